@@ -0,0 +1,39 @@
+#pragma once
+
+#include <snlogger/defines.h>
+#include <snlogger/log_level.h>
+
+#include <stdint.h>
+
+#if defined(SN_COMPILER_MSVC)
+    #include <intrin.h>
+    #define BENCH_HAS_CYCLES 1
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define BENCH_HAS_CYCLES 1
+#else
+    #include <time.h>
+    #define BENCH_HAS_CYCLES 0
+#endif
+
+/**
+ * Cycle counter if available, nanoseconds otherwise.
+ */
+SN_INLINE uint64_t bench_ticks(void) {
+#if BENCH_HAS_CYCLES
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+#define BENCH_TICKS_UNIT (BENCH_HAS_CYCLES ? "cycles" : "ns")
+
+SN_INLINE void bench_null_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    (void)msg;
+    (void)level;
+    // Keep the call from being optimized out
+    *(volatile size_t *)data += len;
+}
@@ -0,0 +1,74 @@
+#if !defined(_WIN32)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <snlogger/snlogger.h>
+
+#include "bench_common.h"
+
+#include <stdio.h>
+
+#if defined(SN_OS_WINDOWS)
+    #define fileno _fileno
+#endif
+
+#define ITERATIONS 200000
+#define BATCH 256
+
+static char ring[1 << 20];
+static char file_buffer[64 * 1024];
+static char format_buffer[4096];
+
+static snBinarySink binary;
+
+typedef enum benchCase {
+    BENCH_TEXT,
+    BENCH_TEXT_DEFERRED,
+    BENCH_BINARY,
+} benchCase;
+
+static const char *case_names[] = {"text", "text_deferred", "binary"};
+
+static const char *host = "10.20.30.40";
+
+int main(void) {
+    printf("case,bytes_per_record,%s_per_record\n", BENCH_TICKS_UNIT);
+
+    for (size_t c = 0; c < SN_ARRAY_LENGTH(case_names); ++c) {
+        FILE *file = tmpfile();
+        if (!file) return 1;
+
+        snFileSink file_sink;
+        sn_file_sink_init(&file_sink, fileno(file), file_buffer, sizeof(file_buffer));
+
+        snSink sink = sn_file_sink(&file_sink);
+        if (c == BENCH_BINARY) {
+            sn_binary_sink_init(&binary, &file_sink);
+            sink = sn_binary_sink(&binary);
+        }
+
+        snAsyncLogger logger;
+        sn_async_logger_init(&logger, ring, sizeof(ring), &sink, 1);
+        if (c != BENCH_TEXT) sn_async_logger_set_deferred_formatting(&logger, format_buffer, sizeof(format_buffer));
+
+        // Logging and processing are both measured, the file write included
+        uint64_t start = bench_ticks();
+        for (int i = 0; i < ITERATIONS; i += BATCH) {
+            for (int j = 0; j < BATCH; ++j)
+                SN_ALOG_INFO(&logger, "request %d from %s took %.3f ms (status %u)", i + j, host, (i + j) * 0.125, 200u);
+
+            sn_async_logger_process(&logger);
+        }
+        sn_async_logger_flush(&logger);
+        uint64_t total = bench_ticks() - start;
+
+        sn_async_logger_deinit(&logger);
+
+        printf("%s,%.1f,%.1f\n", case_names[c], (double)file_sink.bytes_written / ITERATIONS, (double)total / ITERATIONS);
+
+        sn_file_sink_deinit(&file_sink);
+        fclose(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <snlogger/snlogger.h>
+
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Ring size of the measurement, records are never processed
+#define RING_SIZE (64 * 1024)
+
+static char ring[RING_SIZE];
+static char message[256];
+static char format_buffer[1024];
+
+static const size_t message_sizes[] = {16, 40, 64, 80, 120};
+
+/**
+ * Log until the first record is dropped, return the records held.
+ */
+static size_t fill_raw(size_t len) {
+    size_t bytes = 0;
+    snSink sink = {.write = bench_null_sink_write, .data = &bytes};
+
+    snAsyncLogger logger;
+    sn_async_logger_init(&logger, ring, sizeof(ring), &sink, 1);
+
+    size_t count = 0;
+    while (logger.dropped == 0) {
+        sn_async_logger_log_raw(&logger, SN_LOG_LEVEL_INFO, message, len);
+        ++count;
+    }
+
+    sn_async_logger_deinit(&logger);
+    return count - 1;
+}
+
+static size_t fill_typical(bool deferred) {
+    size_t bytes = 0;
+    snSink sink = {.write = bench_null_sink_write, .data = &bytes};
+
+    snAsyncLogger logger;
+    sn_async_logger_init(&logger, ring, sizeof(ring), &sink, 1);
+    if (deferred) sn_async_logger_set_deferred_formatting(&logger, format_buffer, sizeof(format_buffer));
+
+    size_t count = 0;
+    while (logger.dropped == 0) {
+        SN_ALOG_INFO(&logger, "request %d from %s took %.3f ms (status %u)", (int)count, "10.20.30.40", count * 0.125, 200u);
+        ++count;
+    }
+
+    sn_async_logger_deinit(&logger);
+    return count - 1;
+}
+
+static void print_case(const char *name, size_t payload, size_t records) {
+    double per_record = (double)RING_SIZE / (double)records;
+    printf("%s,%zu,%zu,%.1f,%.0f%%\n", name, payload, records, per_record, 100.0 * (per_record - (double)payload) / (double)payload);
+}
+
+int main(void) {
+    memset(message, 'x', sizeof(message));
+
+    printf("case,payload_bytes,records_in_%zu_byte_ring,ring_bytes_per_record,overhead\n", (size_t)RING_SIZE);
+
+    for (size_t i = 0; i < SN_ARRAY_LENGTH(message_sizes); ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "raw_%zu", message_sizes[i]);
+        print_case(name, message_sizes[i], fill_raw(message_sizes[i]));
+    }
+
+    // Payload of the eager record: site pointer and message
+    char text[128];
+    size_t text_len = (size_t)snprintf(text, sizeof(text), "request %d from %s took %.3f ms (status %u)", 1000, "10.20.30.40", 125.0, 200u);
+    print_case("typical", sizeof(void *) + text_len, fill_typical(false));
+    print_case("typical_deferred", sizeof(void *) + text_len, fill_typical(true));
+
+    return 0;
+}
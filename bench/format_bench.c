@@ -0,0 +1,67 @@
+#include <snlogger/snlogger.h>
+
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ITERATIONS 200000
+#define BATCH 256
+
+static char ring[1 << 20];
+
+static char long_arg[1024];
+
+typedef enum benchCase {
+    BENCH_SHORT,
+    BENCH_TYPICAL,
+    BENCH_LONG,
+} benchCase;
+
+static const char *case_names[] = {"short", "typical", "long"};
+
+static void log_case(snAsyncLogger *logger, benchCase c, int i) {
+    switch (c) {
+        case BENCH_SHORT:
+            sn_async_logger_log(logger, SN_LOG_LEVEL_INFO, "tick %d", i);
+            break;
+        case BENCH_TYPICAL:
+            sn_async_logger_log(logger, SN_LOG_LEVEL_INFO, "request %d from %s took %.3f ms (status %u)",
+                    i, "10.20.30.40", i * 0.125, 200u);
+            break;
+        case BENCH_LONG:
+            sn_async_logger_log(logger, SN_LOG_LEVEL_INFO, "payload %d: %s", i, long_arg);
+            break;
+    }
+}
+
+int main(void) {
+    memset(long_arg, 'x', sizeof(long_arg) - 1);
+
+    size_t bytes = 0;
+    snSink sink = {.write = bench_null_sink_write, .data = &bytes};
+
+    printf("case,%s_per_call\n", BENCH_TICKS_UNIT);
+
+    for (size_t c = 0; c < SN_ARRAY_LENGTH(case_names); ++c) {
+        snAsyncLogger logger;
+        sn_async_logger_init(&logger, ring, sizeof(ring), &sink, 1);
+
+        uint64_t total = 0;
+        for (int i = 0; i < ITERATIONS; i += BATCH) {
+            uint64_t start = bench_ticks();
+            for (int j = 0; j < BATCH; ++j)
+                log_case(&logger, (benchCase)c, i + j);
+            total += bench_ticks() - start;
+
+            // Processing is not part of the measurement
+            sn_async_logger_process(&logger);
+        }
+
+        sn_async_logger_deinit(&logger);
+
+        printf("%s,%.1f\n", case_names[c], (double)total / ITERATIONS);
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <snlogger/snlogger.h>
+
+#include "bench_common.h"
+
+#include <stdio.h>
+
+#define ITERATIONS 200000
+
+static char buffer[512];
+
+typedef enum benchCase {
+    BENCH_INTEGERS,
+    BENCH_STRINGS,
+    BENCH_POINTER,
+    BENCH_FIXED,
+    BENCH_GENERAL,
+    BENCH_TYPICAL,
+} benchCase;
+
+static const char *case_names[] = {"integers", "strings", "pointer", "fixed", "general", "typical"};
+
+static const char *host = "10.20.30.40";
+
+#define CASE_INTEGERS "%d %u %ld %lu %llu %zu %x"
+#define CASE_INTEGERS_ARGS(i) -(i), (unsigned)(i) * 7919u, (long)(i) * -104729L, (unsigned long)(i) << 20, \
+        (unsigned long long)(i) * 1000003ull, (size_t)(i), (unsigned)(i) * 2654435761u
+#define CASE_STRINGS "user %s from %.*s: %-12s|"
+#define CASE_STRINGS_ARGS(i) "administrator", (int)((i) & 7) + 4, host, "ok"
+#define CASE_POINTER "object %p released by %p"
+#define CASE_POINTER_ARGS(i) (void *)&buffer[(i) & 255], (void *)host
+#define CASE_FIXED "%f %.3f %.1f"
+#define CASE_FIXED_ARGS(i) (i) * 0.125, (i) / 7.0, -(i) * 3.3
+#define CASE_GENERAL "%g %g %.10g"
+#define CASE_GENERAL_ARGS(i) (i) * 0.001, 1.0 / ((i) + 1), (i) * 1.1
+#define CASE_TYPICAL "request %d from %s took %.3f ms (status %u)"
+#define CASE_TYPICAL_ARGS(i) (i), host, (i) * 0.125, 200u
+
+static void log_case(snStaticLogger *logger, benchCase c, int i) {
+    switch (c) {
+        case BENCH_INTEGERS: sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, CASE_INTEGERS, CASE_INTEGERS_ARGS(i)); break;
+        case BENCH_STRINGS: sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, CASE_STRINGS, CASE_STRINGS_ARGS(i)); break;
+        case BENCH_POINTER: sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, CASE_POINTER, CASE_POINTER_ARGS(i)); break;
+        case BENCH_FIXED: sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, CASE_FIXED, CASE_FIXED_ARGS(i)); break;
+        case BENCH_GENERAL: sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, CASE_GENERAL, CASE_GENERAL_ARGS(i)); break;
+        case BENCH_TYPICAL: sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, CASE_TYPICAL, CASE_TYPICAL_ARGS(i)); break;
+    }
+}
+
+// Same messages through the C library directly, as a reference
+static int snprintf_case(benchCase c, int i) {
+    switch (c) {
+        case BENCH_INTEGERS: return snprintf(buffer, sizeof(buffer), CASE_INTEGERS, CASE_INTEGERS_ARGS(i));
+        case BENCH_STRINGS: return snprintf(buffer, sizeof(buffer), CASE_STRINGS, CASE_STRINGS_ARGS(i));
+        case BENCH_POINTER: return snprintf(buffer, sizeof(buffer), CASE_POINTER, CASE_POINTER_ARGS(i));
+        case BENCH_FIXED: return snprintf(buffer, sizeof(buffer), CASE_FIXED, CASE_FIXED_ARGS(i));
+        case BENCH_GENERAL: return snprintf(buffer, sizeof(buffer), CASE_GENERAL, CASE_GENERAL_ARGS(i));
+        case BENCH_TYPICAL: return snprintf(buffer, sizeof(buffer), CASE_TYPICAL, CASE_TYPICAL_ARGS(i));
+    }
+    return 0;
+}
+
+/**
+ * Compares the formatter of the library against snprintf. Build with
+ * SN_LOGGER_LIBC_FORMATTER=ON to get the same numbers for the vsnprintf
+ * based formatter.
+ */
+int main(void) {
+    size_t bytes = 0;
+    snSink sink = {.write = bench_null_sink_write, .data = &bytes};
+
+    printf("case,logger_%s_per_call,snprintf_%s_per_call\n", BENCH_TICKS_UNIT, BENCH_TICKS_UNIT);
+
+    for (size_t c = 0; c < SN_ARRAY_LENGTH(case_names); ++c) {
+        snStaticLogger logger;
+        sn_static_logger_init(&logger, buffer, sizeof(buffer), &sink, 1);
+
+        uint64_t start = bench_ticks();
+        for (int i = 0; i < ITERATIONS; ++i)
+            log_case(&logger, (benchCase)c, i);
+        uint64_t logger_ticks = bench_ticks() - start;
+
+        sn_static_logger_deinit(&logger);
+
+        volatile int sink_len = 0;
+        start = bench_ticks();
+        for (int i = 0; i < ITERATIONS; ++i)
+            sink_len += snprintf_case((benchCase)c, i);
+        uint64_t snprintf_ticks = bench_ticks() - start;
+
+        printf("%s,%.1f,%.1f\n", case_names[c], (double)logger_ticks / ITERATIONS, (double)snprintf_ticks / ITERATIONS);
+    }
+
+    return 0;
+}
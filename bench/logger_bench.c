@@ -0,0 +1,364 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <snlogger/snlogger.h>
+#include <snlogger/atomic.h>
+
+#include "bench_common.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Throughput and per-call latency of the static and async loggers.
+//
+// Every case logs a fixed number of records per producer into null or
+// in-memory sinks while, for the async logger, a consumer thread keeps
+// processing. Results are printed as CSV, or JSON with --json.
+//
+//   sn_logger_bench [--json] [--quick] [--records N]
+
+#define DEFAULT_RECORDS 100000
+#define QUICK_RECORDS 10000
+
+// Caps the records of large messages, overflow segments grow when the
+// consumer falls behind
+#define BYTES_PER_PRODUCER (16u << 20)
+
+#define MAX_PRODUCERS 4
+#define MAX_MSG_SIZE 1024
+
+#define MEMORY_SINK_SIZE (1u << 20)
+
+typedef struct benchCase {
+    const char *logger; // "static" or "async"
+    int producers;
+    size_t ring_size;
+    size_t msg_size;
+    bool raw; // log_raw instead of a formatted message
+    bool hooks; // memory hooks, overflow segments instead of drops
+    bool memory_sink; // copy records into memory instead of discarding them
+} benchCase;
+
+typedef struct benchResult {
+    size_t records;
+    size_t dropped;
+    double records_per_sec;
+    double p50, p99, p999, max; // nanoseconds
+} benchResult;
+
+typedef struct memorySink {
+    char data[MEMORY_SINK_SIZE];
+    size_t used;
+} memorySink;
+
+static void memory_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    (void)level;
+    memorySink *sink = data;
+
+    if (len > sizeof(sink->data)) len = sizeof(sink->data);
+    if (sizeof(sink->data) - sink->used < len) sink->used = 0;
+
+    memcpy(sink->data + sink->used, msg, len);
+    sink->used += len;
+}
+
+static char payload[MAX_MSG_SIZE + 1];
+
+static double ns_per_tick = 1.0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void calibrate_ticks(void) {
+#if BENCH_HAS_CYCLES
+    uint64_t ns = now_ns();
+    uint64_t ticks = bench_ticks();
+
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 50000000};
+    nanosleep(&pause, NULL);
+
+    ns_per_tick = (double)(now_ns() - ns) / (double)(bench_ticks() - ticks);
+#endif
+}
+
+static void *bench_alloc(size_t size, size_t align, void *data) {
+    (void)align;
+    (void)data;
+    return malloc(size);
+}
+
+static void bench_free(void *ptr, void *data) {
+    (void)data;
+    free(ptr);
+}
+
+static void bench_lock(void *data) {
+    pthread_mutex_lock(data);
+}
+
+static void bench_unlock(void *data) {
+    pthread_mutex_unlock(data);
+}
+
+typedef struct producerArgs {
+    const benchCase *c;
+    snAsyncLogger *async;
+    snStaticLogger *stat;
+    size_t records;
+    uint64_t *latencies;
+    int *start;
+    uint64_t end_ns;
+} producerArgs;
+
+/**
+ * Log one record of msg_size bytes, formatted messages print a counter
+ * and the payload so the formatter has work to do.
+ */
+static void bench_log(const producerArgs *args, int i) {
+    const benchCase *c = args->c;
+
+    if (c->raw) {
+        if (args->async)
+            sn_async_logger_log_raw(args->async, SN_LOG_LEVEL_INFO, payload, c->msg_size);
+        else
+            sn_static_logger_log_raw(args->stat, SN_LOG_LEVEL_INFO, payload, c->msg_size);
+        return;
+    }
+
+    // "req " and 8 digits, then the payload
+    int rest = (int)c->msg_size - 12;
+    if (rest < 0) rest = 0;
+
+    if (args->async)
+        sn_async_logger_log(args->async, SN_LOG_LEVEL_INFO, "req %08d%.*s", i, rest, payload);
+    else
+        sn_static_logger_log(args->stat, SN_LOG_LEVEL_INFO, "req %08d%.*s", i, rest, payload);
+}
+
+static void *producer_main(void *arg) {
+    producerArgs *args = arg;
+
+    while (!sn_atomic_load_acquire(args->start))
+        sn_atomic_pause();
+
+    for (size_t i = 0; i < args->records; ++i) {
+        uint64_t start = bench_ticks();
+        bench_log(args, (int)i);
+        args->latencies[i] = bench_ticks() - start;
+    }
+
+    args->end_ns = now_ns();
+    return NULL;
+}
+
+typedef struct consumerArgs {
+    snAsyncLogger *logger;
+    int done;
+} consumerArgs;
+
+static void *consumer_main(void *arg) {
+    consumerArgs *args = arg;
+
+    while (!sn_atomic_load_acquire(&args->done))
+        if (!sn_async_logger_process(args->logger)) sn_atomic_pause();
+
+    sn_async_logger_drain(args->logger);
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *sorted, size_t count, double p) {
+    size_t index = (size_t)(p * (double)(count - 1));
+    return (double)sorted[index] * ns_per_tick;
+}
+
+static benchResult run_case(const benchCase *c, size_t records_per_producer) {
+    size_t records = SN_MIN(records_per_producer, (size_t)BYTES_PER_PRODUCER / c->msg_size);
+    size_t total = records * (size_t)c->producers;
+
+    uint64_t *latencies = malloc(total * sizeof(*latencies));
+    char *ring = malloc(c->ring_size);
+
+    static memorySink memory;
+    static size_t discarded;
+    memory.used = 0;
+
+    snSink sink = c->memory_sink
+        ? (snSink){.write = memory_sink_write, .data = &memory}
+        : (snSink){.write = bench_null_sink_write, .data = &discarded};
+
+    snAsyncLogger async;
+    snStaticLogger stat;
+    pthread_mutex_t mutex;
+    consumerArgs consumer_args = {.logger = &async};
+    pthread_t consumer;
+
+    bool is_async = strcmp(c->logger, "async") == 0;
+    if (is_async) {
+        sn_async_logger_init(&async, ring, c->ring_size, &sink, 1);
+        if (c->hooks) sn_async_logger_set_memory_hooks(&async, bench_alloc, bench_free, NULL);
+
+        pthread_mutex_init(&mutex, NULL);
+        sn_async_logger_set_lock_hooks(&async, bench_lock, bench_unlock, &mutex);
+
+        pthread_create(&consumer, NULL, consumer_main, &consumer_args);
+    } else {
+        sn_static_logger_init(&stat, ring, c->ring_size, &sink, 1);
+    }
+
+    int start = 0;
+    producerArgs args[MAX_PRODUCERS];
+    pthread_t producers[MAX_PRODUCERS];
+
+    for (int i = 0; i < c->producers; ++i) {
+        args[i] = (producerArgs){
+            .c = c,
+            .async = is_async ? &async : NULL,
+            .stat = is_async ? NULL : &stat,
+            .records = records,
+            .latencies = latencies + (size_t)i * records,
+            .start = &start,
+        };
+        pthread_create(&producers[i], NULL, producer_main, &args[i]);
+    }
+
+    uint64_t start_ns = now_ns();
+    sn_atomic_store_release(&start, 1);
+
+    uint64_t end_ns = start_ns;
+    for (int i = 0; i < c->producers; ++i) {
+        pthread_join(producers[i], NULL);
+        if (args[i].end_ns > end_ns) end_ns = args[i].end_ns;
+    }
+
+    benchResult result = {.records = total};
+
+    if (is_async) {
+        sn_atomic_store_release(&consumer_args.done, 1);
+        pthread_join(consumer, NULL);
+
+        result.dropped = async.dropped;
+        sn_async_logger_deinit(&async);
+        pthread_mutex_destroy(&mutex);
+    } else {
+        sn_static_logger_deinit(&stat);
+    }
+
+    qsort(latencies, total, sizeof(*latencies), compare_u64);
+
+    result.records_per_sec = (double)total / ((double)(end_ns - start_ns) / 1e9);
+    result.p50 = percentile(latencies, total, 0.5);
+    result.p99 = percentile(latencies, total, 0.99);
+    result.p999 = percentile(latencies, total, 0.999);
+    result.max = (double)latencies[total - 1] * ns_per_tick;
+
+    free(ring);
+    free(latencies);
+    return result;
+}
+
+static void print_result(const benchCase *c, const benchResult *r, bool json, bool first) {
+    if (json) {
+        printf("%s  {\"logger\": \"%s\", \"producers\": %d, \"ring\": %zu, \"msg\": %zu, \"mode\": \"%s\", "
+                "\"hooks\": %s, \"sink\": \"%s\", \"records\": %zu, \"dropped\": %zu, \"records_per_sec\": %.0f, "
+                "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f}",
+                first ? "" : ",\n", c->logger, c->producers, c->ring_size, c->msg_size, c->raw ? "raw" : "format",
+                c->hooks ? "true" : "false", c->memory_sink ? "memory" : "null", r->records, r->dropped,
+                r->records_per_sec, r->p50, r->p99, r->p999, r->max);
+        return;
+    }
+
+    printf("%s,%d,%zu,%zu,%s,%d,%s,%zu,%zu,%.0f,%.1f,%.1f,%.1f,%.1f\n",
+            c->logger, c->producers, c->ring_size, c->msg_size, c->raw ? "raw" : "format", c->hooks,
+            c->memory_sink ? "memory" : "null", r->records, r->dropped, r->records_per_sec,
+            r->p50, r->p99, r->p999, r->max);
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    size_t records = DEFAULT_RECORDS;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            records = QUICK_RECORDS;
+        } else if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+            records = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--json] [--quick] [--records N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!records) records = 1;
+
+    memset(payload, 'x', MAX_MSG_SIZE);
+    calibrate_ticks();
+
+    static const int producer_counts[] = {1, 2, 4};
+    static const size_t ring_sizes[] = {64 * 1024, 1024 * 1024};
+    static const size_t msg_sizes[] = {16, 128, 1024};
+
+    if (json) {
+        printf("[\n");
+    } else {
+        printf("logger,producers,ring,msg,mode,hooks,sink,records,dropped,records_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    bool first = true;
+
+    // The static logger writes to its sinks on the calling thread
+    for (size_t m = 0; m < SN_ARRAY_LENGTH(msg_sizes); ++m)
+        for (int raw = 0; raw < 2; ++raw)
+            for (int memory = 0; memory < 2; ++memory) {
+                benchCase c = {
+                    .logger = "static",
+                    .producers = 1,
+                    .ring_size = 4096,
+                    .msg_size = msg_sizes[m],
+                    .raw = raw,
+                    .memory_sink = memory,
+                };
+
+                benchResult r = run_case(&c, records);
+                print_result(&c, &r, json, first);
+                first = false;
+            }
+
+    for (size_t p = 0; p < SN_ARRAY_LENGTH(producer_counts); ++p)
+        for (size_t s = 0; s < SN_ARRAY_LENGTH(ring_sizes); ++s)
+            for (size_t m = 0; m < SN_ARRAY_LENGTH(msg_sizes); ++m)
+                for (int raw = 0; raw < 2; ++raw)
+                    for (int hooks = 0; hooks < 2; ++hooks)
+                        for (int memory = 0; memory < 2; ++memory) {
+                            benchCase c = {
+                                .logger = "async",
+                                .producers = producer_counts[p],
+                                .ring_size = ring_sizes[s],
+                                .msg_size = msg_sizes[m],
+                                .raw = raw,
+                                .hooks = hooks,
+                                .memory_sink = memory,
+                            };
+
+                            benchResult r = run_case(&c, records);
+                            print_result(&c, &r, json, first);
+                            first = false;
+                            fflush(stdout);
+                        }
+
+    if (json) printf("\n]\n");
+
+    return 0;
+}
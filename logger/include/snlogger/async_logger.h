@@ -2,6 +2,7 @@
 
 #include "snlogger/defines.h"
 
+#include "snlogger/clock.h"
 #include "snlogger/log_level.h"
 #include "snlogger/sink.h"
 
@@ -53,29 +54,210 @@ typedef void (*snLockFn)(void *data);
  */
 typedef void (*snUnlockFn)(void *data);
 
+/**
+ * @brief Hook waking the consumer when records are waiting.
+ *
+ * @param data User-provided notification context.
+ *
+ * @note Called by the producer whose log call crossed a threshold, outside
+ *       the lock. Must not call the logger directly or indirectly.
+ * @see sn_async_logger_set_notifier
+ */
+typedef void (*snNotifyFn)(void *data);
+
+/**
+ * @brief Size of the stack buffer messages are formatted into before
+ *        being copied to the ring buffer.
+ *
+ * Longer messages are formatted a second time directly into their record.
+ */
+#ifndef SN_ASYNC_LOGGER_SCRATCH_SIZE
+    #define SN_ASYNC_LOGGER_SCRATCH_SIZE 512
+#endif
+
+/**
+ * @brief Smallest part of the format buffer each sink formats into with
+ *        sink cursors.
+ *
+ * @see sn_async_logger_set_sink_cursors
+ */
+#ifndef SN_ASYNC_SINK_FORMAT_MIN
+    #define SN_ASYNC_SINK_FORMAT_MIN 256
+#endif
+
+/**
+ * @brief Maximum number of records handed to a sink in one write_batch call.
+ *
+ * The processing functions collect up to this many records, take the lock
+ * once for the whole batch and release their ring space after every sink
+ * received it.
+ */
+#ifndef SN_ASYNC_LOGGER_BATCH_SIZE
+    #define SN_ASYNC_LOGGER_BATCH_SIZE 64
+#endif
+
 /**
  * @struct snLogRecordHeader
  * @brief Header stored before each log record in the async logger buffer.
  *
- * This header is immediately followed in memory by the log message payload
- * of @ref len bytes.
+ * This header is immediately followed in memory by the log message payload,
+ * whose length is stored in @ref info (see SN_LOG_RECORD_LEN_SHIFT).
+ * Records are padded to a multiple of 8 bytes, so a record costs 16 bytes
+ * plus its payload rounded up.
  *
  * The message payload is not required to be null-terminated.
  */
 typedef struct snLogRecordHeader {
-    snLogLevel level;   /**< Log level of the record */
-    uint64_t timestamp; /**< Timestamp associated with the record */
-    size_t len;         /**< Length of the message payload in bytes */
+    uint32_t info;      /**< Flags (see SN_LOG_RECORD_COMMITTED), level and payload length */
+    uint32_t sequence;  /**< Low 32 bits of the enqueue order of the record */
+    uint64_t timestamp; /**< Capture time in nanoseconds, 0 without a clock */
 } snLogRecordHeader;
 
 /**
- * @struct snLogRecordHeapNode
- * @brief Node to store log record in heap.
+ * @brief Layout of snLogRecordHeader::info.
+ *
+ * Bits 0-3 hold the record flags, bits 4-7 the log level and bits 8-31 the
+ * payload length. The word is written at once, which publishes the whole
+ * header in lock-free mode. Longer payloads are dropped.
+ */
+#define SN_LOG_RECORD_FLAGS_MASK 0xfu
+#define SN_LOG_RECORD_LEVEL_SHIFT 4
+#define SN_LOG_RECORD_LEN_SHIFT 8
+#define SN_LOG_RECORD_MAX_LEN (UINT32_MAX >> SN_LOG_RECORD_LEN_SHIFT)
+
+/**
+ * @brief Set on a record header once the record is fully written.
+ *
+ * Only used in lock-free mode, where producers publish records
+ * without holding the lock.
+ */
+#define SN_LOG_RECORD_COMMITTED 0x1u
+
+/**
+ * @brief Set on records whose formatting is deferred to processing.
+ *
+ * The payload then holds the format string pointer followed by the
+ * arguments captured from the log call.
+ *
+ * @see sn_async_logger_set_deferred_formatting
+ */
+#define SN_LOG_RECORD_DEFERRED 0x2u
+
+/**
+ * @brief Set on records logged through a call site.
+ *
+ * The payload then starts with the snLogSite pointer. With
+ * SN_LOG_RECORD_DEFERRED the format string is taken from the site.
+ */
+#define SN_LOG_RECORD_SITE 0x4u
+
+/**
+ * @brief Minimum size of the overflow ring segments, in bytes.
+ *
+ * Segments holding a larger record are sized for it.
+ */
+#ifndef SN_ASYNC_SEGMENT_SIZE
+    #define SN_ASYNC_SEGMENT_SIZE (64 * 1024)
+#endif
+
+/**
+ * @struct snAsyncSegment async_logger.h <snlogger/async_logger.h>
+ * @brief Overflow ring segment.
+ *
+ * When the ring is full and memory hooks are set, records are appended to
+ * a chain of segments obtained from the hooks. Each segment is filled
+ * front to back, then the next one is linked. Records are laid out as in
+ * the ring, so a segment is consumed in one pass like a ring that never
+ * wraps. Drained segments are returned to the hooks, except for one spare
+ * kept for the next burst.
+ *
+ * The segment data follows the structure.
+ */
+typedef struct snAsyncSegment {
+    struct snAsyncSegment *next; /**< Next segment in the chain */
+    size_t size; /**< Size of the data in bytes */
+    size_t write_offset; /**< End of the records written by producers */
+    size_t peek_offset; /**< Consumer position, records before it are being emitted */
+} snAsyncSegment;
+
+/**
+ * @enum snBackpressure
+ * @brief What producers do with a record that finds no space.
+ *
+ * Applies once the shard of the thread, the shared ring and the overflow
+ * segments (with memory hooks) are all full.
+ *
+ * @see sn_async_logger_set_backpressure
+ */
+typedef enum snBackpressure {
+    SN_BACKPRESSURE_DROP_NEWEST, /**< Drop the record being logged (default) */
+    SN_BACKPRESSURE_DROP_OLDEST, /**< Drop the oldest unprocessed records of the ring to make room */
+    SN_BACKPRESSURE_BLOCK, /**< Wait until the consumer frees space */
+    SN_BACKPRESSURE_LEVEL, /**< Block from block_level up, drop the others, shed low levels early */
+} snBackpressure;
+
+/**
+ * @enum snBackpressureWait
+ * @brief How blocked producers wait for space.
+ */
+typedef enum snBackpressureWait {
+    SN_BACKPRESSURE_WAIT_SPIN, /**< Busy-wait, lowest latency, burns the core */
+    SN_BACKPRESSURE_WAIT_YIELD, /**< Yield the processor between attempts */
+    SN_BACKPRESSURE_WAIT_FUTEX, /**< Sleep until woken by the consumer (futex, WaitOnAddress) */
+} snBackpressureWait;
+
+/**
+ * @struct snAsyncShard async_logger.h <snlogger/async_logger.h>
+ * @brief Single-producer ring owned by one producer thread.
+ *
+ * Shards are claimed lazily by producer threads on their first log call
+ * and released when the thread exits, see sn_async_logger_set_shards().
+ */
+typedef struct snAsyncShard {
+    void *buffer; /**< Ring buffer storage */
+    size_t buffer_size; /**< Total size of the ring buffer in bytes */
+    uint64_t owner; /**< Id of the owning thread, 0 when free */
+
+    alignas(SN_CACHE_LINE_SIZE) size_t write_offset; /**< Written only by the owning thread */
+    alignas(SN_CACHE_LINE_SIZE) size_t read_offset; /**< Written only by the consumer */
+    size_t peek_offset; /**< Consumer position, records before it are being emitted */
+} snAsyncShard;
+
+/**
+ * @struct snAsyncSinkCursor async_logger.h <snlogger/async_logger.h>
+ * @brief Read position of one sink in the shared ring.
+ *
+ * @see sn_async_logger_set_sink_cursors
+ */
+typedef struct snAsyncSinkCursor {
+    size_t peek_offset; /**< Next record to collect for the sink */
+    size_t read_offset; /**< Records before it were written to the sink */
+    uint64_t sequence; /**< Last record written to the sink */
+    uint32_t detached; /**< Non-zero once the sink lagged beyond the threshold and was left behind */
+    size_t detaches; /**< Times the sink was detached */
+} snAsyncSinkCursor;
+
+/**
+ * @brief Slots probed for the bucket of a call site before it is left
+ *        unlimited.
+ */
+#ifndef SN_ASYNC_RATE_PROBES
+    #define SN_ASYNC_RATE_PROBES 8
+#endif
+
+/**
+ * @struct snAsyncRateSlot async_logger.h <snlogger/async_logger.h>
+ * @brief Token bucket of one call site.
+ *
+ * @see sn_async_logger_set_rate_limit
  */
-typedef struct snLogRecordHeapNode {
-    struct snLogRecordHeapNode *next; /**< Pointer to next node */
-    snLogRecordHeader *record; /**< Pointer to log record header */
-} snLogRecordHeapNode;
+typedef struct snAsyncRateSlot {
+    uintptr_t key; /**< Call site or format string owning the slot, 0 when free */
+    uint32_t kind; /**< Whether key is a call site or a format string, 0 while being claimed */
+    uint32_t level; /**< Level of the last suppressed message */
+    uint64_t full_at; /**< Time the bucket is full again, in nanoseconds */
+    size_t suppressed; /**< Messages suppressed since the last summary */
+} snAsyncRateSlot;
 
 /**
  * @struct snAsyncLogger async_logger.h <snlogger/async_logger.h>
@@ -86,30 +268,30 @@ typedef struct snLogRecordHeapNode {
  *
  * The logger:
  * - Does not create threads
- * - Does not block internally
+ * - Does not block internally, unless a blocking backpressure policy is set
  * - Does not perform I/O during enqueue
  *
  * Thread safety:
  * - Not thread-safe by default
  * - Thread-safe only when lock hooks are installed
  * - Lock hooks must protect both producers and consumers
+ * - In lock-free mode producers never take the lock, see
+ *   sn_async_logger_set_lock_free()
+ * - Producers owning a shard never take the lock, see
+ *   sn_async_logger_set_shards()
+ *
+ * Producer and consumer cursors are kept on separate cache lines.
  */
 typedef struct snAsyncLogger {
-    snLogLevel level; /**< Global log level */
+    snLogLevel level; /**< Effective level, the higher of requested_level and the lowest level a sink accepts */
+    snLogLevel requested_level; /**< Level set with sn_async_logger_set_level() */
+    bool lock_free; /**< Producers reserve space with atomics instead of the lock */
 
     snSink *sinks; /**< List of sinks */
     size_t sink_count; /**< Number of sinks */
 
     void *buffer; /**< Ring buffer storage */
     size_t buffer_size; /**< Total size of the ring buffer in bytes */
-    size_t write_offset; /**< Current write position within the buffer */
-    size_t read_offset; /**< Current read position within the buffer */
-
-    snLogRecordHeapNode *heap_head; /**< Overflow heap list head */
-    snLogRecordHeapNode *heap_tail; /**< Overflow heap list tail */
-
-    uint64_t timestamp; /**< Monotonic record counter */
-    uint64_t processed_timestamp; /**< Last processed record */
 
     snLockFn lock; /**< Optional lock function */
     snUnlockFn unlock; /**< Optional unlock function */
@@ -119,9 +301,110 @@ typedef struct snAsyncLogger {
     snMemoryFreeFn free; /**< Optional memory free hook */
     void *mem_data; /**< User data passed to memory hooks */
 
-    size_t dropped; /**< Number of logs dropped */
+    char *format_buffer; /**< Buffer deferred records are formatted into, enables deferred formatting */
+    size_t format_buffer_size; /**< Size of the format buffer in bytes */
+
+    snClockFn clock; /**< Optional clock giving record timestamps */
+    void *clock_data; /**< User data passed to the clock */
+    snHistogram *queue_histogram; /**< Optional, receives the time records spent queued */
+
+    snBackpressure backpressure; /**< Policy for records that find no space */
+    snBackpressureWait backpressure_wait; /**< How blocked producers wait */
+    snLogLevel shed_level; /**< Highest level shed early by SN_BACKPRESSURE_LEVEL */
+    snLogLevel block_level; /**< Lowest level blocking with SN_BACKPRESSURE_LEVEL */
+
+    snNotifyFn notify; /**< Optional consumer wake-up hook */
+    void *notify_data; /**< User data passed to the notify hook */
+    size_t notify_records; /**< Pending records firing the hook, 0 to ignore */
+    size_t notify_bytes; /**< Bytes used in a ring firing the hook, 0 to ignore */
+    uint64_t notify_age; /**< Age in nanoseconds of pending records firing the hook, 0 to ignore */
+
+    snAsyncSinkCursor *sink_cursors; /**< Optional per-sink read positions, one per sink */
+    size_t sink_detach_bytes; /**< Lag in bytes detaching a sink, 0 to never detach */
+
+    snAsyncRateSlot *rate_slots; /**< Optional per-call-site token buckets */
+    size_t rate_slot_mask; /**< Number of rate slots minus one */
+    uint64_t rate_interval; /**< Nanoseconds between two messages of a call site */
+    uint64_t rate_tolerance; /**< How far ahead a bucket may run, in nanoseconds */
+    snAsyncRateSlot rate_overflow; /**< Bucket shared by the call sites finding no free slot */
+
+    snAsyncShard *shards; /**< Optional per-thread rings */
+    size_t shard_count; /**< Number of shards */
+    uint64_t shard_generation; /**< Identifies this shard set in thread caches */
+    struct snAsyncLogger *shard_next; /**< Next logger with shards, walked when a thread exits */
+
+    // Producer side
+    alignas(SN_CACHE_LINE_SIZE) size_t write_offset; /**< Current write position within the buffer */
+    snAsyncSegment *segment_tail; /**< Overflow segment producers append to */
+    snAsyncSegment *segment_spare; /**< Drained segment kept for the next overflow */
+    size_t segment_count; /**< Segments currently held, the spare included */
+    size_t segment_high_watermark; /**< Highest segment_count */
+    uint64_t sequence; /**< Monotonic record counter */
+    size_t dropped; /**< Number of logs dropped, for any reason */
+    size_t overwritten; /**< Unprocessed records dropped by SN_BACKPRESSURE_DROP_OLDEST */
+    size_t shed; /**< Records shed early by SN_BACKPRESSURE_LEVEL */
+    size_t blocked; /**< Log calls that waited for space */
+    size_t suppressed; /**< Messages suppressed by the rate limit */
+    size_t rate_pending; /**< Suppressed messages no summary reported yet */
+    uint32_t waiters; /**< Producers sleeping on space_epoch */
+    uint32_t notify_armed; /**< Cleared when the notify hook fires, set again by processing */
+    uint64_t pending_since; /**< Capture time of the first record since the last processing */
+    size_t shard_claimed; /**< Number of shard claims made by threads */
+    size_t shard_released; /**< Number of shards released by exiting threads */
+    size_t enqueued[SN_LOG_LEVEL_COUNT]; /**< Records enqueued, per level */
+    size_t level_dropped[SN_LOG_LEVEL_COUNT]; /**< Records dropped, per level */
+    size_t overflow_records; /**< Records stored in overflow segments */
+    size_t overflow_bytes; /**< Bytes of the records stored in overflow segments */
+    size_t ring_high_watermark; /**< Most bytes used at once in the shared ring or a shard */
+    size_t wraps; /**< Times producers wrapped to the start of a ring */
+
+    // Consumer side
+    alignas(SN_CACHE_LINE_SIZE) size_t read_offset; /**< Current read position within the buffer */
+    size_t peek_offset; /**< Consumer position, records before it are being emitted */
+    snAsyncSegment *segment_head; /**< Oldest overflow segment not released yet */
+    snAsyncSegment *segment_peek; /**< Overflow segment the consumer reads from */
+    uint64_t processed_sequence; /**< Last processed record */
+    uint32_t space_epoch; /**< Bumped whenever processing frees ring space */
+    bool processing; /**< A consumer is emitting records, others wait for it */
+    size_t processed[SN_LOG_LEVEL_COUNT]; /**< Records processed, per level */
+    size_t batch_max_records; /**< Most records emitted in one batch */
+    uint64_t batch_max_ns; /**< Longest time spent emitting one batch, in nanoseconds */
 } snAsyncLogger;
 
+/**
+ * @struct snAsyncLoggerStats async_logger.h <snlogger/async_logger.h>
+ * @brief Snapshot of the counters of an async logger.
+ *
+ * @see sn_async_logger_get_stats
+ */
+typedef struct snAsyncLoggerStats {
+    size_t enqueued[SN_LOG_LEVEL_COUNT]; /**< Records enqueued, per level */
+    size_t processed[SN_LOG_LEVEL_COUNT]; /**< Records written to the sinks, per level */
+    size_t dropped[SN_LOG_LEVEL_COUNT]; /**< Records dropped for any reason, per level */
+    size_t dropped_total; /**< Sum of dropped */
+    size_t overwritten; /**< Records dropped by SN_BACKPRESSURE_DROP_OLDEST */
+    size_t shed; /**< Records shed by SN_BACKPRESSURE_LEVEL */
+    size_t blocked; /**< Log calls that waited for space */
+    size_t suppressed; /**< Messages suppressed by the rate limit */
+
+    size_t overflow_records; /**< Records stored in overflow segments */
+    size_t overflow_bytes; /**< Bytes of the records stored in overflow segments */
+    size_t segment_count; /**< Overflow segments currently held */
+    size_t segment_high_watermark; /**< Most overflow segments held at once */
+
+    size_t ring_size; /**< Bytes of the shared ring and the shards */
+    size_t ring_used; /**< Bytes currently used in the shared ring and the shards */
+    size_t ring_high_watermark; /**< Most bytes used at once in the shared ring or a shard */
+    size_t wraps; /**< Times producers wrapped to the start of a ring */
+    size_t pending; /**< Records enqueued but not processed yet */
+
+    size_t batch_max_records; /**< Most records emitted in one batch */
+    uint64_t batch_max_ns; /**< Longest time spent emitting one batch, in nanoseconds */
+
+    size_t sink_calls; /**< Sink write callback invocations, summed over the sinks */
+    size_t sink_records; /**< Records written, summed over the sinks */
+} snAsyncLoggerStats;
+
 /**
  * @brief Initialize an async logger.
  *
@@ -154,6 +437,9 @@ SN_API void sn_async_logger_deinit(snAsyncLogger *logger);
  * @param free Memory free function.
  * @param data User-provided memory context.
  *
+ * Records that do not fit in the ring are then stored in overflow
+ * segments, see snAsyncSegment.
+ *
  * @note Optional. The async logger functions without memory hooks.
  */
 SN_FORCE_INLINE void sn_async_logger_set_memory_hooks(snAsyncLogger *logger, snMemoryAllocateFn alloc, snMemoryFreeFn free, void *data) {
@@ -185,14 +471,292 @@ SN_FORCE_INLINE void sn_async_logger_set_lock_hooks(snAsyncLogger *logger, snLoc
     logger->lock_data = data;
 }
 
+/**
+ * @brief Enable or disable lock-free producer mode.
+ *
+ * In lock-free mode producers reserve ring space with an atomic
+ * compare-and-swap on the write cursor, format the message into the
+ * reserved slot without holding any lock and publish it by setting
+ * SN_LOG_RECORD_COMMITTED on the record header. Processing stops at the
+ * first record that is not committed yet.
+ *
+ * Lock hooks, if installed, are then only taken by the processing
+ * functions to serialize consumers.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param enable Whether to enable lock-free mode.
+ *
+ * @note Must be called before any record is enqueued.
+ * @note Clears the ring buffer.
+ * @note Cannot be combined with shards.
+ * @note Overflow segments are not used in lock-free mode; records that
+ *       do not fit in the ring buffer go to the backpressure policy.
+ * @note Sinks receive records in ring order. A producer takes its sequence
+ *       number after reserving space, so snSinkRecord::sequence is not
+ *       monotonic: a record may reach the sinks before one with a lower
+ *       sequence. Sinks that rely on the order must sort by sequence.
+ */
+SN_API void sn_async_logger_set_lock_free(snAsyncLogger *logger, bool enable);
+
+/**
+ * @brief Give producer threads their own rings.
+ *
+ * The buffer is split evenly between the shards. Each producer thread
+ * claims a shard on its first log call and from then on enqueues into it
+ * without taking the lock or contending with other producers. Every record
+ * is tagged with the global record counter and the processing functions
+ * merge the shards, the shared ring and the overflow segments in that order,
+ * so enqueue order is preserved.
+ *
+ * Threads that find no free shard, and records that do not fit in the
+ * shard of their thread, go through the shared ring as usual.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param shards Array of shards.
+ * @param shard_count Number of shards in the array.
+ * @param buffer Storage split between the shards.
+ * @param buffer_size Size of the storage in bytes.
+ *
+ * @note Must be called before any record is enqueued.
+ * @note A claimed shard stays owned by its thread until the thread exits,
+ *       size the shard count to the number of concurrent producers.
+ *       Records left in the shard of an exited thread are still processed.
+ * @note The logger must be deinitialized before its memory is reused,
+ *       exiting threads look it up to release their shards.
+ * @note Cannot be combined with lock-free mode.
+ * @note The shards and buffer must remain valid for the lifetime of the logger.
+ */
+SN_API void sn_async_logger_set_shards(snAsyncLogger *logger, snAsyncShard *shards, size_t shard_count, void *buffer, size_t buffer_size);
+
+/**
+ * @brief Give every sink its own read position in the ring.
+ *
+ * By default a batch is written to every sink before the next one is
+ * collected, so the slowest sink sets the pace. With cursors, each sink
+ * reads the ring at its own pace through sn_async_logger_process_sink_n(),
+ * typically from a thread of its own, and ring space is released once
+ * every attached sink wrote it.
+ *
+ * A sink lagging more than detach_bytes behind the newest record, while
+ * another sink keeps up, is detached so it stops holding ring space. It
+ * skips the records it missed when attached again with
+ * sn_async_logger_attach_sink().
+ *
+ * With deferred formatting, the format buffer is split evenly between the
+ * sinks formatting messages (sinks without SN_SINK_DEFERRED), so they can
+ * be processed concurrently. Each part holds at least
+ * SN_ASYNC_SINK_FORMAT_MIN bytes, and deferred messages longer than their
+ * part are truncated. Size the buffer for the number of text sinks.
+ *
+ * The queue histogram records one sample per record and sink.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param cursors Array of sink_count cursors, NULL to disable.
+ * @param detach_bytes Lag in bytes detaching a sink, 0 to never detach.
+ *
+ * @note Must be called before any record is enqueued.
+ * @note Cannot be combined with lock-free mode or shards. Overflow
+ *       segments are not used, records that do not fit in the ring go to
+ *       the backpressure policy and SN_BACKPRESSURE_DROP_OLDEST drops the
+ *       newest record.
+ * @note The cursors must remain valid for the lifetime of the logger.
+ */
+SN_API void sn_async_logger_set_sink_cursors(snAsyncLogger *logger, snAsyncSinkCursor *cursors, size_t detach_bytes);
+
+/**
+ * @brief Limit the rate of the messages of each call site.
+ *
+ * Every call site gets a token bucket, keyed by its snLogSite for the
+ * SN_ALOG_* macros and by its format string otherwise. The bucket is
+ * checked by the producer before any formatting, a message finding it
+ * empty is suppressed and counted in snAsyncLoggerStats::suppressed, not
+ * as dropped. The next message let through is preceded by a summary record
+ * at the same level, such as "suppressed 42 messages from src/net.c:120".
+ * A call site that went quiet gets its summary from the processing
+ * functions once its bucket has a token again, or at deinit.
+ *
+ * Buckets live in a small open-addressed table updated with atomic
+ * operations only, no lock is taken. Call sites that find no free slot
+ * within SN_ASYNC_RATE_PROBES slots share one overflow bucket.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param slots Array of slot_count zeroed slots, NULL to disable.
+ * @param slot_count Number of slots, a power of two.
+ * @param rate Messages per second each call site may log.
+ * @param burst Messages a call site may log at once after being quiet, at least 1.
+ *
+ * @note sn_async_logger_log_raw() is not limited.
+ * @note Summaries logged by the processing functions never wait for
+ *       space, a summary finding none is retried later.
+ * @note The slots must remain valid for the lifetime of the logger.
+ */
+SN_API void sn_async_logger_set_rate_limit(snAsyncLogger *logger, snAsyncRateSlot *slots, size_t slot_count, uint64_t rate, uint64_t burst);
+
+/**
+ * @brief Defer message formatting to the processing functions.
+ *
+ * When enabled, sn_async_logger_log() and sn_async_logger_log_va() do not
+ * format the message. They store the format string pointer and a compact
+ * binary copy of the arguments (integers, floating point values, pointers
+ * and the contents of %s strings) in the record. The message is formatted
+ * into the given buffer just before the record is written to the sinks.
+ *
+ * Messages whose arguments cannot be captured (for example %n) or do not
+ * fit in SN_ASYNC_LOGGER_SCRATCH_SIZE bytes are formatted at enqueue time
+ * as usual.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param buffer Buffer used by the processing functions, NULL to disable.
+ * @param buffer_size Size of the buffer in bytes, 0 to disable. Longer
+ *                    messages are truncated.
+ *
+ * @note The format string passed to the log functions must stay valid
+ *       until the record is processed, string literals are fine.
+ * @note Must not be disabled while deferred records are queued.
+ * @note With sink cursors the buffer is shared by the sinks, see
+ *       sn_async_logger_set_sink_cursors().
+ */
+SN_API void sn_async_logger_set_deferred_formatting(snAsyncLogger *logger, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Set the clock giving the timestamp of records.
+ *
+ * The clock is read once per enqueued record, before its ring space is
+ * reserved, so the timestamp is the capture time of the log call rather
+ * than its processing time. Sinks receive it in snSinkRecord::timestamp.
+ * Without a clock timestamps are 0.
+ *
+ * Records are still ordered by their sequence number, timestamps of
+ * different threads may be slightly out of order.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param clock Clock hook, for example sn_clock_monotonic_coarse(),
+ *              sn_clock_realtime() or sn_clock_tsc(). NULL to disable.
+ * @param data User data passed to the clock.
+ */
+SN_FORCE_INLINE void sn_async_logger_set_clock(snAsyncLogger *logger, snClockFn clock, void *data) {
+    logger->clock = clock;
+    logger->clock_data = data;
+}
+
+/**
+ * @brief Record how long records wait before reaching the sinks.
+ *
+ * For every processed record, the time between its capture and the moment
+ * its batch is handed to the sinks is recorded into the histogram, read
+ * from the logger clock. Together with snSink::write_histogram it tells
+ * whether the ring or the processing interval is too small.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param histogram Initialized histogram, NULL to disable. Must stay
+ *                  valid while it is set.
+ *
+ * @note Requires a clock, see sn_async_logger_set_clock(). Use one that is
+ *       cheap to read and does not go backwards, sn_clock_tsc() for example.
+ */
+SN_FORCE_INLINE void sn_async_logger_set_queue_histogram(snAsyncLogger *logger, snHistogram *histogram) {
+    logger->queue_histogram = histogram;
+}
+
+/**
+ * @brief Wake the consumer when enough records are waiting.
+ *
+ * The hook fires when a log call finds that the pending records, the bytes
+ * used in the ring it wrote to, or the age of the records pending since the
+ * last processing reach their threshold. It then stays quiet until the
+ * consumer processed records, so a burst costs one wake-up. The consumer
+ * can block in futex or epoll instead of polling, see snNotifier.
+ *
+ * Thresholds are only checked by log calls: the consumer should still wait
+ * with a timeout, the age threshold for example, to pick up a lone record.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param notify Hook waking the consumer, for example sn_notifier_notify(). NULL to disable.
+ * @param data User data passed to the hook.
+ * @param records Pending record count, 0 to ignore.
+ * @param bytes Bytes used in the ring, 0 to ignore.
+ * @param age Nanoseconds since the first pending record was captured,
+ *            0 to ignore. Requires a clock, see sn_async_logger_set_clock().
+ *
+ * @note Without a notifier the logger does no I/O and wakes no one, as before.
+ */
+SN_FORCE_INLINE void sn_async_logger_set_notifier(snAsyncLogger *logger, snNotifyFn notify, void *data, size_t records, size_t bytes, uint64_t age) {
+    logger->notify = notify;
+    logger->notify_data = data;
+    logger->notify_records = records;
+    logger->notify_bytes = bytes;
+    logger->notify_age = age;
+    logger->notify_armed = 1;
+    logger->pending_since = 0;
+}
+
+/**
+ * @brief Choose what happens to records that find no space.
+ *
+ * - SN_BACKPRESSURE_DROP_NEWEST drops the record being logged.
+ * - SN_BACKPRESSURE_DROP_OLDEST drops the oldest unprocessed records of the
+ *   shared ring until the new one fits, keeping the most recent history.
+ *   Falls back to dropping the newest record while a batch is being
+ *   emitted, while overflow segments hold records, with shards and in
+ *   lock-free mode, where the ring is not the only ordered source.
+ * - SN_BACKPRESSURE_BLOCK waits until the consumer frees space, so no
+ *   record is lost.
+ * - SN_BACKPRESSURE_LEVEL blocks records of block_level and above, drops
+ *   the others and sheds records of shed_level and below as soon as less
+ *   than a quarter of the ring is free, keeping room for the important ones.
+ *   See sn_async_logger_set_backpressure_levels().
+ *
+ * The policy is per logger, so a latency-critical logger can drop while
+ * an audit logger blocks. Counters: dropped, overwritten, shed, blocked.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param policy Backpressure policy.
+ * @param wait How blocked producers wait.
+ *
+ * @note Blocking requires records to be processed by another thread.
+ *       Without lock hooks and outside lock-free mode the logger is not
+ *       shared between threads, so records are dropped instead.
+ * @note Records larger than half the ring are dropped instead of waiting,
+ *       they may not fit even once the ring is empty.
+ */
+SN_FORCE_INLINE void sn_async_logger_set_backpressure(snAsyncLogger *logger, snBackpressure policy, snBackpressureWait wait) {
+    logger->backpressure = policy;
+    logger->backpressure_wait = wait;
+}
+
+/**
+ * @brief Set the levels used by SN_BACKPRESSURE_LEVEL.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param shed_level Records up to this level are shed early, SN_LOG_LEVEL_DEBUG by default.
+ * @param block_level Records from this level up block, SN_LOG_LEVEL_WARN by default.
+ */
+SN_FORCE_INLINE void sn_async_logger_set_backpressure_levels(snAsyncLogger *logger, snLogLevel shed_level, snLogLevel block_level) {
+    logger->shed_level = shed_level;
+    logger->block_level = block_level;
+}
+
 /**
  * @brief Set the global log level.
  *
+ * Records of lower levels, and of levels below the lowest one a sink
+ * accepts (see snSink::levels), are rejected before formatting.
+ *
  * @param logger Pointer to the async logger context.
  * @param level New log level.
  */
 SN_FORCE_INLINE void sn_async_logger_set_level(snAsyncLogger *logger, snLogLevel level) {
-    logger->level = level;
+    logger->requested_level = level;
+    logger->level = SN_MAX(level, sn_sinks_min_level(logger->sinks, logger->sink_count));
+}
+
+/**
+ * @brief Recompute the level after the levels of a sink changed.
+ *
+ * @param logger Pointer to the async logger context.
+ */
+SN_FORCE_INLINE void sn_async_logger_refresh_level(snAsyncLogger *logger) {
+    sn_async_logger_set_level(logger, logger->requested_level);
 }
 
 /**
@@ -206,6 +770,8 @@ SN_FORCE_INLINE void sn_async_logger_set_level(snAsyncLogger *logger, snLogLevel
  * @note This function only enqueues the message. It does not write to sinks.
  * @note This function is not thread-safe unless lock hooks are installed
  *       or external synchronization is provided by the caller.
+ * @note With deferred formatting enabled, fmt must stay valid until the
+ *       record is processed.
  */
 SN_API void sn_async_logger_log_va(snAsyncLogger *logger, snLogLevel level, const char *fmt, va_list args);
 
@@ -233,6 +799,102 @@ SN_INLINE void sn_async_logger_log(snAsyncLogger *logger, snLogLevel level, cons
     va_end(args);
 }
 
+/**
+ * @brief Enqueue a message of a call site using a va_list.
+ *
+ * The record carries only a pointer to the site and the message, or the
+ * captured arguments with deferred formatting. Sinks with write_record
+ * receive the site along with the message.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param site The call site, must stay valid until the record is processed.
+ * @param args Arguments of the site format string.
+ *
+ * @note Use the SN_ALOG() macros instead of calling this directly.
+ * @note Ignored unless sn_log_site_enabled() is true for the logger level.
+ * @note This function is not thread-safe unless lock hooks are installed
+ *       or external synchronization is provided by the caller.
+ */
+SN_API void sn_async_logger_log_site_va(snAsyncLogger *logger, const snLogSite *site, va_list args);
+
+/**
+ * @brief Enqueue a message of a call site.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param site The call site, must stay valid until the record is processed.
+ * @param fmt Unused, the format string of the site. Lets the macros pass
+ *            their arguments through unchanged.
+ * @param ... Format arguments.
+ *
+ * @see sn_async_logger_log_site_va
+ */
+SN_INLINE void sn_async_logger_log_site(snAsyncLogger *logger, const snLogSite *site, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    sn_async_logger_log_site_va(logger, site, args);
+    va_end(args);
+}
+
+/**
+ * @brief Log through a static call site descriptor.
+ *
+ * Defines an snLogSite holding the level, source location and format
+ * string once for the call site, so records only carry a pointer to it.
+ * The format string (first argument after the level) must be a string
+ * literal. The arguments are not evaluated if the site is disabled.
+ *
+ * The site follows the logger level unless it is forced on or off with
+ * sn_log_site_set_mode(). Levels below SN_LOG_MIN_LEVEL are compiled out.
+ *
+ * @code
+ * SN_ALOG_INFO(&logger, "request %d took %.3f ms", id, ms);
+ * @endcode
+ */
+#define SN_ALOG(logger, lvl, ...) do { \
+        if ((int)(lvl) >= SN_LOG_MIN_LEVEL) { \
+            SN_LOG_SITE_DEFINE(sn_log_site_, lvl, SN_FIRST_ARG(__VA_ARGS__)); \
+            snAsyncLogger *sn_logger_ = (logger); \
+            if (sn_log_site_enabled(&sn_log_site_, sn_logger_->level)) \
+                sn_async_logger_log_site(sn_logger_, &sn_log_site_, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#if SN_LOG_MIN_LEVEL <= 0
+    #define SN_ALOG_TRACE(logger, ...) SN_ALOG(logger, SN_LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+    #define SN_ALOG_TRACE(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 1
+    #define SN_ALOG_DEBUG(logger, ...) SN_ALOG(logger, SN_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+    #define SN_ALOG_DEBUG(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 2
+    #define SN_ALOG_INFO(logger, ...) SN_ALOG(logger, SN_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+    #define SN_ALOG_INFO(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 3
+    #define SN_ALOG_WARN(logger, ...) SN_ALOG(logger, SN_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+    #define SN_ALOG_WARN(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 4
+    #define SN_ALOG_ERROR(logger, ...) SN_ALOG(logger, SN_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+    #define SN_ALOG_ERROR(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 5
+    #define SN_ALOG_FATAL(logger, ...) SN_ALOG(logger, SN_LOG_LEVEL_FATAL, __VA_ARGS__)
+#else
+    #define SN_ALOG_FATAL(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
 /**
  * @brief Enqueue a raw log message without formatting.
  *
@@ -242,27 +904,95 @@ SN_INLINE void sn_async_logger_log(snAsyncLogger *logger, snLogLevel level, cons
  * @param len Length of the message in bytes.
  *
  * @note The message is copied into the async logger buffer.
+ * @note Messages longer than SN_LOG_RECORD_MAX_LEN (16 MiB) are dropped.
  * @note This function is not thread-safe unless lock hooks are installed
  *       or external synchronization is provided by the caller.
  */
 SN_API void sn_async_logger_log_raw(snAsyncLogger *logger, snLogLevel level, const char *msg, size_t len);
 
+/**
+ * @brief Read the counters of the logger.
+ *
+ * Counters are maintained with relaxed atomics as records flow, so the
+ * snapshot can be taken from any thread at any time, for example once per
+ * second by a metrics exporter, without taking the lock. Counters read
+ * while records are logged may be a few records apart from each other.
+ * Per-sink counts are in snSink::calls and snSink::records.
+ *
+ * @param logger Pointer to the async logger context.
+ * @param stats Receives the counters.
+ */
+SN_API void sn_async_logger_get_stats(const snAsyncLogger *logger, snAsyncLoggerStats *stats);
+
 /**
  * @brief Process at max n queued log records.
  *
  * Writes queued records to all sinks in order.
  *
+ * With sink cursors, n bounds each attached sink separately: every sink
+ * is handed at max n records in turn, so one call may dispatch up to n
+ * times the number of sinks. The return value then counts the records
+ * released from the ring, the ones every attached sink is done with,
+ * not the number of records dispatched; see snSink::records for that.
+ *
  * @param logger Pointer to the async logger context.
- * @param n Number of records to process at max.
+ * @param n Number of records to process at max, per sink with sink cursors.
  *
- * @return Number of log records processed.
+ * @return Number of log records processed, with sink cursors the number
+ *         of records released from the ring.
  *
  * @note Intended to be called by a user-managed consumer thread or loop.
  * @note This function is not thread-safe unless lock hooks are installed
  *       or external synchronization is provided by the caller.
+ * @note One consumer processes at a time, a concurrent call waits for the
+ *       one in progress to finish. A sink callback must not process the
+ *       logger it is called from.
  */
 SN_API size_t sn_async_logger_process_n(snAsyncLogger *logger, size_t n);
 
+/**
+ * @brief Process at max n queued log records for one sink.
+ *
+ * Writes the records the sink has not received yet, in order, without
+ * waiting for the other sinks. Different sinks may be processed from
+ * different threads at once when lock hooks are installed.
+ *
+ * @param logger Pointer to the async logger context, with sink cursors.
+ * @param sink Index of the sink.
+ * @param n Number of records to process at max.
+ *
+ * @return Number of log records written to the sink, 0 if it is detached.
+ *
+ * @see sn_async_logger_set_sink_cursors
+ */
+SN_API size_t sn_async_logger_process_sink_n(snAsyncLogger *logger, size_t sink, size_t n);
+
+/**
+ * @brief Bytes of the ring a sink has not written yet.
+ *
+ * @param logger Pointer to the async logger context, with sink cursors.
+ * @param sink Index of the sink.
+ * @param records Receives the number of records the sink has not written
+ *                yet, may be NULL.
+ *
+ * @return The lag in bytes, 0 for a detached sink.
+ *
+ * @note May be called from any thread, the result is approximate while
+ *       records are logged.
+ */
+SN_API size_t sn_async_logger_sink_lag(const snAsyncLogger *logger, size_t sink, uint64_t *records);
+
+/**
+ * @brief Attach a detached sink again.
+ *
+ * The sink resumes with the next record logged, the records it missed are
+ * not written to it.
+ *
+ * @param logger Pointer to the async logger context, with sink cursors.
+ * @param sink Index of the sink.
+ */
+SN_API void sn_async_logger_attach_sink(snAsyncLogger *logger, size_t sink);
+
 /**
  * @brief Process queued log records.
  *
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+// Minimal atomic helpers used by the library and its inline functions.
+// Only 32-bit and 64-bit integer objects are supported.
+
+#if defined(SN_COMPILER_MSVC)
+    #include <intrin.h>
+
+    SN_FORCE_INLINE bool sn_atomic_cas_64(volatile __int64 *ptr, void *expected, __int64 desired) {
+        __int64 exp = *(__int64 *)expected;
+        __int64 prev = _InterlockedCompareExchange64(ptr, desired, exp);
+        if (prev == exp) return true;
+        *(__int64 *)expected = prev;
+        return false;
+    }
+
+    SN_FORCE_INLINE bool sn_atomic_cas_32(volatile long *ptr, void *expected, long desired) {
+        long exp = *(long *)expected;
+        long prev = _InterlockedCompareExchange(ptr, desired, exp);
+        if (prev == exp) return true;
+        *(long *)expected = prev;
+        return false;
+    }
+
+    // Aligned loads and stores are atomic on x64 and volatile accesses
+    // have acquire/release semantics with /volatile:ms (default on x64).
+    #define sn_atomic_load_relaxed(ptr) (sizeof(*(ptr)) == 8 \
+            ? (uint64_t)*(volatile __int64 *)(ptr) : (uint64_t)(uint32_t)*(volatile long *)(ptr))
+    #define sn_atomic_load_acquire(ptr) sn_atomic_load_relaxed(ptr)
+
+    #define sn_atomic_store_relaxed(ptr, val) (sizeof(*(ptr)) == 8 \
+            ? (void)(*(volatile __int64 *)(ptr) = (__int64)(val)) : (void)(*(volatile long *)(ptr) = (long)(val)))
+    #define sn_atomic_store_release(ptr, val) sn_atomic_store_relaxed(ptr, val)
+
+    #define sn_atomic_fetch_add_relaxed(ptr, val) (sizeof(*(ptr)) == 8 \
+            ? (uint64_t)_InterlockedExchangeAdd64((volatile __int64 *)(ptr), (__int64)(val)) \
+            : (uint64_t)(uint32_t)_InterlockedExchangeAdd((volatile long *)(ptr), (long)(val)))
+
+    #define sn_atomic_exchange_relaxed(ptr, val) (sizeof(*(ptr)) == 8 \
+            ? (uint64_t)_InterlockedExchange64((volatile __int64 *)(ptr), (__int64)(val)) \
+            : (uint64_t)(uint32_t)_InterlockedExchange((volatile long *)(ptr), (long)(val)))
+
+    #define sn_atomic_cas(ptr, expected, desired) (sizeof(*(ptr)) == 8 \
+            ? sn_atomic_cas_64((volatile __int64 *)(ptr), (expected), (__int64)(desired)) \
+            : sn_atomic_cas_32((volatile long *)(ptr), (expected), (long)(desired)))
+
+    #define sn_atomic_fence() _mm_mfence()
+
+    #define sn_atomic_pause() _mm_pause()
+#else
+    #define sn_atomic_load_relaxed(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+    #define sn_atomic_load_acquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+
+    #define sn_atomic_store_relaxed(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+    #define sn_atomic_store_release(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+    #define sn_atomic_fetch_add_relaxed(ptr, val) __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+
+    #define sn_atomic_exchange_relaxed(ptr, val) __atomic_exchange_n((ptr), (val), __ATOMIC_RELAXED)
+
+    // Weak compare-exchange, on failure *expected is updated with the current value
+    #define sn_atomic_cas(ptr, expected, desired) \
+        __atomic_compare_exchange_n((ptr), (expected), (desired), true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+
+    // Full barrier, orders earlier stores before later loads
+    #define sn_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+    #if defined(__x86_64__) || defined(__i386__)
+        #define sn_atomic_pause() __builtin_ia32_pause()
+    #elif defined(__aarch64__)
+        #define sn_atomic_pause() __asm__ __volatile__("yield")
+    #else
+        #define sn_atomic_pause() ((void)0)
+    #endif
+#endif
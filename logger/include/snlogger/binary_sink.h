@@ -0,0 +1,138 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+#include "snlogger/file_sink.h"
+
+/**
+ * @brief Maximum number of format strings and call sites a binary sink
+ *        tracks. Records of further ones are written as text.
+ */
+#ifndef SN_BINARY_SINK_MAX_DESCRIPTORS
+    #define SN_BINARY_SINK_MAX_DESCRIPTORS 1024
+#endif
+
+/**
+ * @brief Binary log file format.
+ *
+ * A file starts with the 4 byte magic "SNLB", a version byte and 3 zero
+ * bytes, followed by records. Each record starts with a tag byte holding
+ * the record type in bits 0-1 and the log level in bits 2-4. Integers are
+ * LEB128 varints, sequence numbers and timestamps are zigzag encoded
+ * deltas to the previous record. Deltas may be negative, records of a
+ * lock-free logger are written in ring order rather than sequence order.
+ *
+ * - SN_BINARY_RECORD_TEXT: sequence delta, timestamp delta, message
+ *   length, message.
+ * - SN_BINARY_RECORD_ARGS: sequence delta, timestamp delta, descriptor id,
+ *   size of the arguments, then the arguments in order: integers and
+ *   pointers as varints, floating point values as little-endian doubles,
+ *   strings as length and bytes.
+ * - SN_BINARY_RECORD_DESCRIPTOR: descriptor id, line, then the file,
+ *   function and format string, each as length and bytes. Written once
+ *   before the first record using the descriptor. File and function are
+ *   empty for records not logged through a call site.
+ */
+#define SN_BINARY_MAGIC "SNLB"
+#define SN_BINARY_VERSION 2
+#define SN_BINARY_HEADER_SIZE 8
+
+#define SN_BINARY_RECORD_TEXT 0u
+#define SN_BINARY_RECORD_ARGS 1u
+#define SN_BINARY_RECORD_DESCRIPTOR 2u
+
+/**
+ * @struct snBinarySink binary_sink.h <snlogger/binary_sink.h>
+ * @brief Sink writing records in a compact binary format.
+ *
+ * Deferred records (see sn_async_logger_set_deferred_formatting()) are
+ * stored as a descriptor id and their encoded arguments, so the message is
+ * never rendered on the host. The format string and call site of each
+ * descriptor are written once per file. Other records are stored as text.
+ * Use the snlog-decode tool to turn the file back into text.
+ *
+ * The encoded bytes go through an snFileSink, which does the buffering.
+ *
+ * @code
+ * snFileSink file;
+ * sn_file_sink_init(&file, fd, buffer, sizeof(buffer));
+ *
+ * static snBinarySink binary;
+ * sn_binary_sink_init(&binary, &file);
+ *
+ * snSink sinks[] = {sn_binary_sink(&binary)};
+ * @endcode
+ */
+typedef struct snBinarySink {
+    snFileSink *file; /**< Output */
+    uint64_t sequence; /**< Sequence number of the previous record */
+    uint64_t timestamp; /**< Timestamp of the previous record */
+
+    const void *keys[SN_BINARY_SINK_MAX_DESCRIPTORS]; /**< Call site or format string of each descriptor, hashed */
+    uint32_t ids[SN_BINARY_SINK_MAX_DESCRIPTORS]; /**< Descriptor id of each key */
+    uint32_t descriptor_count; /**< Descriptors written */
+
+    uint64_t records; /**< Records written */
+    uint64_t text_records; /**< Records written as text */
+} snBinarySink;
+
+/**
+ * @brief Initialize a binary sink and write the file header.
+ *
+ * @param sink Pointer to the binary sink.
+ * @param file File sink the encoded records are written to, must remain
+ *             valid as long as the binary sink is used.
+ */
+SN_API void sn_binary_sink_init(snBinarySink *sink, snFileSink *file);
+
+/**
+ * @brief snSinkWriteFn of the binary sink, data is the snBinarySink.
+ */
+SN_API void sn_binary_sink_write(const char *msg, size_t len, snLogLevel level, void *data);
+
+/**
+ * @brief snSinkWriteBatchFn of the binary sink, data is the snBinarySink.
+ */
+SN_API void sn_binary_sink_write_batch(const snSinkRecord *records, size_t count, void *data);
+
+/**
+ * @brief snSinkFlushFn of the binary sink, data is the snBinarySink.
+ *
+ * Flushes the underlying file sink.
+ */
+SN_API void sn_binary_sink_flush(void *data);
+
+/**
+ * @brief Format the encoded arguments of a SN_BINARY_RECORD_ARGS record.
+ *
+ * Behaves like snprintf(): returns the length of the full message and
+ * writes at most len bytes including the null character.
+ *
+ * @param buffer Output buffer.
+ * @param len Size of the output buffer.
+ * @param fmt Format string of the descriptor.
+ * @param args Encoded arguments.
+ * @param args_size Size of the encoded arguments.
+ *
+ * @return The message length, or (size_t)-1 if the arguments do not
+ *         match the format string.
+ */
+SN_API size_t sn_binary_format(char *buffer, size_t len, const char *fmt, const void *args, size_t args_size);
+
+/**
+ * @brief Get the snSink of a binary sink.
+ *
+ * The sink has SN_SINK_DEFERRED set, so deferred records are not
+ * formatted unless another sink of the logger needs the text.
+ *
+ * @param sink Pointer to the binary sink.
+ */
+SN_FORCE_INLINE snSink sn_binary_sink(snBinarySink *sink) {
+    return (snSink){
+        .write = sn_binary_sink_write,
+        .flush = sn_binary_sink_flush,
+        .data = sink,
+        .write_batch = sn_binary_sink_write_batch,
+        .flags = SN_SINK_DEFERRED,
+    };
+}
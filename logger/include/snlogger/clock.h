@@ -0,0 +1,109 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+/**
+ * @brief Clock hook giving the capture time of log records.
+ *
+ * @param data User-provided clock context.
+ *
+ * @return The current time in nanoseconds.
+ *
+ * @note Called by producers on every log call that is not filtered out,
+ *       possibly from several threads at once. Must be cheap.
+ * @note Must not call the logger directly or indirectly.
+ */
+typedef uint64_t (*snClockFn)(void *data);
+
+/**
+ * @brief snClockFn reading CLOCK_MONOTONIC, data is unused.
+ *
+ * Uses QueryPerformanceCounter() on Windows.
+ */
+SN_API uint64_t sn_clock_monotonic(void *data);
+
+/**
+ * @brief snClockFn reading CLOCK_MONOTONIC_COARSE, data is unused.
+ *
+ * Only as precise as the scheduler tick (1-4 ms) but several times
+ * cheaper than sn_clock_monotonic(). Same as sn_clock_monotonic() where
+ * the coarse clock does not exist, except on Windows where it uses
+ * GetTickCount64().
+ */
+SN_API uint64_t sn_clock_monotonic_coarse(void *data);
+
+/**
+ * @brief snClockFn reading CLOCK_REALTIME, nanoseconds since the Unix
+ *        epoch, data is unused.
+ */
+SN_API uint64_t sn_clock_realtime(void *data);
+
+/**
+ * @struct snTscClock clock.h <snlogger/clock.h>
+ * @brief Clock converting the CPU time stamp counter to nanoseconds.
+ *
+ * Reading the counter takes a single instruction, the conversion is a
+ * multiplication by the calibrated period. The period is measured against
+ * a reference clock and refined by sn_tsc_clock_calibrate(), which should
+ * be called periodically, for example from the thread processing the
+ * logger. Differences to the reference clock are corrected by adjusting
+ * the period rather than stepping the clock back.
+ *
+ * Requires an invariant TSC on x86. On other architectures sn_clock_tsc()
+ * reads the reference clock directly.
+ *
+ * @code
+ * static snTscClock tsc;
+ * sn_tsc_clock_init(&tsc, sn_clock_realtime, NULL, 1000000000);
+ * sn_async_logger_set_clock(&logger, sn_clock_tsc, &tsc);
+ *
+ * // Processing thread
+ * sn_async_logger_process(&logger);
+ * sn_tsc_clock_calibrate(&tsc);
+ * @endcode
+ */
+typedef struct snTscClock {
+    uint64_t version; /**< Odd while the conversion is updated */
+    uint64_t tsc_base; /**< Counter value at ns_base */
+    uint64_t ns_base; /**< Time at tsc_base */
+    uint64_t mult; /**< Period in nanoseconds, fixed point with shift fractional bits */
+    uint32_t shift; /**< Fractional bits of mult */
+
+    snClockFn reference; /**< Clock the counter is calibrated against */
+    void *reference_data; /**< User data passed to the reference clock */
+    uint64_t interval; /**< Nanoseconds between calibrations */
+    uint64_t calibration_tsc; /**< Counter value at the last calibration */
+    uint64_t calibration_ns; /**< Reference time at the last calibration */
+} snTscClock;
+
+/**
+ * @brief Initialize a TSC clock.
+ *
+ * Measures the counter period for about a millisecond.
+ *
+ * @param clock Pointer to the TSC clock.
+ * @param reference Clock to follow, NULL for sn_clock_monotonic().
+ * @param data User data passed to the reference clock.
+ * @param interval Minimum nanoseconds between two calibrations.
+ */
+SN_API void sn_tsc_clock_init(snTscClock *clock, snClockFn reference, void *data, uint64_t interval);
+
+/**
+ * @brief Recalibrate a TSC clock against its reference clock.
+ *
+ * Does nothing until the calibration interval elapsed since the last
+ * calibration, so it can be called often.
+ *
+ * @param clock Pointer to the TSC clock.
+ *
+ * @return true if the clock was recalibrated.
+ *
+ * @note Must not be called from several threads at once. sn_clock_tsc()
+ *       may run concurrently.
+ */
+SN_API bool sn_tsc_clock_calibrate(snTscClock *clock);
+
+/**
+ * @brief snClockFn of a TSC clock, data is the snTscClock.
+ */
+SN_API uint64_t sn_clock_tsc(void *data);
@@ -32,6 +32,12 @@
 
 #define SN_INLINE static inline
 
+#if defined(SN_COMPILER_MSVC)
+    #define SN_THREAD_LOCAL __declspec(thread)
+#else
+    #define SN_THREAD_LOCAL _Thread_local
+#endif
+
 #if defined(SN_COMPILER_MSVC)
     #define SN_FORCE_INLINE static __forceinline
 #else
@@ -46,6 +52,10 @@
 
 #define SN_UNUSED(x) (void)(x)
 
+// First argument of a variadic macro, the list must not be empty
+#define SN_FIRST_ARG(...) SN_FIRST_ARG_(__VA_ARGS__, 0)
+#define SN_FIRST_ARG_(first, ...) first
+
 #define SN_ARRAY_LENGTH(arr) (sizeof(arr) / sizeof(arr[0]))
 
 #define SN_MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -54,3 +64,5 @@
 
 #define SN_CLAMP(x, min, max) ((x) < (min) ? (min) : (x) > (max) ? (max) : (x))
 
+#define SN_CACHE_LINE_SIZE 64
+
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+#include "snlogger/async_logger.h"
+#include "snlogger/sink.h"
+
+/**
+ * @struct snFileSink file_sink.h <snlogger/file_sink.h>
+ * @brief Buffered sink writing records to a file descriptor.
+ *
+ * Each record is written as its message followed by a newline. Records
+ * are accumulated in a buffer and written out when it is full or a
+ * threshold is reached (see sn_file_sink_set_thresholds()). Batches that
+ * do not fit in the buffer are written with a single writev() straight
+ * from the records, without copying them.
+ *
+ * The sink only writes when one of its callbacks is called, it never
+ * creates threads. It is not thread-safe, which matches the loggers:
+ * records are written from the processing functions of the async logger
+ * or by the caller of the static logger.
+ *
+ * @code
+ * static char buffer[64 * 1024];
+ * snFileSink file;
+ * sn_file_sink_init(&file, STDOUT_FILENO, buffer, sizeof(buffer));
+ *
+ * snSink sinks[] = {sn_file_sink(&file)};
+ * @endcode
+ */
+typedef struct snFileSink {
+    int fd; /**< Destination file descriptor, not owned by the sink */
+
+    char *buffer; /**< Record buffer, NULL when unbuffered */
+    size_t buffer_size; /**< Size of the buffer in bytes */
+    size_t used; /**< Bytes waiting in the buffer */
+    size_t pending_records; /**< Records waiting in the buffer */
+
+    size_t flush_bytes; /**< Write out once this many bytes are buffered, 0 when the buffer is full */
+    size_t flush_records; /**< Write out once this many records are buffered, 0 to disable */
+    bool sync; /**< Sync the file to storage on flush */
+
+    snMemoryFreeFn free; /**< Frees the buffer on deinit if it was allocated by the sink */
+    void *mem_data; /**< User data passed to the free hook */
+
+    uint64_t bytes_written; /**< Bytes written to the file */
+    uint64_t syscalls; /**< Write and sync system calls issued */
+    uint64_t errors; /**< Failed system calls, the data of a failed write is dropped */
+} snFileSink;
+
+/**
+ * @brief Initialize a file sink with a user-provided buffer.
+ *
+ * @param sink Pointer to the file sink.
+ * @param fd File descriptor records are written to.
+ * @param buffer Record buffer, NULL to write every record or batch directly.
+ * @param buffer_size Size of the buffer in bytes.
+ *
+ * @note The buffer must remain valid until sn_file_sink_deinit().
+ * @note The file descriptor is not closed by the sink.
+ */
+SN_API void sn_file_sink_init(snFileSink *sink, int fd, char *buffer, size_t buffer_size);
+
+/**
+ * @brief Initialize a file sink with a buffer allocated through memory hooks.
+ *
+ * @param sink Pointer to the file sink.
+ * @param fd File descriptor records are written to.
+ * @param buffer_size Size of the buffer to allocate in bytes.
+ * @param alloc Memory allocation function.
+ * @param free Memory free function, called by sn_file_sink_deinit().
+ * @param data User-provided memory context.
+ *
+ * @return false if the allocation failed, the sink is then unbuffered.
+ */
+SN_API bool sn_file_sink_init_alloc(snFileSink *sink, int fd, size_t buffer_size,
+        snMemoryAllocateFn alloc, snMemoryFreeFn free, void *data);
+
+/**
+ * @brief Deinitialize a file sink.
+ *
+ * Writes out the buffered records and frees the buffer if it was
+ * allocated by the sink.
+ *
+ * @param sink Pointer to the file sink.
+ */
+SN_API void sn_file_sink_deinit(snFileSink *sink);
+
+/**
+ * @brief Set when buffered records are written out.
+ *
+ * @param sink Pointer to the file sink.
+ * @param bytes Write out once this many bytes are buffered, 0 to wait for
+ *              the buffer to be full.
+ * @param records Write out once this many records are buffered, 0 to disable.
+ */
+SN_FORCE_INLINE void sn_file_sink_set_thresholds(snFileSink *sink, size_t bytes, size_t records) {
+    sink->flush_bytes = bytes;
+    sink->flush_records = records;
+}
+
+/**
+ * @brief Sync the file to storage on every flush.
+ *
+ * @param sink Pointer to the file sink.
+ * @param enable Whether flushes call fdatasync() (fsync() or _commit()
+ *               where it is not available).
+ */
+SN_FORCE_INLINE void sn_file_sink_set_sync(snFileSink *sink, bool enable) {
+    sink->sync = enable;
+}
+
+/**
+ * @brief snSinkWriteFn of the file sink, data is the snFileSink.
+ */
+SN_API void sn_file_sink_write(const char *msg, size_t len, snLogLevel level, void *data);
+
+/**
+ * @brief snSinkWriteBatchFn of the file sink, data is the snFileSink.
+ */
+SN_API void sn_file_sink_write_batch(const snSinkRecord *records, size_t count, void *data);
+
+/**
+ * @brief Write raw bytes through the buffer of the file sink.
+ *
+ * Unlike the write callbacks no newline is added and the record threshold
+ * is not updated. Used by sinks encoding their own format on top of a
+ * file sink, like snBinarySink.
+ *
+ * @param sink Pointer to the file sink.
+ * @param data Bytes to write.
+ * @param len Number of bytes.
+ */
+SN_API void sn_file_sink_write_raw(snFileSink *sink, const void *data, size_t len);
+
+/**
+ * @brief snSinkFlushFn of the file sink, data is the snFileSink.
+ *
+ * Writes out the buffered records, then syncs the file if enabled with
+ * sn_file_sink_set_sync().
+ */
+SN_API void sn_file_sink_flush(void *data);
+
+/**
+ * @brief Get the snSink of a file sink.
+ *
+ * @param sink Pointer to the file sink.
+ *
+ * @return A sink with the write, write_batch and flush callbacks of the
+ *         file sink.
+ */
+SN_FORCE_INLINE snSink sn_file_sink(snFileSink *sink) {
+    return (snSink){
+        .write = sn_file_sink_write,
+        .flush = sn_file_sink_flush,
+        .data = sink,
+        .write_batch = sn_file_sink_write_batch,
+    };
+}
@@ -2,7 +2,21 @@
 
 #include "snlogger/defines.h"
 
-#include <stdarg.h>
+/**
+ * @brief Maximum number of arguments (including '*' width and precision) of
+ *        a format string parsed for a call site.
+ */
+#define SN_FORMAT_MAX_ARGS 16
 
-// TODO:
-size_t format_string(char *restrict buffer, size_t len, const char *restrict fmt, va_list args);
+/**
+ * @struct snFormatArgs formatter.h <snlogger/formatter.h>
+ * @brief Argument list of a format string, parsed once so the arguments can
+ *        be captured without scanning the format string again.
+ *
+ * @see sn_log_site_args
+ */
+typedef struct snFormatArgs {
+    uint32_t count; /**< Number of arguments */
+    uint8_t kinds[SN_FORMAT_MAX_ARGS]; /**< Type of each argument */
+    int32_t bounds[SN_FORMAT_MAX_ARGS]; /**< Precision of %s arguments, negative without one */
+} snFormatArgs;
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+/**
+ * @brief Sub-buckets per power of two, as a number of bits.
+ *
+ * 4 bits give 16 sub-buckets, so recorded values are rounded up by at most
+ * 1/16 (6.25 %).
+ */
+#ifndef SN_HISTOGRAM_SUB_BITS
+    #define SN_HISTOGRAM_SUB_BITS 4
+#endif
+
+#define SN_HISTOGRAM_SUB_BUCKETS (1u << SN_HISTOGRAM_SUB_BITS)
+
+/**
+ * @brief Number of buckets covering the whole uint64_t range.
+ *
+ * Values below SN_HISTOGRAM_SUB_BUCKETS get a bucket each, every power of
+ * two above is split into SN_HISTOGRAM_SUB_BUCKETS buckets.
+ */
+#define SN_HISTOGRAM_BUCKETS ((65 - SN_HISTOGRAM_SUB_BITS) * SN_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @struct snHistogram histogram.h <snlogger/histogram.h>
+ * @brief Log-linear histogram of durations in nanoseconds, HDR style.
+ *
+ * Recording is a handful of relaxed atomic additions, so a histogram can be
+ * recorded by the consumer while another thread takes snapshots. Covers
+ * the full uint64_t range with a bounded relative error and a fixed size
+ * of about 8 KiB, nothing is allocated.
+ *
+ * The async logger records the time records spent queued into one (see
+ * sn_async_logger_set_queue_histogram()) and both loggers record the
+ * duration of the sink writes into snSink::write_histogram.
+ *
+ * @code
+ * snHistogram snapshot;
+ * sn_histogram_snapshot(&queue, &snapshot, true);
+ * printf("p99 %llu ns\n", (unsigned long long)sn_histogram_percentile(&snapshot, 99.0));
+ * @endcode
+ */
+typedef struct snHistogram {
+    uint64_t count; /**< Values recorded */
+    uint64_t sum; /**< Sum of the values */
+    uint64_t min; /**< Smallest value, UINT64_MAX when empty */
+    uint64_t max; /**< Largest value */
+    uint64_t counts[SN_HISTOGRAM_BUCKETS]; /**< Values per bucket */
+} snHistogram;
+
+/**
+ * @brief Initialize an empty histogram.
+ */
+SN_API void sn_histogram_init(snHistogram *histogram);
+
+/**
+ * @brief Record a value.
+ *
+ * @param histogram Pointer to the histogram.
+ * @param value Value to count, nanoseconds for the loggers.
+ */
+SN_API void sn_histogram_record(snHistogram *histogram, uint64_t value);
+
+/**
+ * @brief Copy a histogram, and optionally reset it.
+ *
+ * May be called while another thread records. With reset, every value
+ * ends up in exactly one snapshot.
+ *
+ * @param histogram Pointer to the histogram.
+ * @param out Receives the copy.
+ * @param reset Whether to empty the histogram.
+ */
+SN_API void sn_histogram_snapshot(snHistogram *histogram, snHistogram *out, bool reset);
+
+/**
+ * @brief Value below which the given percentage of the values fall.
+ *
+ * @param histogram Pointer to a histogram, typically a snapshot.
+ * @param percentile Percentage between 0 and 100.
+ *
+ * @return Upper bound of the bucket holding the percentile, at most the
+ *         largest value recorded. 0 when empty.
+ */
+SN_API uint64_t sn_histogram_percentile(const snHistogram *histogram, double percentile);
+
+/**
+ * @brief Largest value counted in a bucket.
+ *
+ * @param index Bucket index, below SN_HISTOGRAM_BUCKETS.
+ */
+SN_API uint64_t sn_histogram_bucket_upper(size_t index);
@@ -12,3 +12,38 @@ typedef enum snLogLevel {
     SN_LOG_LEVEL_ERROR,
     SN_LOG_LEVEL_FATAL
 } snLogLevel;
+
+/**
+ * @brief Number of log levels, sizes per-level arrays.
+ */
+#define SN_LOG_LEVEL_COUNT (SN_LOG_LEVEL_FATAL + 1)
+
+/**
+ * @brief Bit of a level in a level mask, see snSink::levels.
+ */
+#define SN_LOG_LEVEL_BIT(level) (1u << (level))
+
+/**
+ * @brief Level mask holding every level.
+ */
+#define SN_LOG_LEVEL_ALL ((1u << SN_LOG_LEVEL_COUNT) - 1)
+
+/**
+ * @brief Level mask holding a level and the levels above it.
+ */
+#define SN_LOG_LEVELS_FROM(level) (SN_LOG_LEVEL_ALL & ~(SN_LOG_LEVEL_BIT(level) - 1))
+
+/**
+ * @brief Lowest level compiled in by the logging macros.
+ *
+ * Numeric so it can be used by the preprocessor: 0 TRACE, 1 DEBUG, 2 INFO,
+ * 3 WARN, 4 ERROR, 5 FATAL, 6 disables all macros. Macros of lower levels
+ * (SN_ALOG_DEBUG() and friends) compile to nothing and do not evaluate
+ * their arguments.
+ *
+ * Define it before including the headers or on the command line, e.g.
+ * -DSN_LOG_MIN_LEVEL=2 for release builds.
+ */
+#ifndef SN_LOG_MIN_LEVEL
+    #define SN_LOG_MIN_LEVEL 0
+#endif
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+#include "snlogger/atomic.h"
+#include "snlogger/formatter.h"
+#include "snlogger/log_level.h"
+
+/**
+ * @brief States of the parsed argument list of a call site.
+ */
+#define SN_LOG_SITE_ARGS_UNPARSED 0u
+#define SN_LOG_SITE_ARGS_PARSING 1u
+#define SN_LOG_SITE_ARGS_READY 2u
+#define SN_LOG_SITE_ARGS_UNSUPPORTED 3u
+
+/**
+ * @brief Call site flags, see snLogSiteState.
+ */
+#define SN_LOG_SITE_REGISTERED 0x1u /**< The site is in the site list */
+#define SN_LOG_SITE_FORCE_ON 0x2u /**< Logs regardless of the logger level */
+#define SN_LOG_SITE_FORCE_OFF 0x4u /**< Never logs */
+
+/**
+ * @enum snLogSiteMode
+ * @brief Runtime override of a call site.
+ */
+typedef enum snLogSiteMode {
+    SN_LOG_SITE_DEFAULT, /**< Follow the logger level */
+    SN_LOG_SITE_ENABLED, /**< Always log, even below the logger level */
+    SN_LOG_SITE_DISABLED, /**< Never log */
+} snLogSiteMode;
+
+struct snLogSite;
+
+/**
+ * @struct snLogSiteState log_site.h <snlogger/log_site.h>
+ * @brief Mutable state of a call site.
+ *
+ * C cannot parse the format string at compile time, so every call site
+ * keeps this small mutable state next to its read-only descriptor:
+ * - The site registers itself in the global site list the first time it
+ *   is executed, so it can be found and toggled at runtime.
+ * - The first capturing log call parses the argument list of the format
+ *   string once, later calls capture their arguments without scanning it.
+ */
+typedef struct snLogSiteState {
+    uint32_t flags; /**< SN_LOG_SITE_* flags */
+    uint32_t args_state; /**< One of SN_LOG_SITE_ARGS_* */
+    snFormatArgs args; /**< Parsed argument list, valid once args_state is SN_LOG_SITE_ARGS_READY */
+    const struct snLogSite *site; /**< The site, set on registration */
+    struct snLogSiteState *next; /**< Next registered site */
+} snLogSiteState;
+
+/**
+ * @struct snLogSite log_site.h <snlogger/log_site.h>
+ * @brief Static descriptor of a logging call site.
+ *
+ * Defined once per call site by the logging macros (see SN_ALOG()) so
+ * records only carry a pointer to it instead of the source location and
+ * format string.
+ */
+typedef struct snLogSite {
+    snLogLevel level; /**< Log level of the call site */
+    uint32_t line; /**< Source line */
+    const char *file; /**< Source file */
+    const char *function; /**< Enclosing function */
+    const char *fmt; /**< Format string */
+    snLogSiteState *state; /**< Mutable state */
+} snLogSite;
+
+/**
+ * @brief Define a static call site descriptor named name.
+ *
+ * fmt must be a string literal.
+ */
+#define SN_LOG_SITE_DEFINE(name, lvl, fmt_) \
+    static snLogSiteState name##_state_; \
+    static const snLogSite name = { \
+        .level = (lvl), \
+        .line = __LINE__, \
+        .file = __FILE__, \
+        .function = __func__, \
+        .fmt = (fmt_), \
+        .state = &name##_state_, \
+    }
+
+/**
+ * @brief Register a call site in the site list.
+ *
+ * Called by sn_log_site_enabled() on the first execution of the site.
+ *
+ * @param site Pointer to the call site.
+ *
+ * @return The flags of the site.
+ *
+ * @note Thread-safe.
+ */
+SN_API uint32_t sn_log_site_register(const snLogSite *site);
+
+/**
+ * @brief Whether a call site logs with the given logger level.
+ *
+ * Registers the site on first use. Sites forced on or off with
+ * sn_log_site_set_mode() ignore the level.
+ *
+ * @param site Pointer to the call site.
+ * @param level Current level of the logger.
+ */
+SN_FORCE_INLINE bool sn_log_site_enabled(const snLogSite *site, snLogLevel level) {
+    uint32_t flags = (uint32_t)sn_atomic_load_relaxed(&site->state->flags);
+    if (!(flags & SN_LOG_SITE_REGISTERED)) flags = sn_log_site_register(site);
+
+    if (flags & (SN_LOG_SITE_FORCE_ON | SN_LOG_SITE_FORCE_OFF))
+        return (flags & SN_LOG_SITE_FORCE_ON) != 0;
+
+    return site->level >= level;
+}
+
+/**
+ * @brief Override the logger level for one call site.
+ *
+ * @param site Pointer to the call site.
+ * @param mode The new mode.
+ *
+ * @note Thread-safe. Takes effect on the next execution of the site.
+ */
+SN_API void sn_log_site_set_mode(const snLogSite *site, snLogSiteMode mode);
+
+/**
+ * @brief Get the mode of a call site.
+ *
+ * @param site Pointer to the call site.
+ */
+SN_API snLogSiteMode sn_log_site_get_mode(const snLogSite *site);
+
+/**
+ * @brief Iterate the registered call sites.
+ *
+ * Sites register on their first execution, sites that never ran are not
+ * listed.
+ *
+ * @param site The previous site, NULL to get the first one.
+ *
+ * @return The next site, or NULL at the end of the list.
+ *
+ * @note Thread-safe, sites registered during the iteration may be missed.
+ */
+SN_API const snLogSite *sn_log_site_next(const snLogSite *site);
+
+/**
+ * @brief Set the mode of all registered call sites matching a pattern.
+ *
+ * @param file Suffix of the source file, NULL matches any file.
+ * @param line Source line, 0 matches any line.
+ * @param function Name of the enclosing function, NULL matches any function.
+ * @param mode The new mode.
+ *
+ * @return Number of call sites changed.
+ *
+ * @note Thread-safe. Only sites that already ran are affected.
+ */
+SN_API size_t sn_log_sites_set_mode(const char *file, uint32_t line, const char *function, snLogSiteMode mode);
+
+/**
+ * @brief Get the parsed argument list of a call site.
+ *
+ * Parses the format string on the first call.
+ *
+ * @param site Pointer to the call site.
+ *
+ * @return The argument list, or NULL if the format string cannot be
+ *         captured or another thread is parsing it right now.
+ *
+ * @note Thread-safe.
+ */
+SN_API const snFormatArgs *sn_log_site_args(const snLogSite *site);
+
+/**
+ * @brief Accepts and ignores log macro arguments.
+ *
+ * Used by the macros of levels below SN_LOG_MIN_LEVEL so the arguments
+ * stay type-checked and referenced without being evaluated.
+ */
+SN_INLINE void sn_log_discard(const void *logger, const char *fmt, ...) {
+    SN_UNUSED(logger);
+    SN_UNUSED(fmt);
+}
+
+/**
+ * @brief Expansion of a logging macro whose level is compiled out.
+ */
+#define SN_LOG_DISCARD(logger, ...) do { \
+        if (0) sn_log_discard((logger), __VA_ARGS__); \
+    } while (0)
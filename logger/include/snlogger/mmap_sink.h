@@ -0,0 +1,115 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+#include "snlogger/sink.h"
+
+/**
+ * @brief Nanoseconds a segment sink waits before creating a segment again
+ *        after a failure. Records written in the meantime are dropped.
+ */
+#ifndef SN_MMAP_SINK_RETRY_NS
+    #define SN_MMAP_SINK_RETRY_NS 1000000000ull
+#endif
+
+/**
+ * @struct snMmapSink mmap_sink.h <snlogger/mmap_sink.h>
+ * @brief Sink copying records into memory-mapped log segments.
+ *
+ * Records are written one per line into a preallocated segment file
+ * mapped in memory, so writing a batch is a memcpy into the page cache
+ * without any system call. When a record does not fit in the rest of the
+ * segment, the segment is truncated to its used length and the next one
+ * is created. Records larger than a segment are split.
+ *
+ * Segments are named path.000000, path.000001, ... Existing segments are
+ * never overwritten, a sink starts at the first unused index, so a
+ * restarted process appends new segments after the ones of earlier runs.
+ *
+ * Not available on Windows.
+ *
+ * @code
+ * snMmapSink segments;
+ * sn_mmap_sink_init(&segments, "/var/log/app/app.log", 64 << 20);
+ *
+ * snSink sinks[] = {sn_mmap_sink(&segments)};
+ * @endcode
+ */
+typedef struct snMmapSink {
+    const char *path; /**< Base path of the segments */
+    size_t segment_size; /**< Preallocated size of each segment in bytes */
+    uint32_t segment; /**< Index of the current segment */
+
+    int fd; /**< Current segment file, -1 if none */
+    char *map; /**< Mapping of the current segment, NULL if none */
+    size_t used; /**< Bytes written to the current segment */
+    size_t synced; /**< Bytes of the current segment already synced */
+
+    uint64_t bytes_written; /**< Bytes copied to the segments */
+    uint64_t segments; /**< Segments created */
+    uint64_t syscalls; /**< System calls issued */
+    uint64_t errors; /**< Failed system calls */
+    uint64_t dropped; /**< Records dropped or cut short because no segment could be created */
+    uint64_t retry_at; /**< Monotonic time before which no segment is created after a failure */
+    bool closed; /**< Set by sn_mmap_sink_close(), later writes are dropped */
+} snMmapSink;
+
+/**
+ * @brief Initialize a segment sink and create its first segment.
+ *
+ * @param sink Pointer to the segment sink.
+ * @param path Base path of the segments, must remain valid until the sink
+ *             is closed.
+ * @param segment_size Size of each segment in bytes.
+ *
+ * @return false if the first segment could not be created. The sink tries
+ *         again on a write at least SN_MMAP_SINK_RETRY_NS later.
+ */
+SN_API bool sn_mmap_sink_init(snMmapSink *sink, const char *path, size_t segment_size);
+
+/**
+ * @brief snSinkWriteFn of the segment sink, data is the snMmapSink.
+ */
+SN_API void sn_mmap_sink_write(const char *msg, size_t len, snLogLevel level, void *data);
+
+/**
+ * @brief snSinkWriteBatchFn of the segment sink, data is the snMmapSink.
+ */
+SN_API void sn_mmap_sink_write_batch(const snSinkRecord *records, size_t count, void *data);
+
+/**
+ * @brief snSinkFlushFn of the segment sink, data is the snMmapSink.
+ *
+ * Synchronously writes the range of the current segment written since
+ * the last flush back to the file with msync(). Earlier segments only had
+ * their writeback started, without waiting, when the sink rolled over to
+ * the next segment.
+ */
+SN_API void sn_mmap_sink_flush(void *data);
+
+/**
+ * @brief snSinkCloseFn of the segment sink, data is the snMmapSink.
+ *
+ * Truncates the current segment to its used length and unmaps it. Also
+ * used to deinitialize a sink that is not attached to a logger. Records
+ * written after closing are dropped.
+ */
+SN_API void sn_mmap_sink_close(void *data);
+
+/**
+ * @brief Get the snSink of a segment sink.
+ *
+ * @param sink Pointer to the segment sink.
+ *
+ * @return A sink with the write, write_batch, flush and close callbacks of
+ *         the segment sink.
+ */
+SN_FORCE_INLINE snSink sn_mmap_sink(snMmapSink *sink) {
+    return (snSink){
+        .write = sn_mmap_sink_write,
+        .flush = sn_mmap_sink_flush,
+        .close = sn_mmap_sink_close,
+        .data = sink,
+        .write_batch = sn_mmap_sink_write_batch,
+    };
+}
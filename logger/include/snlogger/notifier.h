@@ -0,0 +1,80 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+/**
+ * @brief Timeout of sn_notifier_wait() that never expires.
+ */
+#define SN_NOTIFIER_WAIT_FOREVER UINT64_MAX
+
+/**
+ * @enum snNotifierKind
+ * @brief How an snNotifier signals the consumer.
+ */
+typedef enum snNotifierKind {
+    SN_NOTIFIER_FUTEX, /**< Counter waited on with futex (WaitOnAddress on Windows) */
+    SN_NOTIFIER_EVENTFD, /**< eventfd the consumer can add to its epoll set, Linux only */
+} snNotifierKind;
+
+/**
+ * @struct snNotifier notifier.h <snlogger/notifier.h>
+ * @brief Built-in consumer wake-up for sn_async_logger_set_notifier().
+ *
+ * @code
+ * snNotifier notifier;
+ * sn_notifier_init(&notifier, SN_NOTIFIER_FUTEX);
+ * sn_async_logger_set_notifier(&logger, sn_notifier_notify, &notifier, 64, 0, 0);
+ *
+ * // Consumer thread, the timeout bounds the latency of a lone record
+ * while (running) {
+ *     sn_notifier_wait(&notifier, 10000000);
+ *     sn_async_logger_process(&logger);
+ * }
+ * @endcode
+ *
+ * With SN_NOTIFIER_EVENTFD, fd becomes readable on notification. After
+ * epoll reports it, sn_notifier_wait() with a zero timeout resets it.
+ */
+typedef struct snNotifier {
+    snNotifierKind kind; /**< Signalling mechanism */
+    int fd; /**< eventfd of SN_NOTIFIER_EVENTFD, -1 otherwise */
+    uint32_t signal; /**< Bumped by every notification of SN_NOTIFIER_FUTEX */
+    uint32_t seen; /**< Last signal value consumed by the waiter */
+    size_t notifications; /**< Number of notifications sent */
+} snNotifier;
+
+/**
+ * @brief Initialize a notifier.
+ *
+ * @param notifier Pointer to the notifier.
+ * @param kind Signalling mechanism.
+ *
+ * @return false if the mechanism is not available, SN_NOTIFIER_EVENTFD
+ *         outside Linux or when eventfd() fails.
+ */
+SN_API bool sn_notifier_init(snNotifier *notifier, snNotifierKind kind);
+
+/**
+ * @brief Release the resources of a notifier.
+ */
+SN_API void sn_notifier_deinit(snNotifier *notifier);
+
+/**
+ * @brief snNotifyFn waking the consumer, data is the snNotifier.
+ */
+SN_API void sn_notifier_notify(void *data);
+
+/**
+ * @brief Wait for a notification.
+ *
+ * Returns immediately if a notification arrived since the previous call.
+ *
+ * @param notifier Pointer to the notifier.
+ * @param timeout Nanoseconds to wait at most, 0 to only check,
+ *                SN_NOTIFIER_WAIT_FOREVER for no limit.
+ *
+ * @return true if notified, false on timeout.
+ *
+ * @note Only one thread may wait on a notifier.
+ */
+SN_API bool sn_notifier_wait(snNotifier *notifier, uint64_t timeout);
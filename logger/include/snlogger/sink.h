@@ -2,7 +2,9 @@
 
 #include "snlogger/defines.h"
 
+#include "snlogger/histogram.h"
 #include "snlogger/log_level.h"
+#include "snlogger/log_site.h"
 
 /**
  * @brief Sink write function for the logger.
@@ -25,6 +27,67 @@
  */
 typedef void (*snSinkWriteFn)(const char *msg, size_t len, snLogLevel level, void *data);
 
+/**
+ * @struct snSinkRecord sink.h <snlogger/sink.h>
+ * @brief View of a log record passed to snSinkWriteRecordFn.
+ *
+ * Only valid for the duration of the call.
+ *
+ * Deferred records (see sn_async_logger_set_deferred_formatting()) also
+ * carry their format string and captured arguments. Their msg is NULL if
+ * every sink of the logger has SN_SINK_DEFERRED set.
+ */
+typedef struct snSinkRecord {
+    const char *msg; /**< Formatted message, not null-terminated */
+    size_t len; /**< Length of the message in bytes */
+    snLogLevel level; /**< Log level of the record */
+    const snLogSite *site; /**< Call site, NULL unless logged through a call site (see SN_ALOG()) */
+    uint64_t sequence; /**< Enqueue order in the async logger, 0 for the static logger. Not monotonic in lock-free mode */
+    uint64_t timestamp; /**< Capture time in nanoseconds from the logger clock, 0 without one (see sn_async_logger_set_clock()) */
+    const char *fmt; /**< Format string of a deferred record, NULL otherwise */
+    const void *args; /**< Arguments of a deferred record, captured by the producer in the library's internal layout */
+    size_t args_size; /**< Size of the captured arguments in bytes */
+} snSinkRecord;
+
+/**
+ * @brief Sink write function receiving the whole record.
+ *
+ * Alternative to snSinkWriteFn for sinks that use more than the message,
+ * like the source location of the call site.
+ *
+ * @param record The log record
+ * @param data User-defined sink data
+ *
+ * @note Same restrictions as snSinkWriteFn.
+ */
+typedef void (*snSinkWriteRecordFn)(const snSinkRecord *record, void *data);
+
+/**
+ * @brief Sink write function receiving several records at once.
+ *
+ * Called by the async logger processing functions with every record
+ * collected in one pass (at most SN_ASYNC_LOGGER_BATCH_SIZE), in enqueue
+ * order, so the sink can hand them to the system in a single call
+ * (writev(), sendmmsg(), ...).
+ *
+ * @param records Array of log records
+ * @param count Number of records, at least 1
+ * @param data User-defined sink data
+ *
+ * @note The records are only valid for the duration of the call.
+ * @note Same restrictions as snSinkWriteFn.
+ */
+typedef void (*snSinkWriteBatchFn)(const snSinkRecord *records, size_t count, void *data);
+
+/**
+ * @brief Sink flag: the sink handles deferred records from their format
+ *        string and captured arguments and does not need their message.
+ *
+ * When every sink of an async logger has it, deferred records are not
+ * formatted at all.
+ */
+#define SN_SINK_DEFERRED 0x1u
+
 /**
  * @brief Sink open callback.
  *
@@ -89,18 +152,130 @@ typedef void (*snSinkFlushFn)(void *data);
  *
  * Sink lifecycle:
  * - @c open  is called during logger initialization (if provided)
- * - @c write is called for each log record (required)
+ * - @c write_record, or @c write if not provided, is called for each
+ *   log record
+ * - @c write_batch, if provided, is used by the async logger instead of
+ *   the per-record callbacks (one of the three is required)
  * - @c flush may be called explicitly or before shutdown (if provided)
  * - @c close is called during logger deinitialization (if provided)
  *
+ * The loggers count the callback invocations in @c calls and the records
+ * they carried in @c records, with relaxed atomic stores so they can be
+ * read while logging. When @c write_histogram is set, they also record the
+ * duration of every write callback into it (one write_batch call, or one
+ * write or write_record call).
+ *
+ * A sink only receives the levels of its @c levels mask. The loggers check
+ * it before calling the sink and reject records no sink accepts before
+ * formatting them, see sn_sinks_min_level().
+ *
  * @note The logger itself is not thread-safe unless explicitly stated.
  *       Sink implementations must handle their own synchronization if needed.
  */
 typedef struct snSink {
     snSinkOpenFn  open;   /**< Optional sink initialization callback */
-    snSinkWriteFn write;  /**< Required sink write callback */
+    snSinkWriteFn write;  /**< Sink write callback, required unless write_record or write_batch is set */
     snSinkCloseFn close;  /**< Optional sink shutdown callback */
     snSinkFlushFn flush;  /**< Optional sink flush callback */
     void *data;           /**< User-defined sink data */
+    snSinkWriteRecordFn write_record; /**< Optional record write callback, used instead of write */
+    snSinkWriteBatchFn write_batch; /**< Optional batch write callback, used by the async logger */
+    uint32_t flags; /**< SN_SINK_* flags */
+
+    size_t calls; /**< Write callback invocations, maintained by the logger */
+    size_t records; /**< Records written, maintained by the logger */
+    snHistogram *write_histogram; /**< Optional, receives the duration of each write callback in nanoseconds */
+    uint32_t levels; /**< Mask of the accepted levels (SN_LOG_LEVEL_BIT()), 0 accepts every level */
 } snSink;
 
+/**
+ * @brief Levels accepted by a sink, as a mask.
+ */
+SN_FORCE_INLINE uint32_t sn_sink_levels(const snSink *sink) {
+    return sink->levels ? sink->levels : SN_LOG_LEVEL_ALL;
+}
+
+/**
+ * @brief Whether a sink accepts records of a level.
+ */
+SN_FORCE_INLINE bool sn_sink_accepts(const snSink *sink, snLogLevel level) {
+    return (sn_sink_levels(sink) & SN_LOG_LEVEL_BIT(level)) != 0;
+}
+
+/**
+ * @brief Only send a level and the levels above it to a sink.
+ *
+ * @note Refresh the level of a logger the sink is attached to afterwards,
+ *       see sn_async_logger_refresh_level() and sn_static_logger_refresh_level().
+ */
+SN_FORCE_INLINE void sn_sink_set_min_level(snSink *sink, snLogLevel level) {
+    sink->levels = SN_LOG_LEVELS_FROM(level);
+}
+
+/**
+ * @brief Only send the levels of a mask to a sink.
+ *
+ * @param sink The sink.
+ * @param levels Mask of SN_LOG_LEVEL_BIT() values, 0 for every level.
+ *
+ * @note Refresh the level of a logger the sink is attached to afterwards.
+ */
+SN_FORCE_INLINE void sn_sink_set_levels(snSink *sink, uint32_t levels) {
+    sink->levels = levels;
+}
+
+/**
+ * @brief Lowest level accepted by any of the sinks.
+ *
+ * Records below it are wanted by no sink. Without sinks, every level is
+ * accepted.
+ */
+SN_INLINE snLogLevel sn_sinks_min_level(const snSink *sinks, size_t count) {
+    if (!count) return SN_LOG_LEVEL_TRACE;
+
+    uint32_t levels = 0;
+    for (size_t i = 0; i < count; ++i)
+        levels |= sn_sink_levels(&sinks[i]);
+
+    for (int level = SN_LOG_LEVEL_TRACE; level < SN_LOG_LEVEL_FATAL; ++level)
+        if (levels & SN_LOG_LEVEL_BIT(level)) return (snLogLevel)level;
+
+    return SN_LOG_LEVEL_FATAL;
+}
+
+/**
+ * @brief Write a record to a sink.
+ *
+ * Calls write_record if provided, write otherwise, or write_batch with a
+ * single record for sinks that only provide it.
+ *
+ * @param sink The sink.
+ * @param record The log record.
+ */
+SN_FORCE_INLINE void sn_sink_write(const snSink *sink, const snSinkRecord *record) {
+    if (sink->write_record)
+        sink->write_record(record, sink->data);
+    else if (sink->write)
+        sink->write(record->msg, record->len, record->level, sink->data);
+    else
+        sink->write_batch(record, 1, sink->data);
+}
+
+/**
+ * @brief Write several records to a sink.
+ *
+ * Calls write_batch if provided, sn_sink_write() for each record otherwise.
+ *
+ * @param sink The sink.
+ * @param records Array of log records.
+ * @param count Number of records.
+ */
+SN_FORCE_INLINE void sn_sink_write_batch(const snSink *sink, const snSinkRecord *records, size_t count) {
+    if (sink->write_batch) {
+        sink->write_batch(records, count, sink->data);
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        sn_sink_write(sink, &records[i]);
+}
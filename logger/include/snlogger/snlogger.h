@@ -1,5 +1,15 @@
 #pragma once
 
 #include "snlogger/log_level.h"
+#include "snlogger/log_site.h"
+#include "snlogger/clock.h"
+#include "snlogger/histogram.h"
+#include "snlogger/notifier.h"
 #include "snlogger/static_logger.h"
 #include "snlogger/async_logger.h"
+#include "snlogger/file_sink.h"
+#include "snlogger/binary_sink.h"
+
+#if !defined(SN_OS_WINDOWS)
+    #include "snlogger/mmap_sink.h"
+#endif
@@ -30,7 +30,8 @@ typedef struct snStaticLogger {
     snSink *sinks; /**< Array of sinks */
     size_t sink_count; /**< Number of sinks */
 
-    snLogLevel level; /**< The global log level threashold */
+    snLogLevel level; /**< Effective level, the higher of requested_level and the lowest level a sink accepts */
+    snLogLevel requested_level; /**< Level set with sn_static_logger_set_level() */
 
     size_t dropped; /**< Number of logs dropped */
     size_t truncated; /**< Number of logs truncated */
@@ -79,13 +80,24 @@ SN_API void sn_static_logger_flush(snStaticLogger *logger);
 /**
  * @brief Set the global log level.
  *
- * Messages with a level lower than this value will be ignored.
+ * Messages with a level lower than this value will be ignored, as well as
+ * messages of levels no sink accepts (see snSink::levels).
  *
  * @param logger Pointer to the logger context
  * @param level New log level threshold
  */
 SN_FORCE_INLINE void sn_static_logger_set_level(snStaticLogger *logger, snLogLevel level) {
-    logger->level = level;
+    logger->requested_level = level;
+    logger->level = SN_MAX(level, sn_sinks_min_level(logger->sinks, logger->sink_count));
+}
+
+/**
+ * @brief Recompute the level after the levels of a sink changed.
+ *
+ * @param logger Pointer to the logger context
+ */
+SN_FORCE_INLINE void sn_static_logger_refresh_level(snStaticLogger *logger) {
+    sn_static_logger_set_level(logger, logger->requested_level);
 }
 
 /**
@@ -125,6 +137,93 @@ SN_INLINE void sn_static_logger_log(snStaticLogger *logger, snLogLevel level, co
     va_end(args);
 }
 
+/**
+ * @brief Log a message of a call site using a va_list.
+ *
+ * Sinks with write_record receive the site along with the message.
+ *
+ * @param logger Pointer to the logger context
+ * @param site The call site
+ * @param args Arguments of the site format string
+ *
+ * @note Use the SN_SLOG() macros instead of calling this directly.
+ * @note Ignored unless sn_log_site_enabled() is true for the logger level.
+ */
+SN_API void sn_static_logger_log_site_va(snStaticLogger *logger, const snLogSite *site, va_list args);
+
+/**
+ * @brief Log a message of a call site.
+ *
+ * @param logger Pointer to the logger context
+ * @param site The call site
+ * @param fmt Unused, the format string of the site. Lets the macros pass
+ *            their arguments through unchanged.
+ * @param ... Format arguments
+ *
+ * @see sn_static_logger_log_site_va
+ */
+SN_INLINE void sn_static_logger_log_site(snStaticLogger *logger, const snLogSite *site, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    sn_static_logger_log_site_va(logger, site, args);
+    va_end(args);
+}
+
+/**
+ * @brief Log through a static call site descriptor.
+ *
+ * Static logger counterpart of SN_ALOG(). The format string must be a
+ * string literal.
+ *
+ * @code
+ * SN_SLOG_WARN(&logger, "retrying %s", host);
+ * @endcode
+ */
+#define SN_SLOG(logger, lvl, ...) do { \
+        if ((int)(lvl) >= SN_LOG_MIN_LEVEL) { \
+            SN_LOG_SITE_DEFINE(sn_log_site_, lvl, SN_FIRST_ARG(__VA_ARGS__)); \
+            snStaticLogger *sn_logger_ = (logger); \
+            if (sn_log_site_enabled(&sn_log_site_, sn_logger_->level)) \
+                sn_static_logger_log_site(sn_logger_, &sn_log_site_, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#if SN_LOG_MIN_LEVEL <= 0
+    #define SN_SLOG_TRACE(logger, ...) SN_SLOG(logger, SN_LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+    #define SN_SLOG_TRACE(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 1
+    #define SN_SLOG_DEBUG(logger, ...) SN_SLOG(logger, SN_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+    #define SN_SLOG_DEBUG(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 2
+    #define SN_SLOG_INFO(logger, ...) SN_SLOG(logger, SN_LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+    #define SN_SLOG_INFO(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 3
+    #define SN_SLOG_WARN(logger, ...) SN_SLOG(logger, SN_LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+    #define SN_SLOG_WARN(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 4
+    #define SN_SLOG_ERROR(logger, ...) SN_SLOG(logger, SN_LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+    #define SN_SLOG_ERROR(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
+#if SN_LOG_MIN_LEVEL <= 5
+    #define SN_SLOG_FATAL(logger, ...) SN_SLOG(logger, SN_LOG_LEVEL_FATAL, __VA_ARGS__)
+#else
+    #define SN_SLOG_FATAL(logger, ...) SN_LOG_DISCARD(logger, __VA_ARGS__)
+#endif
+
 /**
  * @brief Log a raw message without formatting.
  *
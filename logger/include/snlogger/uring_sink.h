@@ -0,0 +1,164 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+#include "snlogger/file_sink.h"
+
+/**
+ * @brief Maximum number of buffers of an io_uring sink.
+ */
+#define SN_URING_SINK_MAX_BUFFERS 16
+
+/**
+ * @brief Times a write of a buffer is resubmitted after -EAGAIN or -EINTR
+ *        without progress before its data is dropped.
+ */
+#ifndef SN_URING_SINK_MAX_RETRIES
+    #define SN_URING_SINK_MAX_RETRIES 8
+#endif
+
+/**
+ * @struct snUringBuffer uring_sink.h <snlogger/uring_sink.h>
+ * @brief One buffer of an io_uring sink.
+ */
+typedef struct snUringBuffer {
+    char *data; /**< Buffer storage */
+    size_t start; /**< Offset of the data not written yet */
+    size_t len; /**< End of the data in the buffer */
+    uint64_t offset; /**< File offset of the data at start */
+    bool in_flight; /**< A write of the buffer is queued in the kernel */
+    uint32_t retries; /**< Resubmissions since the last progress */
+} snUringBuffer;
+
+/**
+ * @struct snUringSink uring_sink.h <snlogger/uring_sink.h>
+ * @brief File sink handing its filled buffers to io_uring.
+ *
+ * Linux only, built as the separate snlogger_uring library
+ * (SN_LOGGER_BUILD_URING). Records are written one per line like
+ * snFileSink, but a filled buffer is submitted as an asynchronous write
+ * and the sink carries on with the next buffer, so a slow disk does not
+ * block the processing thread until every buffer is in flight.
+ * Completions are reaped on later writes and flushes.
+ *
+ * Writes to seekable files use explicit offsets, so several buffers can
+ * be in flight. Pipes and other streams get one write in flight at a time
+ * to keep the records in order.
+ *
+ * When io_uring is not available (old kernel, seccomp, ...), the sink
+ * falls back to a plain snFileSink over the whole buffer.
+ *
+ * Requires Linux 5.6 or later for IORING_OP_WRITE.
+ */
+typedef struct snUringSink {
+    snFileSink file; /**< Fallback sink, used when io_uring is not available */
+    bool active; /**< io_uring is used */
+    bool sync; /**< Sync the file to storage on flush */
+
+    int fd; /**< Destination file descriptor, not owned by the sink */
+    uint64_t offset; /**< File offset of the next submitted byte, (uint64_t)-1 for streams */
+
+    snUringBuffer buffers[SN_URING_SINK_MAX_BUFFERS]; /**< Buffers of the sink */
+    uint32_t buffer_count; /**< Number of buffers */
+    size_t buffer_size; /**< Size of each buffer in bytes */
+    uint32_t current; /**< Buffer records are copied into */
+    uint32_t in_flight; /**< Buffers queued in the kernel */
+    uint32_t generation; /**< Tags submitted writes, bumped when in-flight writes are abandoned */
+
+    int ring_fd; /**< io_uring instance */
+    void *sq_ring; /**< Mapped submission ring */
+    size_t sq_ring_size; /**< Size of the submission ring mapping */
+    void *cq_ring; /**< Mapped completion ring, may alias sq_ring */
+    size_t cq_ring_size; /**< Size of the completion ring mapping */
+    void *sqes; /**< Mapped submission queue entries */
+    size_t sqes_size; /**< Size of the entry mapping */
+
+    uint32_t *sq_head; /**< Submission ring head, written by the kernel */
+    uint32_t *sq_tail; /**< Submission ring tail */
+    uint32_t sq_mask; /**< Submission ring index mask */
+    uint32_t *sq_array; /**< Submission ring entry indices */
+    uint32_t *cq_head; /**< Completion ring head */
+    uint32_t *cq_tail; /**< Completion ring tail, written by the kernel */
+    uint32_t cq_mask; /**< Completion ring index mask */
+    void *cqes; /**< Completion entries */
+
+    uint64_t bytes_written; /**< Bytes written to the file */
+    uint64_t syscalls; /**< io_uring_enter and sync system calls issued */
+    uint64_t submissions; /**< Writes submitted, including resubmitted partial writes */
+    uint64_t errors; /**< Failed writes, their data is dropped */
+} snUringSink;
+
+/**
+ * @brief Initialize an io_uring sink.
+ *
+ * The buffer is split evenly into buffer_count buffers.
+ *
+ * @param sink Pointer to the io_uring sink.
+ * @param fd File descriptor records are written to.
+ * @param buffer Storage of the buffers.
+ * @param buffer_size Size of the storage in bytes.
+ * @param buffer_count Number of buffers, at most SN_URING_SINK_MAX_BUFFERS.
+ *
+ * @return true if io_uring is used, false if the sink fell back to a
+ *         plain buffered file sink. The sink is usable either way.
+ *
+ * @note The buffer must remain valid until sn_uring_sink_deinit().
+ * @note The file descriptor is not closed by the sink.
+ */
+SN_API bool sn_uring_sink_init(snUringSink *sink, int fd, char *buffer, size_t buffer_size, uint32_t buffer_count);
+
+/**
+ * @brief Deinitialize an io_uring sink.
+ *
+ * Writes out the buffered records, waits for every write in flight and
+ * releases the io_uring instance.
+ *
+ * @param sink Pointer to the io_uring sink.
+ */
+SN_API void sn_uring_sink_deinit(snUringSink *sink);
+
+/**
+ * @brief Sync the file to storage on every flush.
+ *
+ * @param sink Pointer to the io_uring sink.
+ * @param enable Whether flushes call fdatasync() once the writes completed.
+ */
+SN_FORCE_INLINE void sn_uring_sink_set_sync(snUringSink *sink, bool enable) {
+    sink->sync = enable;
+    sn_file_sink_set_sync(&sink->file, enable);
+}
+
+/**
+ * @brief snSinkWriteFn of the io_uring sink, data is the snUringSink.
+ */
+SN_API void sn_uring_sink_write(const char *msg, size_t len, snLogLevel level, void *data);
+
+/**
+ * @brief snSinkWriteBatchFn of the io_uring sink, data is the snUringSink.
+ */
+SN_API void sn_uring_sink_write_batch(const snSinkRecord *records, size_t count, void *data);
+
+/**
+ * @brief snSinkFlushFn of the io_uring sink, data is the snUringSink.
+ *
+ * Submits the current buffer and waits until every write completed, then
+ * syncs the file if enabled with sn_uring_sink_set_sync().
+ */
+SN_API void sn_uring_sink_flush(void *data);
+
+/**
+ * @brief Get the snSink of an io_uring sink.
+ *
+ * @param sink Pointer to the io_uring sink.
+ *
+ * @return A sink with the write, write_batch and flush callbacks of the
+ *         io_uring sink.
+ */
+SN_FORCE_INLINE snSink sn_uring_sink(snUringSink *sink) {
+    return (snSink){
+        .write = sn_uring_sink_write,
+        .flush = sn_uring_sink_flush,
+        .data = sink,
+        .write_batch = sn_uring_sink_write_batch,
+    };
+}
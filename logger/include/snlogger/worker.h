@@ -0,0 +1,130 @@
+#pragma once
+
+#include "snlogger/defines.h"
+
+#include "snlogger/async_logger.h"
+#include "snlogger/notifier.h"
+
+/**
+ * @brief Maximum number of loggers serviced by one worker.
+ */
+#ifndef SN_WORKER_MAX_LOGGERS
+    #define SN_WORKER_MAX_LOGGERS 16
+#endif
+
+/**
+ * @enum snWorkerMode
+ * @brief How a worker waits when every logger is empty.
+ */
+typedef enum snWorkerMode {
+    SN_WORKER_BLOCKING, /**< Sleep on a notifier until producers cross a threshold */
+    SN_WORKER_BUSY_POLL, /**< Keep polling, lowest latency, burns the core */
+} snWorkerMode;
+
+/**
+ * @struct snWorkerConfig worker.h <snlogger/worker.h>
+ * @brief Settings of an snWorker, see sn_worker_config_default().
+ */
+typedef struct snWorkerConfig {
+    snWorkerMode mode; /**< Waiting strategy */
+    int cpu; /**< CPU the thread is pinned to, -1 to not pin */
+    size_t batch; /**< Records processed per logger before moving to the next one, per sink with sink cursors */
+    uint64_t flush_interval; /**< Nanoseconds between sink flushes, 0 to flush at shutdown only */
+    uint64_t idle_timeout; /**< Longest sleep in nanoseconds in blocking mode */
+    size_t notify_records; /**< Pending records waking a blocking worker */
+} snWorkerConfig;
+
+/**
+ * @struct snWorker worker.h <snlogger/worker.h>
+ * @brief Background thread processing one or more async loggers.
+ *
+ * Built as the separate snlogger_worker library (SN_LOGGER_BUILD_WORKER),
+ * the core library still creates no threads. The worker processes its
+ * loggers in turn, SN_WORKER_MAX_LOGGERS at most, flushes their sinks
+ * periodically and drains them on shutdown.
+ *
+ * In blocking mode the worker installs its notifier on every logger (see
+ * sn_async_logger_set_notifier()) and sleeps until notify_records records
+ * or half a ring are pending, or idle_timeout elapsed.
+ *
+ * @code
+ * snWorkerConfig config;
+ * sn_worker_config_default(&config);
+ * config.cpu = 3;
+ *
+ * snWorker worker;
+ * sn_worker_init(&worker, &config);
+ * sn_worker_add(&worker, &logger);
+ * sn_worker_start(&worker);
+ * ...
+ * sn_worker_stop(&worker); // after the producers stopped
+ * @endcode
+ */
+typedef struct snWorker {
+    snWorkerConfig config; /**< Settings */
+
+    snAsyncLogger *loggers[SN_WORKER_MAX_LOGGERS]; /**< Serviced loggers */
+    size_t logger_count; /**< Number of loggers */
+
+    snNotifier notifier; /**< Wakes the thread in blocking mode */
+    uint32_t running; /**< Cleared to stop the thread */
+    bool started; /**< The thread was created */
+    bool pinned; /**< The thread runs on config.cpu */
+    uintptr_t thread; /**< Platform thread handle */
+
+    size_t processed; /**< Records processed, as returned by sn_async_logger_process_n() */
+    size_t flushes; /**< Periodic flushes */
+    size_t sleeps; /**< Waits on the notifier in blocking mode */
+} snWorker;
+
+/**
+ * @brief Fill a configuration with the defaults.
+ *
+ * Blocking mode, no pinning, batches of SN_ASYNC_LOGGER_BATCH_SIZE
+ * records, a flush every 100 ms, sleeps of 10 ms at most and wake-ups at
+ * 4 batches of pending records.
+ */
+SN_API void sn_worker_config_default(snWorkerConfig *config);
+
+/**
+ * @brief Initialize a worker.
+ *
+ * @param worker Pointer to the worker.
+ * @param config Settings, NULL for the defaults.
+ */
+SN_API void sn_worker_init(snWorker *worker, const snWorkerConfig *config);
+
+/**
+ * @brief Add a logger to the worker.
+ *
+ * @param worker Pointer to the worker.
+ * @param logger Logger to process. Must have lock hooks or run in
+ *               lock-free mode, producers keep logging from other threads.
+ *
+ * @return false if the worker already has SN_WORKER_MAX_LOGGERS loggers.
+ *
+ * @note Must be called before sn_worker_start().
+ * @note In blocking mode, replaces the notifier of the logger.
+ */
+SN_API bool sn_worker_add(snWorker *worker, snAsyncLogger *logger);
+
+/**
+ * @brief Start the worker thread.
+ *
+ * @param worker Pointer to the worker.
+ *
+ * @return false if the thread could not be created. A failure to pin the
+ *         thread is not an error, see snWorker::pinned.
+ */
+SN_API bool sn_worker_start(snWorker *worker);
+
+/**
+ * @brief Stop the worker thread, then drain and flush every logger.
+ *
+ * @param worker Pointer to the worker.
+ *
+ * @note Records logged after the call returns are not processed, stop the
+ *       producers first. The loggers are not deinitialized.
+ * @note The worker must be initialized again before another start.
+ */
+SN_API void sn_worker_stop(snWorker *worker);
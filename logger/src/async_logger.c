@@ -1,9 +1,19 @@
 #include "snlogger/async_logger.h"
 
-#include "snlogger/formatter.h"
+#include "snlogger/atomic.h"
+
+#include "formatter.h"
+#include "notifier.h"
 
 #include <string.h>
 
+#if defined(SN_OS_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
 #define async_logger_lock(logger) if (logger->lock) logger->lock(logger->lock_data)
 
 #define async_logger_unlock(logger) if (logger->unlock) logger->unlock(logger->lock_data)
@@ -11,237 +21,1828 @@
 #define GET_ALIGNED(x, align) (((size_t)(x) + (align) - 1) & ~((align) - 1))
 #define PTR_BYTE_DIFF(x, y) (((size_t)x) - ((size_t)y))
 
-static size_t ring_buffer_free_size(snAsyncLogger *logger) {
-    if (logger->write_offset >= logger->read_offset)
-        return logger->buffer_size - (logger->write_offset - logger->read_offset);
+#define RECORD_WRAP_MARK (SN_LOG_LEVEL_FATAL + 1)
+
+#define RECORD_INVALID_OFFSET ((size_t)-1)
+
+// SN_BACKPRESSURE_LEVEL sheds low levels once less than 1/N of the ring is free
+#define SHED_FREE_DIVISOR 4
+
+// Pauses between two attempts of a spinning producer
+#define SPIN_WAIT_PAUSES 64
+
+SN_STATIC_ASSERT(sizeof(snLogRecordHeader) == 16, "Record headers are packed into 16 bytes");
+
+static uint32_t record_info(uint32_t flags, snLogLevel level, size_t len) {
+    return flags | (uint32_t)level << SN_LOG_RECORD_LEVEL_SHIFT | (uint32_t)len << SN_LOG_RECORD_LEN_SHIFT;
+}
+
+static uint32_t record_flags(const snLogRecordHeader *record) {
+    return record->info & SN_LOG_RECORD_FLAGS_MASK;
+}
+
+static snLogLevel record_level(const snLogRecordHeader *record) {
+    return (snLogLevel)((record->info >> SN_LOG_RECORD_LEVEL_SHIFT) & 0xfu);
+}
+
+static size_t record_len(const snLogRecordHeader *record) {
+    return record->info >> SN_LOG_RECORD_LEN_SHIFT;
+}
+
+/**
+ * Widen the 32-bit sequence of a record next to a known full sequence.
+ *
+ * Records being processed are never 2^31 apart.
+ */
+static uint64_t sequence_extend(uint64_t near, uint32_t sequence) {
+    return near + (uint64_t)(int64_t)(int32_t)(sequence - (uint32_t)near);
+}
+
+// Leaves room for the null character written by the formatter
+static size_t record_size(size_t len) {
+    return GET_ALIGNED(sizeof(snLogRecordHeader) + len + 1, alignof(snLogRecordHeader));
+}
+
+static snLogRecordHeader *record_at(void *buffer, size_t offset) {
+    return (snLogRecordHeader *)(((char *)buffer) + offset);
+}
+
+// Counters are read by sn_async_logger_get_stats without the lock
+
+/**
+ * Add to a counter only written with the lock held. Counters updated
+ * outside the lock use sn_atomic_fetch_add_relaxed.
+ */
+static void stat_add(size_t *counter, size_t value) {
+    sn_atomic_store_relaxed(counter, *counter + value);
+}
+
+static void stat_max(size_t *counter, size_t value) {
+    size_t current = sn_atomic_load_relaxed(counter);
+    while (value > current && !sn_atomic_cas(counter, &current, value));
+}
 
-    return logger->read_offset - logger->write_offset;
+static void stat_max_u64(uint64_t *counter, uint64_t value) {
+    uint64_t current = sn_atomic_load_relaxed(counter);
+    while (value > current && !sn_atomic_cas(counter, &current, value));
+}
+
+/**
+ * Find the place for a record of size bytes given a snapshot of the cursors.
+ *
+ * Returns the offset of the record or RECORD_INVALID_OFFSET if it does not fit.
+ * next receives the new write offset. If the returned offset differs from
+ * write, the record wrapped to the start of the buffer.
+ */
+static size_t ring_buffer_place(size_t write, size_t read, size_t buffer_size, size_t size, size_t *next) {
+    if (write >= read) {
+        if (write + size <= buffer_size) {
+            *next = write + size;
+            return write;
+        }
+
+        // Wrap, must not catch up with the read offset
+        if (read > size) {
+            *next = size;
+            return 0;
+        }
+
+        return RECORD_INVALID_OFFSET;
+    }
+
+    if (write + size < read) {
+        *next = write + size;
+        return write;
+    }
+
+    return RECORD_INVALID_OFFSET;
+}
+
+static void ring_buffer_mark_wrap(void *buffer, size_t buffer_size, size_t offset) {
+    // If there is no room for a header, the reader wraps by itself
+    if (buffer_size - offset < sizeof(snLogRecordHeader)) return;
+
+    snLogRecordHeader *wrap_mark = record_at(buffer, offset);
+    sn_atomic_store_release(&wrap_mark->info, record_info(SN_LOG_RECORD_COMMITTED, RECORD_WRAP_MARK, 0));
 }
 
 static snLogRecordHeader *ring_buffer_allocate(snAsyncLogger *logger, size_t size) {
-    size += alignof(snLogRecordHeader);
+    size_t next;
+    size_t offset = ring_buffer_place(logger->write_offset, logger->read_offset, logger->buffer_size, size, &next);
+
+    if (offset == RECORD_INVALID_OFFSET) return NULL;
+
+    if (offset != logger->write_offset) {
+        ring_buffer_mark_wrap(logger->buffer, logger->buffer_size, logger->write_offset);
+        sn_atomic_fetch_add_relaxed(&logger->wraps, 1);
+    }
+    sn_atomic_store_relaxed(&logger->write_offset, next);
+
+    return record_at(logger->buffer, offset);
+}
+
+static snLogRecordHeader *ring_buffer_allocate_lock_free(snAsyncLogger *logger, size_t size) {
+    size_t write = sn_atomic_load_relaxed(&logger->write_offset);
+
+    for (;;) {
+        size_t read = sn_atomic_load_acquire(&logger->read_offset);
+
+        size_t next;
+        size_t offset = ring_buffer_place(write, read, logger->buffer_size, size, &next);
+
+        if (offset == RECORD_INVALID_OFFSET) return NULL;
+
+        if (sn_atomic_cas(&logger->write_offset, &write, next)) {
+            if (offset != write) {
+                ring_buffer_mark_wrap(logger->buffer, logger->buffer_size, write);
+                sn_atomic_fetch_add_relaxed(&logger->wraps, 1);
+            }
+            return record_at(logger->buffer, offset);
+        }
+    }
+}
+
+/**
+ * Skip wrap marks and return the record of the shared ring at offset, if
+ * any, moving offset past the wrap marks.
+ *
+ * Must be called with the lock held.
+ */
+static snLogRecordHeader *ring_buffer_peek_at(snAsyncLogger *logger, size_t *offset) {
+    while (*offset != logger->write_offset) {
+        if (logger->buffer_size - *offset < sizeof(snLogRecordHeader)) {
+            // Next record should start from 0 itself
+            *offset = 0;
+            continue;
+        }
+
+        snLogRecordHeader *record = record_at(logger->buffer, *offset);
+
+        // Check for wrap mark
+        if (record_level(record) == RECORD_WRAP_MARK) {
+            *offset = 0;
+            continue;
+        }
+
+        return record;
+    }
+
+    return NULL;
+}
+
+/**
+ * Return the oldest uncollected record of the shared ring, if any.
+ *
+ * Must be called with the lock held.
+ */
+static snLogRecordHeader *ring_buffer_peek(snAsyncLogger *logger) {
+    return ring_buffer_peek_at(logger, &logger->peek_offset);
+}
+
+/**
+ * Reserve space in the shard of the calling thread.
+ *
+ * The record becomes visible to the consumer only after shard_publish.
+ */
+static snLogRecordHeader *shard_allocate(snAsyncLogger *logger, snAsyncShard *shard, size_t size, size_t *next) {
+    size_t write = shard->write_offset;
+    size_t read = sn_atomic_load_acquire(&shard->read_offset);
+
+    size_t offset = ring_buffer_place(write, read, shard->buffer_size, size, next);
+
+    if (offset == RECORD_INVALID_OFFSET) return NULL;
+
+    if (offset != write) {
+        ring_buffer_mark_wrap(shard->buffer, shard->buffer_size, write);
+        sn_atomic_fetch_add_relaxed(&logger->wraps, 1);
+    }
+
+    return record_at(shard->buffer, offset);
+}
+
+SN_FORCE_INLINE void shard_publish(snAsyncShard *shard, size_t next) {
+    sn_atomic_store_release(&shard->write_offset, next);
+}
+
+#define SHARD_CACHE_SIZE 4
+
+typedef struct shardCacheEntry {
+    const snAsyncLogger *logger;
+    uint64_t generation;
+    snAsyncShard *shard;
+    size_t released; // shard_released when no free shard was found
+} shardCacheEntry;
+
+static SN_THREAD_LOCAL shardCacheEntry shard_cache[SHARD_CACHE_SIZE];
+static SN_THREAD_LOCAL size_t shard_cache_victim;
+static SN_THREAD_LOCAL uint64_t shard_thread_id;
 
-    size_t free = ring_buffer_free_size(logger);
+static uint64_t shard_generation_counter;
+static uint64_t shard_thread_counter;
 
-    if (free < size) return NULL;
+// Loggers with shards, so exiting threads can release theirs
+static snAsyncLogger *shard_loggers;
+static uint32_t shard_loggers_lock;
 
-    if ((logger->write_offset >= logger->read_offset && logger->write_offset + size <= logger->buffer_size) || 
-            (logger->write_offset < logger->read_offset && logger->write_offset + size < logger->read_offset)) {
-        void *p = ((char *)logger->buffer) + logger->write_offset;
-        void *aligned = (void *)GET_ALIGNED(p, alignof(snLogRecordHeader));
-        logger->write_offset += size - alignof(snLogRecordHeader) + PTR_BYTE_DIFF(aligned, p);
-        return (snLogRecordHeader *)aligned;
+static void shard_loggers_acquire(void) {
+    uint32_t expected = 0;
+    while (!sn_atomic_cas(&shard_loggers_lock, &expected, 1)) {
+        expected = 0;
+        notifier_yield();
     }
+}
+
+static void shard_loggers_release(void) {
+    sn_atomic_store_release(&shard_loggers_lock, 0);
+}
+
+/**
+ * Release the shards owned by an exiting thread, they keep their records
+ * and the next claimer continues after them.
+ */
+static void shard_thread_exit(uint64_t id) {
+    shard_loggers_acquire();
 
-    // Wrapping logic
-    if (logger->write_offset >= logger->read_offset && logger->read_offset > size) {
-        // Write the wrap mark
-        if (logger->write_offset < logger->buffer_size) {
-            void *ptr = ((char *)logger->buffer) + logger->write_offset;
-            snLogRecordHeader *wrap_mark = (snLogRecordHeader *)GET_ALIGNED(ptr, alignof(snLogRecordHeader));
-            logger->write_offset += PTR_BYTE_DIFF(wrap_mark, ptr);
-            if (logger->write_offset < logger->buffer_size && logger->buffer_size - logger->write_offset >= sizeof(snLogRecordHeader))
-                wrap_mark->level = SN_LOG_LEVEL_FATAL + 1;
+    for (snAsyncLogger *logger = shard_loggers; logger; logger = logger->shard_next) {
+        for (size_t i = 0; i < logger->shard_count; ++i) {
+            snAsyncShard *shard = &logger->shards[i];
+            if (sn_atomic_load_relaxed(&shard->owner) != id) continue;
+
+            sn_atomic_store_release(&shard->owner, 0);
+            sn_atomic_fetch_add_relaxed(&logger->shard_released, 1);
+        }
+    }
+
+    shard_loggers_release();
+}
+
+#if defined(SN_OS_WINDOWS)
+
+static DWORD shard_exit_key = FLS_OUT_OF_INDEXES;
+
+static VOID WINAPI shard_exit_callback(PVOID data) {
+    if (data) shard_thread_exit((uint64_t)(uintptr_t)data);
+}
+
+static void shard_exit_key_create(void) {
+    if (shard_exit_key == FLS_OUT_OF_INDEXES) shard_exit_key = FlsAlloc(shard_exit_callback);
+}
+
+static void shard_exit_arm(uint64_t id) {
+    if (shard_exit_key != FLS_OUT_OF_INDEXES) FlsSetValue(shard_exit_key, (PVOID)(uintptr_t)id);
+}
+
+#else
+
+static pthread_key_t shard_exit_key;
+static bool shard_exit_key_valid;
+
+static void shard_exit_callback(void *data) {
+    shard_thread_exit((uint64_t)(uintptr_t)data);
+}
+
+static void shard_exit_key_create(void) {
+    if (!shard_exit_key_valid) shard_exit_key_valid = pthread_key_create(&shard_exit_key, shard_exit_callback) == 0;
+}
+
+static void shard_exit_arm(uint64_t id) {
+    if (shard_exit_key_valid) pthread_setspecific(shard_exit_key, (void *)(uintptr_t)id);
+}
+
+#endif
+
+/**
+ * Add or remove a logger from the loggers walked by exiting threads.
+ */
+static void shard_loggers_update(snAsyncLogger *logger, bool add) {
+    shard_loggers_acquire();
+
+    snAsyncLogger **link = &shard_loggers;
+    while (*link && *link != logger)
+        link = &(*link)->shard_next;
+
+    if (add && !*link) {
+        shard_exit_key_create();
+        logger->shard_next = NULL;
+        *link = logger;
+    } else if (!add && *link) {
+        *link = logger->shard_next;
+    }
+
+    shard_loggers_release();
+}
+
+/**
+ * Find the shard owned by the thread, or claim a free one.
+ */
+static snAsyncShard *shard_claim(snAsyncLogger *logger) {
+    if (!shard_thread_id) {
+        shard_thread_id = sn_atomic_fetch_add_relaxed(&shard_thread_counter, 1) + 1;
+        shard_exit_arm(shard_thread_id);
+    }
+
+    // The cache entry may have been evicted, the shard is still ours
+    for (size_t i = 0; i < logger->shard_count; ++i)
+        if (sn_atomic_load_relaxed(&logger->shards[i].owner) == shard_thread_id) return &logger->shards[i];
+
+    for (size_t i = 0; i < logger->shard_count; ++i) {
+        snAsyncShard *shard = &logger->shards[i];
+
+        uint64_t owner = sn_atomic_load_relaxed(&shard->owner);
+        while (!owner && !sn_atomic_cas(&shard->owner, &owner, shard_thread_id));
+
+        if (!owner) {
+            sn_atomic_fetch_add_relaxed(&logger->shard_claimed, 1);
+            return shard;
         }
-        void *aligned = (void *)GET_ALIGNED(logger->buffer, alignof(snLogRecordHeader));
-        logger->write_offset = size - alignof(snLogRecordHeader) + PTR_BYTE_DIFF(aligned, logger->buffer);
-        return (snLogRecordHeader *)aligned;
     }
 
     return NULL;
 }
 
-static snLogRecordHeapNode *try_heap_allocation(snAsyncLogger *logger, size_t len) {
-    if (!logger->alloc) return NULL;
+/**
+ * Get the shard owned by the calling thread, claiming one on first use.
+ *
+ * Returns NULL if all shards are owned by other threads. Threads without
+ * a shard look again once another thread released one.
+ */
+static snAsyncShard *async_logger_thread_shard(snAsyncLogger *logger) {
+    for (size_t i = 0; i < SHARD_CACHE_SIZE; ++i) {
+        shardCacheEntry *entry = &shard_cache[i];
+        if (entry->logger != logger || entry->generation != logger->shard_generation) continue;
+
+        if (entry->shard || entry->released == sn_atomic_load_relaxed(&logger->shard_released)) return entry->shard;
+
+        entry->released = sn_atomic_load_relaxed(&logger->shard_released);
+        entry->shard = shard_claim(logger);
+        return entry->shard;
+    }
 
-    size_t alloc_size = sizeof(snLogRecordHeapNode) + sizeof(snLogRecordHeader) + len;
-    snLogRecordHeapNode *node = logger->alloc(alloc_size, alignof(snLogRecordHeader), logger->mem_data);
+    size_t released = sn_atomic_load_relaxed(&logger->shard_released);
+    snAsyncShard *shard = shard_claim(logger);
 
-    if (!node) return NULL;
+    shardCacheEntry *entry = &shard_cache[shard_cache_victim++ % SHARD_CACHE_SIZE];
+    *entry = (shardCacheEntry){
+        .logger = logger,
+        .generation = logger->shard_generation,
+        .shard = shard,
+        .released = released,
+    };
 
-    node->next = NULL;
+    return shard;
+}
 
-    node->record = (snLogRecordHeader *)(node + 1);
+// Segment data starts after the structure, aligned for the record header
+#define SEGMENT_DATA_OFFSET GET_ALIGNED(sizeof(snAsyncSegment), alignof(snLogRecordHeader))
 
-    if (logger->heap_tail)
-        logger->heap_tail->next = node;
-    else
-        logger->heap_head = node;
-    logger->heap_tail = node;
+static snLogRecordHeader *segment_record(snAsyncSegment *segment, size_t offset) {
+    return record_at((char *)segment + SEGMENT_DATA_OFFSET, offset);
+}
 
-    return node;
+static void segment_free(snAsyncLogger *logger, snAsyncSegment *segment) {
+    stat_add(&logger->segment_count, (size_t)-1);
+    if (logger->free) logger->free(segment, logger->mem_data);
+}
+
+/**
+ * Append a record to the overflow segments, linking a new segment when
+ * the last one is full.
+ *
+ * Must be called with the lock held.
+ */
+static snLogRecordHeader *segment_allocate(snAsyncLogger *logger, size_t size) {
+    // Sink cursors only cover the ring
+    if (!logger->alloc || logger->sink_cursors) return NULL;
+
+    snAsyncSegment *tail = logger->segment_tail;
+    if (tail && tail->size - tail->write_offset >= size) {
+        snLogRecordHeader *record = segment_record(tail, tail->write_offset);
+        tail->write_offset += size;
+        return record;
+    }
+
+    snAsyncSegment *segment = logger->segment_spare;
+    if (segment && segment->size >= size) {
+        logger->segment_spare = NULL;
+    } else {
+        size_t data_size = SN_MAX((size_t)SN_ASYNC_SEGMENT_SIZE, size);
+        segment = logger->alloc(SEGMENT_DATA_OFFSET + data_size, alignof(snLogRecordHeader), logger->mem_data);
+        if (!segment) return NULL;
+
+        segment->size = data_size;
+
+        stat_add(&logger->segment_count, 1);
+        if (logger->segment_count > logger->segment_high_watermark)
+            sn_atomic_store_relaxed(&logger->segment_high_watermark, logger->segment_count);
+    }
+
+    segment->next = NULL;
+    segment->write_offset = size;
+    segment->peek_offset = 0;
+
+    if (tail) {
+        tail->next = segment;
+    } else {
+        logger->segment_head = segment;
+        logger->segment_peek = segment;
+    }
+    logger->segment_tail = segment;
+
+    return segment_record(segment, 0);
+}
+
+/**
+ * Return the oldest uncollected record of the overflow segments, if any.
+ *
+ * Must be called with the lock held.
+ */
+static snLogRecordHeader *segment_peek(snAsyncLogger *logger) {
+    snAsyncSegment *segment = logger->segment_peek;
+
+    while (segment) {
+        if (segment->peek_offset != segment->write_offset) return segment_record(segment, segment->peek_offset);
+
+        segment = segment->next;
+        if (segment) logger->segment_peek = segment;
+    }
+
+    return NULL;
+}
+
+/**
+ * Release the segments whose records were all emitted.
+ *
+ * Must be called with the lock held, after the collected records were
+ * emitted. One drained segment is kept as a spare.
+ */
+static void segment_release(snAsyncLogger *logger) {
+    while (logger->segment_head != logger->segment_peek) {
+        snAsyncSegment *segment = logger->segment_head;
+        logger->segment_head = segment->next;
+        segment_free(logger, segment);
+    }
+
+    snAsyncSegment *last = logger->segment_head;
+    if (!last || last != logger->segment_tail || last->peek_offset != last->write_offset) return;
+
+    // Everything was consumed, the chain is empty again
+    logger->segment_head = NULL;
+    logger->segment_peek = NULL;
+    logger->segment_tail = NULL;
+
+    if (!logger->segment_spare) {
+        logger->segment_spare = last;
+    } else {
+        segment_free(logger, last);
+    }
 }
 
 void sn_async_logger_init(snAsyncLogger *logger, void *buffer, size_t buffer_size, snSink *sinks, size_t sink_count) {
+    // Keep every record offset aligned for the header
+    void *aligned = (void *)GET_ALIGNED(buffer, alignof(snLogRecordHeader));
+    size_t adjust = PTR_BYTE_DIFF(aligned, buffer);
+    buffer_size = buffer_size > adjust ? (buffer_size - adjust) & ~(alignof(snLogRecordHeader) - 1) : 0;
+
     *logger = (snAsyncLogger){
-        .level = SN_LOG_LEVEL_TRACE,
+        .level = sn_sinks_min_level(sinks, sink_count),
+        .requested_level = SN_LOG_LEVEL_TRACE,
+        .lock_free = false,
 
         .sinks = sinks,
         .sink_count = sink_count,
 
-        .buffer = buffer,
+        .buffer = aligned,
         .buffer_size = buffer_size,
         .write_offset = 0,
         .read_offset = 0,
+        .peek_offset = 0,
+
+        .backpressure = SN_BACKPRESSURE_DROP_NEWEST,
+        .backpressure_wait = SN_BACKPRESSURE_WAIT_YIELD,
+        .shed_level = SN_LOG_LEVEL_DEBUG,
+        .block_level = SN_LOG_LEVEL_WARN,
 
-        .timestamp = 1,
-        .processed_timestamp = 0,
+        .notify_armed = 1,
+
+        .sequence = 1,
+        .processed_sequence = 0,
     };
 
     for (size_t i = 0; i < sink_count; ++i)
         if (sinks[i].open) sinks[i].open(sinks[i].data);
 }
 
+static void async_logger_rate_flush(snAsyncLogger *logger, bool force);
+
 void sn_async_logger_deinit(snAsyncLogger *logger) {
     while (sn_async_logger_process(logger));
 
+    // Call sites that went quiet before their bucket refilled
+    async_logger_rate_flush(logger, true);
+    while (sn_async_logger_process(logger));
+
     for (size_t i = 0; i < logger->sink_count; ++i) {
         if (logger->sinks[i].flush) logger->sinks[i].flush(logger->sinks[i].data);
         if (logger->sinks[i].close) logger->sinks[i].close(logger->sinks[i].data);
     }
 
+    while (logger->segment_head) {
+        snAsyncSegment *segment = logger->segment_head;
+        logger->segment_head = segment->next;
+        segment_free(logger, segment);
+    }
+    if (logger->segment_spare) segment_free(logger, logger->segment_spare);
+
+    if (logger->shards) shard_loggers_update(logger, false);
+
     *logger = (snAsyncLogger){0};
 }
 
-void sn_async_logger_log_va(snAsyncLogger *logger, snLogLevel level, const char *fmt, va_list args) {
-    if (level < logger->level) return;
+void sn_async_logger_set_shards(snAsyncLogger *logger, snAsyncShard *shards, size_t shard_count, void *buffer, size_t buffer_size) {
+    SN_ASSERT(!logger->lock_free && "Shards cannot be combined with lock-free mode");
+    SN_ASSERT(!logger->sink_cursors && "Shards cannot be combined with sink cursors");
+
+    // Exiting threads must not walk the shards while they are replaced
+    shard_loggers_update(logger, false);
+
+    size_t shard_size = shard_count ? buffer_size / shard_count : 0;
+
+    for (size_t i = 0; i < shard_count; ++i) {
+        void *start = ((char *)buffer) + i * shard_size;
+        void *aligned = (void *)GET_ALIGNED(start, alignof(snLogRecordHeader));
+        size_t adjust = PTR_BYTE_DIFF(aligned, start);
+
+        shards[i] = (snAsyncShard){
+            .buffer = aligned,
+            .buffer_size = shard_size > adjust ? (shard_size - adjust) & ~(alignof(snLogRecordHeader) - 1) : 0,
+            .write_offset = 0,
+            .read_offset = 0,
+            .peek_offset = 0,
+        };
+    }
+
+    logger->shards = shards;
+    logger->shard_count = shard_count;
+    logger->shard_claimed = 0;
+    logger->shard_released = 0;
+    // Starts from 1 so zeroed thread cache entries never match
+    logger->shard_generation = sn_atomic_fetch_add_relaxed(&shard_generation_counter, 1) + 1;
+
+    if (shard_count) shard_loggers_update(logger, true);
+}
+
+void sn_async_logger_set_lock_free(snAsyncLogger *logger, bool enable) {
+    SN_ASSERT(!(enable && logger->shards) && "Lock-free mode cannot be combined with shards");
+    SN_ASSERT(!(enable && logger->sink_cursors) && "Lock-free mode cannot be combined with sink cursors");
+
+    // Consumers rely on free space being zeroed to detect uncommitted records
+    if (enable) memset(logger->buffer, 0, logger->buffer_size);
+
+    logger->write_offset = 0;
+    logger->read_offset = 0;
+    logger->peek_offset = 0;
+    logger->lock_free = enable;
+}
+
+/**
+ * Number of sinks formatting deferred records, each one gets its part of
+ * the format buffer with sink cursors. index receives the part of sink.
+ */
+static size_t sink_format_parts(const snAsyncLogger *logger, size_t sink, size_t *index) {
+    size_t parts = 0;
+
+    for (size_t i = 0; i < logger->sink_count; ++i) {
+        if (logger->sinks[i].flags & SN_SINK_DEFERRED) continue;
+        if (i == sink) *index = parts;
+        ++parts;
+    }
+
+    return parts;
+}
+
+#ifndef NDEBUG
+// Only checked by SN_ASSERT
+static bool sink_format_split_valid(const snAsyncLogger *logger) {
+    size_t index;
+    size_t parts = sink_format_parts(logger, logger->sink_count, &index);
+    return !logger->sink_cursors || !logger->format_buffer || !parts ||
+            logger->format_buffer_size / parts >= SN_ASYNC_SINK_FORMAT_MIN;
+}
+#endif
+
+void sn_async_logger_set_deferred_formatting(snAsyncLogger *logger, char *buffer, size_t buffer_size) {
+    logger->format_buffer = buffer_size ? buffer : NULL;
+    logger->format_buffer_size = buffer ? buffer_size : 0;
+
+    SN_ASSERT(sink_format_split_valid(logger) && "Format buffer too small for the sinks with cursors");
+}
+
+void sn_async_logger_set_sink_cursors(snAsyncLogger *logger, snAsyncSinkCursor *cursors, size_t detach_bytes) {
+    SN_ASSERT(!(cursors && (logger->lock_free || logger->shards)) && "Sink cursors cannot be combined with lock-free mode or shards");
+
+    for (size_t i = 0; cursors && i < logger->sink_count; ++i) {
+        cursors[i] = (snAsyncSinkCursor){
+            .peek_offset = logger->read_offset,
+            .read_offset = logger->read_offset,
+            .sequence = logger->processed_sequence,
+        };
+    }
+
+    logger->sink_cursors = cursors;
+    logger->sink_detach_bytes = detach_bytes;
+
+    SN_ASSERT(sink_format_split_valid(logger) && "Format buffer too small for the sinks with cursors");
+}
+
+void sn_async_logger_set_rate_limit(snAsyncLogger *logger, snAsyncRateSlot *slots, size_t slot_count, uint64_t rate, uint64_t burst) {
+    SN_ASSERT(!(slots && (!slot_count || (slot_count & (slot_count - 1)))) && "Rate slot count must be a power of two");
+
+    if (!rate) rate = 1;
+    if (!burst) burst = 1;
+
+    logger->rate_interval = 1000000000ull / rate;
+    logger->rate_tolerance = logger->rate_interval * (burst - 1);
+    logger->rate_slot_mask = slots ? slot_count - 1 : 0;
+    logger->rate_slots = slots;
+    logger->rate_overflow = (snAsyncRateSlot){0};
+}
+
+static size_t ring_used(size_t write, size_t read, size_t buffer_size) {
+    return write >= read ? write - read : buffer_size - (read - write);
+}
+
+static void async_logger_drop(snAsyncLogger *logger, snLogLevel level) {
+    sn_atomic_fetch_add_relaxed(&logger->dropped, 1);
+    sn_atomic_fetch_add_relaxed(&logger->level_dropped[level], 1);
+}
+
+/**
+ * Count a record just written, given the bytes used in its ring.
+ */
+static void async_logger_enqueued(snAsyncLogger *logger, snLogLevel level, size_t used) {
+    sn_atomic_fetch_add_relaxed(&logger->enqueued[level], 1);
+    stat_max(&logger->ring_high_watermark, used);
+}
+
+/**
+ * Shed a low level record early under SN_BACKPRESSURE_LEVEL, given the
+ * bytes used in the ring it would go to.
+ */
+static bool async_logger_shed(snAsyncLogger *logger, snLogLevel level, size_t used, size_t buffer_size) {
+    if (logger->backpressure != SN_BACKPRESSURE_LEVEL || level > logger->shed_level) return false;
+    if (buffer_size - used >= buffer_size / SHED_FREE_DIVISOR) return false;
+
+    sn_atomic_fetch_add_relaxed(&logger->shed, 1);
+    async_logger_drop(logger, level);
+    return true;
+}
+
+/**
+ * Whether a record that found no space waits for the consumer.
+ *
+ * Depending on where the cursors stand, a record larger than half the
+ * ring may not fit even in an empty ring.
+ */
+static bool async_logger_should_block(const snAsyncLogger *logger, snLogLevel level, size_t size) {
+    // Nobody else can free space
+    if (!logger->lock_free && !logger->lock) return false;
+    if (size > logger->buffer_size / 2) return false;
+
+    if (logger->backpressure == SN_BACKPRESSURE_BLOCK) return true;
+    return logger->backpressure == SN_BACKPRESSURE_LEVEL && level >= logger->block_level;
+}
+
+/**
+ * Wait until processing freed ring space after the given epoch, or a
+ * little while. Called without the lock held.
+ */
+static void async_logger_wait_space(snAsyncLogger *logger, uint32_t epoch, bool *waited) {
+    if (!*waited) {
+        sn_atomic_fetch_add_relaxed(&logger->blocked, 1);
+        *waited = true;
+    }
+
+    switch (logger->backpressure_wait) {
+    case SN_BACKPRESSURE_WAIT_SPIN:
+        for (size_t i = 0; i < SPIN_WAIT_PAUSES && sn_atomic_load_acquire(&logger->space_epoch) == epoch; ++i)
+            sn_atomic_pause();
+        break;
+
+    case SN_BACKPRESSURE_WAIT_YIELD:
+        notifier_yield();
+        break;
+
+    case SN_BACKPRESSURE_WAIT_FUTEX:
+        // Pairs with the fence of async_logger_space_freed: either the
+        // consumer sees the waiter or the waiter sees the new epoch
+        sn_atomic_fetch_add_relaxed(&logger->waiters, 1);
+        sn_atomic_fence();
+        if (sn_atomic_load_acquire(&logger->space_epoch) == epoch)
+            notifier_wait_address(&logger->space_epoch, epoch, SN_NOTIFIER_WAIT_FOREVER);
+        sn_atomic_fetch_add_relaxed(&logger->waiters, (uint32_t)-1);
+        break;
+    }
+}
+
+/**
+ * Wake producers waiting for space. Called by the serialized consumer
+ * after moving the read offset.
+ */
+static void async_logger_space_freed(snAsyncLogger *logger) {
+    sn_atomic_store_release(&logger->space_epoch, logger->space_epoch + 1);
+
+    sn_atomic_fence();
+    if (sn_atomic_load_relaxed(&logger->waiters)) notifier_wake_address(&logger->space_epoch);
+}
+
+/**
+ * Drop the oldest uncollected record of the shared ring to make room.
+ *
+ * Only done while the ring is the sole source of records and no batch is
+ * being emitted, so the dropped record is the one the consumer expects
+ * next and the merge by sequence is not broken by a gap.
+ *
+ * Must be called with the lock held.
+ */
+static bool ring_buffer_drop_oldest(snAsyncLogger *logger) {
+    if (logger->shards || logger->sink_cursors || logger->segment_head || logger->read_offset != logger->peek_offset) return false;
+
+    snLogRecordHeader *record = ring_buffer_peek(logger);
+    if (!record) return false;
+
+    sn_atomic_store_relaxed(&logger->processed_sequence, sequence_extend(logger->processed_sequence, record->sequence));
+    logger->peek_offset += record_size(record_len(record));
+    sn_atomic_store_relaxed(&logger->read_offset, logger->peek_offset);
+
+    sn_atomic_fetch_add_relaxed(&logger->overwritten, 1);
+    async_logger_drop(logger, record_level(record));
+    return true;
+}
+
+/**
+ * Call the notify hook once pending records cross a threshold, given the
+ * sequence of the record just enqueued and the bytes used in its ring.
+ *
+ * Fires once, then stays quiet until the consumer re-arms it.
+ */
+static void async_logger_notify(snAsyncLogger *logger, uint64_t sequence, size_t used, uint64_t timestamp) {
+    if (!sn_atomic_load_relaxed(&logger->notify_armed)) return;
+
+    uint64_t since = sn_atomic_load_relaxed(&logger->pending_since);
+    if (!since && timestamp && sn_atomic_cas(&logger->pending_since, &since, timestamp)) since = timestamp;
+
+    uint64_t pending = sequence - sn_atomic_load_relaxed(&logger->processed_sequence);
+
+    bool due = (logger->notify_records && pending >= logger->notify_records)
+        || (logger->notify_bytes && used >= logger->notify_bytes)
+        || (logger->notify_age && since && timestamp - since >= logger->notify_age);
+    if (!due) return;
+
+    uint32_t armed = 1;
+    while (!sn_atomic_cas(&logger->notify_armed, &armed, 0))
+        if (!armed) return;
+
+    logger->notify(logger->notify_data);
+}
+
+/**
+ * Re-arm the notify hook after processing.
+ */
+static void async_logger_rearm(snAsyncLogger *logger) {
+    if (!logger->notify) return;
+
+    sn_atomic_store_relaxed(&logger->pending_since, 0);
+    if (!sn_atomic_load_relaxed(&logger->notify_armed)) sn_atomic_store_release(&logger->notify_armed, 1);
+}
+
+/**
+ * Payload of a record being enqueued.
+ *
+ * Either a ready payload that is copied, or a format string with its
+ * arguments that is formatted directly into the record after the call
+ * site, if any.
+ */
+typedef struct recordPayload {
+    const char *msg;
+    const char *fmt;
+    va_list *args;
+    const snLogSite *site;
+    uint32_t flags;
+    uint64_t timestamp;
+    bool no_wait; // Drop rather than wait for space, for records of the consumer
+} recordPayload;
+
+static void record_write(snLogRecordHeader *record, snLogLevel level, uint64_t sequence, size_t len, const recordPayload *payload, uint32_t flags) {
+    record->sequence = (uint32_t)sequence;
+    record->timestamp = payload->timestamp;
+
+    char *body = (char *)(record + 1);
+
+    if (payload->msg) {
+        memcpy(body, payload->msg, len * sizeof(char));
+    } else {
+        size_t prefix = 0;
+        if (payload->site) {
+            memcpy(body, &payload->site, sizeof(payload->site));
+            prefix = sizeof(payload->site);
+        }
+
+        format_string(body + prefix, len - prefix + 1, payload->fmt, *payload->args);
+    }
+
+    sn_atomic_store_release(&record->info, record_info(payload->flags | flags, level, len));
+}
+
+static bool async_logger_enqueue(snAsyncLogger *logger, snLogLevel level, size_t len, const recordPayload *payload) {
+    if (len > SN_LOG_RECORD_MAX_LEN) {
+        async_logger_drop(logger, level);
+        return false;
+    }
+
+    size_t size = record_size(len);
+    size_t used;
+    bool waited = false;
+
+    if (logger->lock_free) {
+        used = ring_used(sn_atomic_load_relaxed(&logger->write_offset), sn_atomic_load_relaxed(&logger->read_offset), logger->buffer_size);
+        if (async_logger_shed(logger, level, used, logger->buffer_size)) return false;
+
+        snLogRecordHeader *record;
+        for (;;) {
+            uint32_t epoch = sn_atomic_load_acquire(&logger->space_epoch);
+
+            record = ring_buffer_allocate_lock_free(logger, size);
+            if (record || payload->no_wait || !async_logger_should_block(logger, level, size)) break;
+
+            async_logger_wait_space(logger, epoch, &waited);
+        }
+
+        if (!record) {
+            async_logger_drop(logger, level);
+            return false;
+        }
+
+        uint64_t sequence = sn_atomic_fetch_add_relaxed(&logger->sequence, 1);
+        record_write(record, level, sequence, len, payload, SN_LOG_RECORD_COMMITTED);
+
+        used = ring_used(sn_atomic_load_relaxed(&logger->write_offset), sn_atomic_load_relaxed(&logger->read_offset), logger->buffer_size);
+        async_logger_enqueued(logger, level, used);
+
+        if (logger->notify) async_logger_notify(logger, sequence, used, payload->timestamp);
+        return true;
+    }
+
+    snAsyncShard *shard = logger->shards ? async_logger_thread_shard(logger) : NULL;
+    if (shard) {
+        used = ring_used(shard->write_offset, sn_atomic_load_relaxed(&shard->read_offset), shard->buffer_size);
+        if (async_logger_shed(logger, level, used, shard->buffer_size)) return false;
+
+        size_t next;
+        snLogRecordHeader *record = shard_allocate(logger, shard, size, &next);
+
+        if (record) {
+            uint64_t sequence = sn_atomic_fetch_add_relaxed(&logger->sequence, 1);
+            record_write(record, level, sequence, len, payload, 0);
+
+            shard_publish(shard, next);
+
+            used = ring_used(next, sn_atomic_load_relaxed(&shard->read_offset), shard->buffer_size);
+            async_logger_enqueued(logger, level, used);
+
+            if (logger->notify) async_logger_notify(logger, sequence, used, payload->timestamp);
+            return true;
+        }
+    }
+
+    async_logger_lock(logger);
+
+    if (async_logger_shed(logger, level, ring_used(logger->write_offset, logger->read_offset, logger->buffer_size), logger->buffer_size)) {
+        async_logger_unlock(logger);
+        return false;
+    }
+
+    for (;;) {
+        snLogRecordHeader *record = ring_buffer_allocate(logger, size);
+
+        // Overflow means a full ring
+        used = logger->buffer_size;
+        if (record) {
+            used = ring_used(logger->write_offset, logger->read_offset, logger->buffer_size);
+        } else if ((record = segment_allocate(logger, size))) {
+            stat_add(&logger->overflow_records, 1);
+            stat_add(&logger->overflow_bytes, size);
+        }
+
+        if (record) {
+            uint64_t sequence = sn_atomic_fetch_add_relaxed(&logger->sequence, 1);
+            record_write(record, level, sequence, len, payload, 0);
+            async_logger_enqueued(logger, level, used);
+
+            async_logger_unlock(logger);
+
+            if (logger->notify) async_logger_notify(logger, sequence, used, payload->timestamp);
+            return true;
+        }
+
+        if (logger->backpressure == SN_BACKPRESSURE_DROP_OLDEST && ring_buffer_drop_oldest(logger)) continue;
+
+        if (payload->no_wait || !async_logger_should_block(logger, level, size)) break;
+
+        uint32_t epoch = logger->space_epoch;
+        async_logger_unlock(logger);
+
+        async_logger_wait_space(logger, epoch, &waited);
+
+        async_logger_lock(logger);
+    }
+
+    async_logger_drop(logger, level);
+    async_logger_unlock(logger);
+    return false;
+}
+
+/**
+ * Enqueue a message, site is NULL for calls not made through a call site.
+ *
+ * Records of a call site start with the site pointer, which also gives the
+ * format string of deferred records. Other deferred records start with the
+ * format string pointer.
+ */
+static uint64_t async_logger_now(const snAsyncLogger *logger) {
+    return logger->clock ? logger->clock(logger->clock_data) : 0;
+}
+
+static void async_logger_log(snAsyncLogger *logger, snLogLevel level, const snLogSite *site, const char *fmt, va_list args, uint64_t timestamp) {
+    // Format once into the scratch buffer, then the record is a plain copy.
+    // Only messages longer than the scratch buffer are formatted twice.
+    char scratch[SN_ASYNC_LOGGER_SCRATCH_SIZE];
+
+    uint32_t flags = 0;
+    size_t prefix = 0;
+    if (site) {
+        memcpy(scratch, &site, sizeof(site));
+        prefix = sizeof(site);
+        flags = SN_LOG_RECORD_SITE;
+    }
+
+    if (logger->format_buffer) {
+        size_t deferred_prefix = prefix;
+        if (!site) {
+            memcpy(scratch, &fmt, sizeof(fmt));
+            deferred_prefix = sizeof(fmt);
+        }
+
+        // Call sites parse their format string once
+        const snFormatArgs *parsed = site ? sn_log_site_args(site) : NULL;
+
+        char *args_buffer = scratch + deferred_prefix;
+        size_t args_buffer_size = sizeof(scratch) - deferred_prefix;
+        size_t size = parsed
+            ? format_capture_args(args_buffer, args_buffer_size, parsed, args)
+            : format_capture(args_buffer, args_buffer_size, fmt, args);
+
+        if (size != FORMAT_CAPTURE_FAILED) {
+            async_logger_enqueue(logger, level, deferred_prefix + size,
+                    &(recordPayload){.msg = scratch, .flags = flags | SN_LOG_RECORD_DEFERRED, .timestamp = timestamp});
+            return;
+        }
+    }
 
     va_list args_copy;
+
     va_copy(args_copy, args);
-    // TODO: Temporary fix: vsnprintf writes upto len bytes including null character
-    size_t len = format_string(NULL, 0, fmt, args_copy) + 1;
+    size_t len = format_string(scratch + prefix, sizeof(scratch) - prefix, fmt, args_copy);
     va_end(args_copy);
+
     if (len == 0) {
-        logger->dropped++;
+        async_logger_drop(logger, level);
         return;
     }
 
-    async_logger_lock(logger);
-    size_t record_size = sizeof(snLogRecordHeader) + len;
-    snLogRecordHeader *record = ring_buffer_allocate(logger, record_size);
+    if (len < sizeof(scratch) - prefix) {
+        async_logger_enqueue(logger, level, prefix + len, &(recordPayload){.msg = scratch, .flags = flags, .timestamp = timestamp});
+        return;
+    }
 
-    if (record) {
-        record->level = level;
-        record->len = len;
-        record->timestamp = logger->timestamp++;
-        format_string((char *)(record + 1), len, fmt, args);
+    va_copy(args_copy, args);
+    async_logger_enqueue(logger, level, prefix + len,
+            &(recordPayload){.fmt = fmt, .args = &args_copy, .site = site, .flags = flags, .timestamp = timestamp});
+    va_end(args_copy);
+}
 
-        async_logger_unlock(logger);
-        return;
+#define RATE_KIND_FORMAT 1u
+#define RATE_KIND_SITE 2u
+
+/**
+ * Find or claim the rate slot of a call site, the shared overflow bucket
+ * when the probed slots all belong to other sites.
+ */
+static snAsyncRateSlot *rate_slot_find(snAsyncLogger *logger, uintptr_t key, uint32_t kind) {
+    size_t index = (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32);
+
+    for (size_t probe = 0; probe < SN_ASYNC_RATE_PROBES && probe <= logger->rate_slot_mask; ++probe) {
+        snAsyncRateSlot *slot = &logger->rate_slots[(index + probe) & logger->rate_slot_mask];
+
+        uintptr_t owner = sn_atomic_load_relaxed(&slot->key);
+        if (!owner && sn_atomic_cas(&slot->key, &owner, key)) {
+            // Tells the consumer how to name the site in its summary
+            sn_atomic_store_release(&slot->kind, kind);
+            return slot;
+        }
+        if (owner == key) return slot;
     }
 
-    snLogRecordHeapNode *node = try_heap_allocation(logger, len);
-    if (node) {
-        node->record->level = level;
-        node->record->len = len;
-        node->record->timestamp = logger->timestamp++;
-        format_string((char *)(node->record + 1), len, fmt, args);
+    return &logger->rate_overflow;
+}
 
-        async_logger_unlock(logger);
-        return;
+/**
+ * Take a token from a bucket, as a generic cell rate algorithm: the
+ * bucket is a single timestamp, the time it is full again.
+ */
+static bool rate_slot_take(snAsyncRateSlot *slot, uint64_t now, uint64_t interval, uint64_t tolerance) {
+    uint64_t full_at = sn_atomic_load_relaxed(&slot->full_at);
+
+    for (;;) {
+        uint64_t start = SN_MAX(full_at, now);
+        if (start - now > tolerance) return false;
+
+        if (sn_atomic_cas(&slot->full_at, &full_at, start + interval)) return true;
     }
+}
 
-    logger->dropped++;
-    async_logger_unlock(logger);
+static size_t rate_summary_format(char *buffer, size_t buffer_size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t len = format_string(buffer, buffer_size, fmt, args);
+    va_end(args);
+
+    return SN_MIN(len, buffer_size - 1);
+}
+
+/**
+ * Log the summary of the messages suppressed by a slot. A summary that
+ * finds no space gives its count back to the slot.
+ */
+static void rate_slot_report(snAsyncLogger *logger, snAsyncRateSlot *slot, snLogLevel level, size_t suppressed, uint64_t timestamp, bool wait) {
+    char msg[SN_ASYNC_LOGGER_SCRATCH_SIZE];
+    size_t len;
+
+    if (slot == &logger->rate_overflow) {
+        len = rate_summary_format(msg, sizeof(msg), "suppressed %zu messages from call sites without a rate slot", suppressed);
+    } else if (sn_atomic_load_acquire(&slot->kind) == RATE_KIND_SITE) {
+        const snLogSite *site = (const snLogSite *)sn_atomic_load_relaxed(&slot->key);
+        len = rate_summary_format(msg, sizeof(msg), "suppressed %zu messages from %s:%u", suppressed, site->file, (unsigned)site->line);
+    } else {
+        len = rate_summary_format(msg, sizeof(msg), "suppressed %zu messages of \"%s\"", suppressed, (const char *)sn_atomic_load_relaxed(&slot->key));
+    }
+
+    if (async_logger_enqueue(logger, level, len, &(recordPayload){.msg = msg, .timestamp = timestamp, .no_wait = !wait})) {
+        sn_atomic_fetch_add_relaxed(&logger->rate_pending, (size_t)0 - suppressed);
+    } else {
+        sn_atomic_fetch_add_relaxed(&slot->suppressed, suppressed);
+    }
+}
+
+/**
+ * Whether the rate limit suppresses a message, site is NULL for calls not
+ * made through a call site. Logs the summary of the suppressed messages
+ * before a message let through.
+ */
+static bool async_logger_rate_limited(snAsyncLogger *logger, snLogLevel level, const snLogSite *site, const char *fmt, uint64_t timestamp) {
+    snAsyncRateSlot *slot = site
+        ? rate_slot_find(logger, (uintptr_t)site, RATE_KIND_SITE)
+        : rate_slot_find(logger, (uintptr_t)fmt, RATE_KIND_FORMAT);
+
+    uint64_t now = logger->clock ? timestamp : sn_clock_monotonic(NULL);
+
+    if (!rate_slot_take(slot, now, logger->rate_interval, logger->rate_tolerance)) {
+        sn_atomic_store_relaxed(&slot->level, (uint32_t)level);
+        sn_atomic_fetch_add_relaxed(&slot->suppressed, 1);
+        sn_atomic_fetch_add_relaxed(&logger->rate_pending, 1);
+        sn_atomic_fetch_add_relaxed(&logger->suppressed, 1);
+        return true;
+    }
+
+    if (!sn_atomic_load_relaxed(&slot->suppressed)) return false;
+
+    size_t suppressed = sn_atomic_exchange_relaxed(&slot->suppressed, 0);
+    if (suppressed) rate_slot_report(logger, slot, level, suppressed, timestamp, true);
+
+    return false;
+}
+
+/**
+ * Report the messages suppressed by call sites that went quiet, once their
+ * bucket has a token again, or right away when forced. Called by consumers
+ * without the lock, the summaries never wait for space.
+ */
+static void async_logger_rate_flush(snAsyncLogger *logger, bool force) {
+    if (!logger->rate_slots || !sn_atomic_load_relaxed(&logger->rate_pending)) return;
+
+    uint64_t timestamp = async_logger_now(logger);
+    uint64_t now = logger->clock ? timestamp : sn_clock_monotonic(NULL);
+
+    for (size_t i = 0; i <= logger->rate_slot_mask + 1; ++i) {
+        snAsyncRateSlot *slot = i <= logger->rate_slot_mask ? &logger->rate_slots[i] : &logger->rate_overflow;
+
+        if (!sn_atomic_load_relaxed(&slot->suppressed)) continue;
+
+        // A slot being claimed cannot be named yet
+        if (slot != &logger->rate_overflow && !sn_atomic_load_acquire(&slot->kind)) continue;
+
+        if (!force && !rate_slot_take(slot, now, logger->rate_interval, logger->rate_tolerance)) continue;
+
+        size_t suppressed = sn_atomic_exchange_relaxed(&slot->suppressed, 0);
+        if (suppressed) rate_slot_report(logger, slot, (snLogLevel)sn_atomic_load_relaxed(&slot->level), suppressed, timestamp, false);
+    }
+}
+
+void sn_async_logger_log_va(snAsyncLogger *logger, snLogLevel level, const char *fmt, va_list args) {
+    if (level < logger->level) return;
+
+    // Capture time, before formatting
+    uint64_t timestamp = async_logger_now(logger);
+    if (logger->rate_slots && async_logger_rate_limited(logger, level, NULL, fmt, timestamp)) return;
+
+    async_logger_log(logger, level, NULL, fmt, args, timestamp);
+}
+
+void sn_async_logger_log_site_va(snAsyncLogger *logger, const snLogSite *site, va_list args) {
+    if (!sn_log_site_enabled(site, logger->level)) return;
+
+    uint64_t timestamp = async_logger_now(logger);
+    if (logger->rate_slots && async_logger_rate_limited(logger, site->level, site, site->fmt, timestamp)) return;
+
+    async_logger_log(logger, site->level, site, site->fmt, args, timestamp);
 }
 
 void sn_async_logger_log_raw(snAsyncLogger *logger, snLogLevel level, const char *msg, size_t len) {
     if (level < logger->level) return;
 
-    async_logger_lock(logger);
+    async_logger_enqueue(logger, level, len, &(recordPayload){.msg = msg, .timestamp = async_logger_now(logger)});
+}
 
-    size_t record_size = sizeof(snLogRecordHeader) + len;
-    snLogRecordHeader *record = ring_buffer_allocate(logger, record_size);
+/**
+ * Records collected by the processing functions but not released yet.
+ *
+ * The ring space of the records is only released once every sink got the
+ * batch, so sinks can receive views pointing straight into the ring.
+ */
+typedef struct processBatch {
+    const snLogRecordHeader *records[SN_ASYNC_LOGGER_BATCH_SIZE];
+    uint64_t sequences[SN_ASYNC_LOGGER_BATCH_SIZE]; /**< Full sequence of each record */
+    size_t count;
+} processBatch;
 
-    if (record) {
-        record->level = level;
-        record->len = len;
-        record->timestamp = logger->timestamp++;
-        memcpy((void *)(record + 1), msg, len * sizeof(char));
+/**
+ * Write records to a sink, recording the duration of each write callback.
+ */
+static void sink_write_timed(snSink *sink, const snSinkRecord *records, size_t count) {
+    uint64_t start = sn_clock_monotonic(NULL);
 
-        async_logger_unlock(logger);
+    if (sink->write_batch) {
+        sink->write_batch(records, count, sink->data);
+        sn_histogram_record(sink->write_histogram, sn_clock_monotonic(NULL) - start);
         return;
     }
 
-    snLogRecordHeapNode *node = try_heap_allocation(logger, len);
-    if (node) {
-        node->record->level = level;
-        node->record->len = len;
-        node->record->timestamp = logger->timestamp++;
-        memcpy((void *)(node->record + 1), msg, len * sizeof(char));
+    for (size_t i = 0; i < count; ++i) {
+        sn_sink_write(sink, &records[i]);
 
-        async_logger_unlock(logger);
-        return;
+        uint64_t end = sn_clock_monotonic(NULL);
+        sn_histogram_record(sink->write_histogram, end - start);
+        start = end;
     }
+}
 
-    logger->dropped++;
-    async_logger_unlock(logger);
+/**
+ * Copy the records a sink accepts to out, returns their count.
+ */
+static size_t sink_filter(const snSink *sink, const snSinkRecord *records, size_t count, snSinkRecord *out) {
+    size_t out_count = 0;
+    for (size_t i = 0; i < count; ++i)
+        if (sn_sink_accepts(sink, records[i].level)) out[out_count++] = records[i];
+
+    return out_count;
 }
 
-size_t sn_async_logger_process_n(snAsyncLogger *logger, size_t n) {
+/**
+ * Sinks a batch is written to, and the buffer their deferred records are
+ * formatted into.
+ */
+typedef struct emitTarget {
+    snSink *sinks;
+    size_t sink_count;
+    char *format_buffer;
+    size_t format_buffer_size;
+} emitTarget;
+
+static emitTarget async_logger_target(snAsyncLogger *logger) {
+    return (emitTarget){
+        .sinks = logger->sinks,
+        .sink_count = logger->sink_count,
+        .format_buffer = logger->format_buffer,
+        .format_buffer_size = logger->format_buffer_size,
+    };
+}
+
+/**
+ * Write records to the sinks that accept them, given the mask of the
+ * levels present in the records.
+ */
+static void async_logger_deliver(const emitTarget *target, const snSinkRecord *records, size_t count, uint32_t levels) {
+    if (!count) return;
+
+    snSinkRecord filtered[SN_ASYNC_LOGGER_BATCH_SIZE];
+
+    for (size_t i = 0; i < target->sink_count; ++i) {
+        snSink *sink = &target->sinks[i];
+        const snSinkRecord *accepted = records;
+        size_t accepted_count = count;
+
+        // Only sinks missing some levels of the batch need a filtered copy
+        if (levels & ~sn_sink_levels(sink)) {
+            accepted = filtered;
+            accepted_count = sink_filter(sink, records, count, filtered);
+            if (!accepted_count) continue;
+        }
+
+        if (sink->write_histogram) {
+            sink_write_timed(sink, accepted, accepted_count);
+        } else {
+            sn_sink_write_batch(sink, accepted, accepted_count);
+        }
+
+        // Sinks are written outside the lock
+        sn_atomic_fetch_add_relaxed(&sink->calls, sink->write_batch ? 1 : accepted_count);
+        sn_atomic_fetch_add_relaxed(&sink->records, accepted_count);
+    }
+}
+
+/**
+ * Write a batch of records to all sinks, formatting the deferred ones first.
+ *
+ * Deferred records are formatted one after another into the format buffer.
+ * When it runs out of space, the records gathered so far are delivered
+ * and the buffer is reused.
+ */
+static void async_logger_emit(const emitTarget *target, processBatch *batch) {
+    snSinkRecord out[SN_ASYNC_LOGGER_BATCH_SIZE];
+    size_t out_count = 0;
+    size_t format_used = 0;
+
+    // Levels formatted for the sinks wanting text, sinks taking the
+    // captured arguments make formatting unnecessary
+    uint32_t format_levels = 0;
+    for (size_t i = 0; i < target->sink_count; ++i)
+        if (!(target->sinks[i].flags & SN_SINK_DEFERRED)) format_levels |= sn_sink_levels(&target->sinks[i]);
+
+    // Levels present in out
+    uint32_t levels = 0;
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        const snLogRecordHeader *record = batch->records[i];
+        snSinkRecord *view = &out[out_count];
+
+        *view = (snSinkRecord){
+            .msg = (const char *)(record + 1),
+            .len = record_len(record),
+            .level = record_level(record),
+            .sequence = batch->sequences[i],
+            .timestamp = record->timestamp,
+        };
+
+        if (record_flags(record) & SN_LOG_RECORD_SITE) {
+            memcpy(&view->site, view->msg, sizeof(view->site));
+            view->msg += sizeof(view->site);
+            view->len -= sizeof(view->site);
+        }
+
+        if (record_flags(record) & SN_LOG_RECORD_DEFERRED) {
+            if (view->site) {
+                view->fmt = view->site->fmt;
+            } else {
+                memcpy(&view->fmt, view->msg, sizeof(view->fmt));
+                view->msg += sizeof(view->fmt);
+                view->len -= sizeof(view->fmt);
+            }
+
+            view->args = view->msg;
+            view->args_size = view->len;
+            view->msg = NULL;
+            view->len = 0;
+        }
+
+        if (view->fmt && !target->format_buffer_size) {
+            // No room to format into, text sinks get an empty message
+            view->msg = "";
+        } else if (view->fmt && (format_levels & SN_LOG_LEVEL_BIT(view->level))) {
+            size_t available = target->format_buffer_size - format_used;
+            size_t len = format_captured(target->format_buffer + format_used, available, view->fmt, view->args, view->args_size);
+
+            if (len >= available && format_used) {
+                // Deliver the messages formatted so far and start over
+                async_logger_deliver(target, out, out_count, levels);
+                out[0] = *view;
+                view = &out[0];
+                out_count = 0;
+                format_used = 0;
+                levels = 0;
+
+                available = target->format_buffer_size;
+                len = format_captured(target->format_buffer, available, view->fmt, view->args, view->args_size);
+            }
+
+            if (len >= available) len = available - 1;
+
+            view->msg = target->format_buffer + format_used;
+            view->len = len;
+            format_used += len + 1;
+        }
+
+        levels |= SN_LOG_LEVEL_BIT(view->level);
+        ++out_count;
+    }
+
+    async_logger_deliver(target, out, out_count, levels);
+}
+
+/**
+ * Emit a batch and record the batch size and duration, and how long its
+ * records were queued.
+ */
+static void async_logger_emit_timed(snAsyncLogger *logger, const emitTarget *target, processBatch *batch) {
+    if (logger->queue_histogram && logger->clock) {
+        uint64_t now = logger->clock(logger->clock_data);
+
+        for (size_t i = 0; i < batch->count; ++i) {
+            uint64_t timestamp = batch->records[i]->timestamp;
+            if (timestamp) sn_histogram_record(logger->queue_histogram, now > timestamp ? now - timestamp : 0);
+        }
+    }
+
+    uint64_t start = sn_clock_monotonic(NULL);
+    async_logger_emit(target, batch);
+    uint64_t elapsed = sn_clock_monotonic(NULL) - start;
+
+    stat_max(&logger->batch_max_records, batch->count);
+    stat_max_u64(&logger->batch_max_ns, elapsed);
+}
+
+static size_t async_logger_process_n_lock_free(snAsyncLogger *logger, size_t n) {
     size_t count = 0;
+    processBatch batch = {0};
+    emitTarget target = async_logger_target(logger);
 
     async_logger_lock(logger);
 
-    while (logger->read_offset != logger->write_offset && count < n) {
-        void *read_ptr = ((char *)logger->buffer) + logger->read_offset;
-        snLogRecordHeader *record = (snLogRecordHeader *)GET_ALIGNED(read_ptr, alignof(snLogRecordHeader));
-        logger->read_offset += PTR_BYTE_DIFF(record, read_ptr);
+    while (count < n) {
+        // Collect the contiguous committed records
+        size_t read = logger->read_offset;
+        snLogRecordHeader *wrap = NULL;
+        batch.count = 0;
+
+        while (batch.count < SN_ASYNC_LOGGER_BATCH_SIZE && count + batch.count < n) {
+            if (read == sn_atomic_load_acquire(&logger->write_offset)) break;
+
+            if (logger->buffer_size - read < sizeof(snLogRecordHeader)) {
+                // Next record should start from 0 itself
+                read = 0;
+                continue;
+            }
+
+            snLogRecordHeader *record = record_at(logger->buffer, read);
+
+            // Reserved but not yet published
+            if (!(sn_atomic_load_acquire(&record->info) & SN_LOG_RECORD_COMMITTED)) break;
+
+            if (record_level(record) == RECORD_WRAP_MARK) {
+                wrap = record;
+                read = 0;
+                continue;
+            }
+
+            // Producers reserve space before taking a sequence number, so
+            // records may sit in the ring slightly out of sequence order
+            uint64_t sequence = sequence_extend(logger->processed_sequence, record->sequence);
+            if (sequence > logger->processed_sequence) sn_atomic_store_relaxed(&logger->processed_sequence, sequence);
+
+            sn_atomic_fetch_add_relaxed(&logger->processed[record_level(record)], 1);
+            batch.sequences[batch.count] = sequence;
+            batch.records[batch.count++] = record;
+            read += record_size(record_len(record));
+        }
 
-        if (logger->read_offset >= logger->buffer_size || logger->buffer_size - logger->read_offset < sizeof(snLogRecordHeader)) {
-            // Next record should start from 0 itself
-            logger->read_offset = 0;
+        if (!batch.count && !wrap) break;
+
+        async_logger_emit_timed(logger, &target, &batch);
+
+        count += batch.count;
+
+        // Free space must stay zeroed, see sn_async_logger_set_lock_free
+        for (size_t i = 0; i < batch.count; ++i)
+            memset((void *)batch.records[i], 0, record_size(record_len(batch.records[i])));
+        if (wrap) memset(wrap, 0, sizeof(snLogRecordHeader));
+
+        sn_atomic_store_release(&logger->read_offset, read);
+        async_logger_space_freed(logger);
+    }
+
+    async_logger_unlock(logger);
+
+    if (count) async_logger_rearm(logger);
+
+    return count;
+}
+
+/**
+ * Skip wrap marks and return the oldest uncollected published record of
+ * the shard, if any.
+ */
+static snLogRecordHeader *shard_peek(snAsyncShard *shard) {
+    size_t write = sn_atomic_load_acquire(&shard->write_offset);
+
+    while (shard->peek_offset != write) {
+        if (shard->buffer_size - shard->peek_offset < sizeof(snLogRecordHeader)) {
+            shard->peek_offset = 0;
             continue;
         }
 
-        // Check for wrap mark
-        if (record->level == SN_LOG_LEVEL_FATAL + 1) {
-            logger->read_offset = 0;
+        snLogRecordHeader *record = record_at(shard->buffer, shard->peek_offset);
+
+        if (record_level(record) == RECORD_WRAP_MARK) {
+            shard->peek_offset = 0;
             continue;
         }
 
-        // maintain the order
-        if (logger->processed_timestamp + 1 != record->timestamp) break;
-        logger->processed_timestamp = record->timestamp; // or just logger->processed_timestamp++;
+        return record;
+    }
+
+    return NULL;
+}
+
+// Record sources merged by the consumer, shards follow
+#define SOURCE_RING 0
+#define SOURCE_SEGMENT 1
+#define SOURCE_SHARD 2
+
+static snLogRecordHeader *source_peek(snAsyncLogger *logger, size_t source) {
+    if (source == SOURCE_RING) return ring_buffer_peek(logger);
+    if (source == SOURCE_SEGMENT) return segment_peek(logger);
+    return shard_peek(&logger->shards[source - SOURCE_SHARD]);
+}
+
+/**
+ * Find the record carrying the given counter value.
+ *
+ * The counter is global, so this is a k-way merge of the sources. The
+ * source of the previous record is checked first as consecutive records
+ * usually come from the same one.
+ */
+static snLogRecordHeader *async_logger_next_record(snAsyncLogger *logger, uint32_t sequence, size_t *source) {
+    snLogRecordHeader *record = source_peek(logger, *source);
+    if (record && record->sequence == sequence) return record;
+
+    size_t source_count = SOURCE_SHARD + logger->shard_count;
+    for (size_t i = 0; i < source_count; ++i) {
+        if (i == *source) continue;
+
+        record = source_peek(logger, i);
+        if (record && record->sequence == sequence) {
+            *source = i;
+            return record;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Release the ring space every attached sink wrote, detaching the sinks
+ * lagging beyond the threshold while another one keeps up. Sinks being
+ * written to are not detached, they still read their records.
+ *
+ * Returns the number of records released. Must be called with the lock held.
+ */
+static size_t sink_cursors_release(snAsyncLogger *logger) {
+    size_t write = logger->write_offset;
+    size_t detach = logger->sink_detach_bytes;
+
+    size_t min_lag = (size_t)-1;
+    for (size_t i = 0; i < logger->sink_count; ++i) {
+        const snAsyncSinkCursor *cursor = &logger->sink_cursors[i];
+        if (!cursor->detached) min_lag = SN_MIN(min_lag, ring_used(write, cursor->read_offset, logger->buffer_size));
+    }
+
+    // The slowest attached sink sets the new read offset, everything is
+    // released without attached sinks
+    size_t target = write;
+    size_t max_lag = 0;
+    for (size_t i = 0; i < logger->sink_count; ++i) {
+        snAsyncSinkCursor *cursor = &logger->sink_cursors[i];
+        if (cursor->detached) continue;
 
+        size_t lag = ring_used(write, cursor->read_offset, logger->buffer_size);
+        if (detach && lag > detach && min_lag <= detach && cursor->peek_offset == cursor->read_offset) {
+            sn_atomic_store_relaxed(&cursor->detached, 1);
+            stat_add(&cursor->detaches, 1);
+            continue;
+        }
+
+        if (lag > max_lag) {
+            max_lag = lag;
+            target = cursor->read_offset;
+        }
+    }
+
+    size_t read = logger->read_offset;
+    size_t released = 0;
+    uint64_t sequence = logger->processed_sequence;
+
+    while (read != target) {
+        if (logger->buffer_size - read < sizeof(snLogRecordHeader)) {
+            read = 0;
+            continue;
+        }
+
+        const snLogRecordHeader *record = record_at(logger->buffer, read);
+        if (record_level(record) == RECORD_WRAP_MARK) {
+            read = 0;
+            continue;
+        }
+
+        sequence = sequence_extend(sequence, record->sequence);
+        stat_add(&logger->processed[record_level(record)], 1);
+        read += record_size(record_len(record));
+        ++released;
+    }
+
+    if (read == logger->read_offset) return 0;
+
+    logger->peek_offset = read;
+    sn_atomic_store_relaxed(&logger->read_offset, read);
+    sn_atomic_store_relaxed(&logger->processed_sequence, sequence);
+    async_logger_space_freed(logger);
+
+    return released;
+}
+
+/**
+ * Write at max n records to one sink, adding the records released on the
+ * way to released. Returns the number of records written.
+ */
+static size_t async_logger_process_sink(snAsyncLogger *logger, size_t sink, size_t n, size_t *released) {
+    snAsyncSinkCursor *cursor = &logger->sink_cursors[sink];
+    size_t count = 0;
+    processBatch batch = {0};
+
+    // Each text sink formats its deferred records into its part of the buffer
+    size_t part = 0;
+    size_t parts = sink_format_parts(logger, sink, &part);
+    bool formats = logger->format_buffer && !(logger->sinks[sink].flags & SN_SINK_DEFERRED);
+    size_t format_size = formats ? logger->format_buffer_size / parts : 0;
+    emitTarget target = {
+        .sinks = &logger->sinks[sink],
+        .sink_count = 1,
+        .format_buffer = format_size ? logger->format_buffer + part * format_size : NULL,
+        .format_buffer_size = format_size,
+    };
+
+    async_logger_lock(logger);
+
+    // Another thread writing to the same sink, the space is released by
+    // cursor so it goes first
+    while (cursor->peek_offset != cursor->read_offset) {
         async_logger_unlock(logger);
+        notifier_yield();
+        async_logger_lock(logger);
+    }
 
-        for (size_t i = 0; i < logger->sink_count; ++i)
-            logger->sinks[i].write((const char *)(record + 1), record->len, record->level, logger->sinks[i].data);
+    while (count < n && !cursor->detached) {
+        uint64_t sequence = cursor->sequence;
+        batch.count = 0;
 
-        ++count;
+        while (batch.count < SN_ASYNC_LOGGER_BATCH_SIZE && count + batch.count < n) {
+            snLogRecordHeader *record = ring_buffer_peek_at(logger, &cursor->peek_offset);
+            if (!record) break;
+
+            sequence = sequence_extend(sequence, record->sequence);
+            batch.sequences[batch.count] = sequence;
+            batch.records[batch.count++] = record;
+            cursor->peek_offset += record_size(record_len(record));
+        }
+
+        if (!batch.count) {
+            // Wrap marks skipped by the peek
+            sn_atomic_store_relaxed(&cursor->read_offset, cursor->peek_offset);
+            break;
+        }
+
+        async_logger_unlock(logger);
+
+        async_logger_emit_timed(logger, &target, &batch);
+
+        count += batch.count;
 
         async_logger_lock(logger);
 
-        logger->read_offset += sizeof(snLogRecordHeader) + record->len;
+        sn_atomic_store_relaxed(&cursor->read_offset, cursor->peek_offset);
+        sn_atomic_store_relaxed(&cursor->sequence, sequence);
+
+        *released += sink_cursors_release(logger);
     }
 
-    while (logger->heap_head && count < n) {
-        snLogRecordHeapNode *node = logger->heap_head;
-        // maintain the order
-        if (logger->processed_timestamp + 1 != node->record->timestamp) break;
-        logger->processed_timestamp = node->record->timestamp; // or just logger->processed_timestamp++;
+    async_logger_unlock(logger);
+
+    return count;
+}
+
+size_t sn_async_logger_process_sink_n(snAsyncLogger *logger, size_t sink, size_t n) {
+    size_t released = 0;
+    size_t count = async_logger_process_sink(logger, sink, n, &released);
+
+    if (released) async_logger_rearm(logger);
+
+    return count;
+}
+
+static size_t async_logger_process_n_cursors(snAsyncLogger *logger, size_t n) {
+    size_t released = 0;
+
+    for (size_t i = 0; i < logger->sink_count; ++i)
+        async_logger_process_sink(logger, i, n, &released);
+
+    // Without attached sinks nothing else releases the records
+    async_logger_lock(logger);
+    released += sink_cursors_release(logger);
+    async_logger_unlock(logger);
+
+    if (released) async_logger_rearm(logger);
+
+    return released;
+}
+
+size_t sn_async_logger_sink_lag(const snAsyncLogger *logger, size_t sink, uint64_t *records) {
+    const snAsyncSinkCursor *cursor = &logger->sink_cursors[sink];
+    bool detached = sn_atomic_load_relaxed(&cursor->detached);
+
+    if (records) {
+        uint64_t last = sn_atomic_load_relaxed(&logger->sequence) - 1;
+        uint64_t written = sn_atomic_load_relaxed(&cursor->sequence);
+        *records = !detached && last > written ? last - written : 0;
+    }
+
+    if (detached) return 0;
+
+    return ring_used(sn_atomic_load_relaxed(&logger->write_offset), sn_atomic_load_relaxed(&cursor->read_offset), logger->buffer_size);
+}
+
+void sn_async_logger_attach_sink(snAsyncLogger *logger, size_t sink) {
+    snAsyncSinkCursor *cursor = &logger->sink_cursors[sink];
+
+    async_logger_lock(logger);
+
+    if (cursor->detached) {
+        cursor->peek_offset = logger->write_offset;
+        sn_atomic_store_relaxed(&cursor->read_offset, logger->write_offset);
+        sn_atomic_store_relaxed(&cursor->sequence, logger->sequence - 1);
+        sn_atomic_store_relaxed(&cursor->detached, 0);
+    }
+
+    async_logger_unlock(logger);
+}
+
+/**
+ * Wait until no other consumer is emitting records, then mark the logger
+ * as being processed. Called and returns with the lock held.
+ *
+ * The space of the collected records is released by peek offset, so one
+ * consumer at a time keeps another from freeing records still being
+ * written, and from sharing the format buffer.
+ */
+static void async_logger_begin_processing(snAsyncLogger *logger) {
+    while (logger->processing) {
+        async_logger_unlock(logger);
+        notifier_yield();
+        async_logger_lock(logger);
+    }
+
+    logger->processing = true;
+}
+
+size_t sn_async_logger_process_n(snAsyncLogger *logger, size_t n) {
+    async_logger_rate_flush(logger, false);
+
+    if (logger->lock_free) return async_logger_process_n_lock_free(logger, n);
+    if (logger->sink_cursors) return async_logger_process_n_cursors(logger, n);
+
+    size_t count = 0;
+    size_t source = SOURCE_RING;
+    processBatch batch = {0};
+    emitTarget target = async_logger_target(logger);
 
-        logger->heap_head = node->next;
+    async_logger_lock(logger);
+    async_logger_begin_processing(logger);
+
+    while (count < n) {
+        batch.count = 0;
+
+        while (batch.count < SN_ASYNC_LOGGER_BATCH_SIZE && count + batch.count < n) {
+            // maintain the order
+            uint64_t sequence = logger->processed_sequence + 1;
+            snLogRecordHeader *record = async_logger_next_record(logger, (uint32_t)sequence, &source);
+            if (!record) break;
+
+            sn_atomic_store_relaxed(&logger->processed_sequence, sequence);
+            stat_add(&logger->processed[record_level(record)], 1);
+            batch.sequences[batch.count] = sequence;
+            batch.records[batch.count++] = record;
+
+            if (source == SOURCE_RING) {
+                logger->peek_offset += record_size(record_len(record));
+            } else if (source == SOURCE_SEGMENT) {
+                logger->segment_peek->peek_offset += record_size(record_len(record));
+            } else {
+                logger->shards[source - SOURCE_SHARD].peek_offset += record_size(record_len(record));
+            }
+        }
 
-        if (!logger->heap_head) logger->heap_tail = NULL;
+        if (!batch.count) break;
 
         async_logger_unlock(logger);
 
-        for (size_t i = 0; i < logger->sink_count; ++i)
-            logger->sinks[i].write((const char *)(node->record + 1), node->record->len, node->record->level, logger->sinks[i].data);
+        async_logger_emit_timed(logger, &target, &batch);
 
-        if (logger->free) logger->free(node, logger->mem_data);
-        ++count;
+        count += batch.count;
 
         async_logger_lock(logger);
+
+        // Release the space of the emitted records
+        for (size_t i = 0; i < logger->shard_count; ++i) {
+            snAsyncShard *shard = &logger->shards[i];
+            if (shard->read_offset != shard->peek_offset)
+                sn_atomic_store_release(&shard->read_offset, shard->peek_offset);
+        }
+
+        sn_atomic_store_relaxed(&logger->read_offset, logger->peek_offset);
+
+        segment_release(logger);
+        async_logger_space_freed(logger);
     }
 
+    logger->processing = false;
     async_logger_unlock(logger);
 
+    if (count) async_logger_rearm(logger);
+
     return count;
 }
 
+void sn_async_logger_get_stats(const snAsyncLogger *logger, snAsyncLoggerStats *stats) {
+    *stats = (snAsyncLoggerStats){
+        .dropped_total = sn_atomic_load_relaxed(&logger->dropped),
+        .overwritten = sn_atomic_load_relaxed(&logger->overwritten),
+        .shed = sn_atomic_load_relaxed(&logger->shed),
+        .blocked = sn_atomic_load_relaxed(&logger->blocked),
+        .suppressed = sn_atomic_load_relaxed(&logger->suppressed),
+
+        .overflow_records = sn_atomic_load_relaxed(&logger->overflow_records),
+        .overflow_bytes = sn_atomic_load_relaxed(&logger->overflow_bytes),
+        .segment_count = sn_atomic_load_relaxed(&logger->segment_count),
+        .segment_high_watermark = sn_atomic_load_relaxed(&logger->segment_high_watermark),
+
+        .ring_size = logger->buffer_size,
+        .ring_used = ring_used(sn_atomic_load_relaxed(&logger->write_offset), sn_atomic_load_relaxed(&logger->read_offset), logger->buffer_size),
+        .ring_high_watermark = sn_atomic_load_relaxed(&logger->ring_high_watermark),
+        .wraps = sn_atomic_load_relaxed(&logger->wraps),
+
+        .batch_max_records = sn_atomic_load_relaxed(&logger->batch_max_records),
+        .batch_max_ns = sn_atomic_load_relaxed(&logger->batch_max_ns),
+    };
+
+    for (size_t i = 0; i < SN_LOG_LEVEL_COUNT; ++i) {
+        stats->enqueued[i] = sn_atomic_load_relaxed(&logger->enqueued[i]);
+        stats->processed[i] = sn_atomic_load_relaxed(&logger->processed[i]);
+        stats->dropped[i] = sn_atomic_load_relaxed(&logger->level_dropped[i]);
+    }
+
+    for (size_t i = 0; i < logger->shard_count; ++i) {
+        const snAsyncShard *shard = &logger->shards[i];
+        stats->ring_size += shard->buffer_size;
+        stats->ring_used += ring_used(sn_atomic_load_relaxed(&shard->write_offset), sn_atomic_load_relaxed(&shard->read_offset), shard->buffer_size);
+    }
+
+    // In lock-free mode records are processed slightly out of order
+    uint64_t last = sn_atomic_load_relaxed(&logger->sequence) - 1;
+    uint64_t processed = sn_atomic_load_relaxed(&logger->processed_sequence);
+    stats->pending = last > processed ? (size_t)(last - processed) : 0;
+
+    for (size_t i = 0; i < logger->sink_count; ++i) {
+        stats->sink_calls += sn_atomic_load_relaxed(&logger->sinks[i].calls);
+        stats->sink_records += sn_atomic_load_relaxed(&logger->sinks[i].records);
+    }
+}
+
 size_t sn_async_logger_drain(snAsyncLogger *logger) {
     size_t total = 0;
     size_t count;
@@ -264,4 +1865,3 @@ void sn_async_logger_drain_and_flush(snAsyncLogger *logger) {
     for (size_t i = 0; i < logger->sink_count; ++i)
         if (logger->sinks[i].flush) logger->sinks[i].flush(logger->sinks[i].data);
 }
-
@@ -0,0 +1,209 @@
+#include "snlogger/binary_sink.h"
+
+#include "formatter.h"
+
+#include <string.h>
+
+SN_STATIC_ASSERT((SN_BINARY_SINK_MAX_DESCRIPTORS & (SN_BINARY_SINK_MAX_DESCRIPTORS - 1)) == 0,
+        "SN_BINARY_SINK_MAX_DESCRIPTORS must be a power of two");
+
+// Keeps probe sequences short, further descriptors are written as text
+#define DESCRIPTOR_LIMIT (SN_BINARY_SINK_MAX_DESCRIPTORS / 4 * 3)
+
+// Encoded records are gathered here before going to the file sink
+#define BINARY_CHUNK_SIZE 4096
+
+// Largest encoded argument list and fallback text message
+#define BINARY_ARGS_MAX (2 * SN_ASYNC_LOGGER_SCRATCH_SIZE)
+
+// Longest tag and varint header of a record
+#define RECORD_HEADER_MAX 32
+
+typedef struct binaryChunk {
+    unsigned char data[BINARY_CHUNK_SIZE];
+    size_t used;
+} binaryChunk;
+
+static size_t varint_encode(unsigned char *out, uint64_t value) {
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+
+    return n;
+}
+
+static void chunk_flush(snBinarySink *sink, binaryChunk *chunk) {
+    if (!chunk->used) return;
+
+    sn_file_sink_write_raw(sink->file, chunk->data, chunk->used);
+    chunk->used = 0;
+}
+
+static void chunk_put(snBinarySink *sink, binaryChunk *chunk, const void *data, size_t len) {
+    if (sizeof(chunk->data) - chunk->used < len) {
+        chunk_flush(sink, chunk);
+
+        if (len > sizeof(chunk->data)) {
+            sn_file_sink_write_raw(sink->file, data, len);
+            return;
+        }
+    }
+
+    memcpy(chunk->data + chunk->used, data, len);
+    chunk->used += len;
+}
+
+static void chunk_put_string(snBinarySink *sink, binaryChunk *chunk, const char *str) {
+    size_t len = str ? strlen(str) : 0;
+
+    unsigned char header[10];
+    chunk_put(sink, chunk, header, varint_encode(header, len));
+    if (len) chunk_put(sink, chunk, str, len);
+}
+
+/**
+ * Find the descriptor id of a call site or format string.
+ *
+ * Writes the descriptor record for new keys. Returns false if the
+ * descriptor table is full.
+ */
+static bool binary_sink_descriptor(snBinarySink *sink, binaryChunk *chunk, const snSinkRecord *record, uint32_t *id) {
+    const void *key = record->site ? (const void *)record->site : (const void *)record->fmt;
+
+    size_t mask = SN_BINARY_SINK_MAX_DESCRIPTORS - 1;
+    size_t slot = (size_t)(((uint64_t)(uintptr_t)key >> 3) * 0x9e3779b97f4a7c15ull >> 32) & mask;
+
+    while (sink->keys[slot]) {
+        if (sink->keys[slot] == key) {
+            *id = sink->ids[slot];
+            return true;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    if (sink->descriptor_count >= DESCRIPTOR_LIMIT) return false;
+
+    *id = sink->descriptor_count++;
+    sink->keys[slot] = key;
+    sink->ids[slot] = *id;
+
+    const snLogSite *site = record->site;
+    snLogLevel level = site ? site->level : record->level;
+
+    unsigned char header[RECORD_HEADER_MAX];
+    size_t n = 0;
+    header[n++] = (unsigned char)(SN_BINARY_RECORD_DESCRIPTOR | (unsigned)level << 2);
+    n += varint_encode(header + n, *id);
+    n += varint_encode(header + n, site ? site->line : 0);
+    chunk_put(sink, chunk, header, n);
+
+    chunk_put_string(sink, chunk, site ? site->file : NULL);
+    chunk_put_string(sink, chunk, site ? site->function : NULL);
+    chunk_put_string(sink, chunk, record->fmt);
+
+    return true;
+}
+
+static uint64_t zigzag_delta(uint64_t value, uint64_t previous) {
+    int64_t delta = (int64_t)(value - previous);
+    return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+static void binary_sink_record(snBinarySink *sink, binaryChunk *chunk, const snSinkRecord *record) {
+    // Sequence numbers usually grow by one and timestamps by little, so
+    // zigzag deltas take a few bytes. Timestamps of different threads may
+    // go back slightly.
+    unsigned char header[RECORD_HEADER_MAX];
+    size_t n = 1;
+    n += varint_encode(header + n, zigzag_delta(record->sequence, sink->sequence));
+    n += varint_encode(header + n, zigzag_delta(record->timestamp, sink->timestamp));
+
+    sink->sequence = record->sequence;
+    sink->timestamp = record->timestamp;
+
+    if (record->fmt) {
+        unsigned char args[BINARY_ARGS_MAX];
+        size_t args_size = format_encode_captured(args, sizeof(args), record->fmt, record->args, record->args_size);
+
+        uint32_t id;
+        if (args_size != FORMAT_CAPTURE_FAILED && binary_sink_descriptor(sink, chunk, record, &id)) {
+            header[0] = (unsigned char)(SN_BINARY_RECORD_ARGS | (unsigned)record->level << 2);
+            n += varint_encode(header + n, id);
+            n += varint_encode(header + n, args_size);
+
+            chunk_put(sink, chunk, header, n);
+            chunk_put(sink, chunk, args, args_size);
+
+            sink->records++;
+            return;
+        }
+    }
+
+    const char *msg = record->msg;
+    size_t len = record->len;
+
+    // Only the arguments were given, render them here
+    char text[BINARY_ARGS_MAX];
+    if (!msg) {
+        len = format_captured(text, sizeof(text), record->fmt, record->args, record->args_size);
+        if (len >= sizeof(text)) len = sizeof(text) - 1;
+        msg = text;
+    }
+
+    header[0] = (unsigned char)(SN_BINARY_RECORD_TEXT | (unsigned)record->level << 2);
+    n += varint_encode(header + n, len);
+
+    chunk_put(sink, chunk, header, n);
+    chunk_put(sink, chunk, msg, len);
+
+    sink->records++;
+    sink->text_records++;
+}
+
+void sn_binary_sink_init(snBinarySink *sink, snFileSink *file) {
+    memset(sink, 0, sizeof(*sink));
+    sink->file = file;
+
+    unsigned char header[SN_BINARY_HEADER_SIZE] = {0};
+    memcpy(header, SN_BINARY_MAGIC, 4);
+    header[4] = SN_BINARY_VERSION;
+
+    sn_file_sink_write_raw(file, header, sizeof(header));
+}
+
+void sn_binary_sink_write_batch(const snSinkRecord *records, size_t count, void *data) {
+    snBinarySink *sink = data;
+
+    binaryChunk chunk;
+    chunk.used = 0;
+
+    for (size_t i = 0; i < count; ++i)
+        binary_sink_record(sink, &chunk, &records[i]);
+
+    chunk_flush(sink, &chunk);
+}
+
+void sn_binary_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    snSinkRecord record = {.msg = msg, .len = len, .level = level};
+    sn_binary_sink_write_batch(&record, 1, data);
+}
+
+void sn_binary_sink_flush(void *data) {
+    snBinarySink *sink = data;
+    sn_file_sink_flush(sink->file);
+}
+
+size_t sn_binary_format(char *buffer, size_t len, const char *fmt, const void *args, size_t args_size) {
+    // Native arguments take at most 8 times their varint encoding
+    unsigned char captured[8 * BINARY_ARGS_MAX];
+
+    size_t size = format_decode_captured(captured, sizeof(captured), fmt, args, args_size);
+    if (size == FORMAT_CAPTURE_FAILED) return (size_t)-1;
+
+    return format_captured(buffer, len, fmt, captured, size);
+}
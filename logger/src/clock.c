@@ -0,0 +1,186 @@
+#if !defined(_WIN32)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "snlogger/clock.h"
+
+#include "snlogger/atomic.h"
+
+#include <time.h>
+
+#if defined(SN_OS_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#endif
+
+#if defined(SN_COMPILER_MSVC) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+    #define CLOCK_HAS_TSC 1
+#elif !defined(SN_COMPILER_MSVC) && (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+    #define CLOCK_HAS_TSC 1
+#else
+    #define CLOCK_HAS_TSC 0
+#endif
+
+#if !defined(SN_OS_WINDOWS) && !defined(CLOCK_MONOTONIC_COARSE)
+    #define CLOCK_MONOTONIC_COARSE CLOCK_MONOTONIC
+#endif
+
+// Duration of the initial period measurement
+#define TSC_MEASURE_NS 1000000ull
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+uint64_t sn_clock_monotonic(void *data) {
+    SN_UNUSED(data);
+
+#if defined(SN_OS_WINDOWS)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    uint64_t ticks = (uint64_t)counter.QuadPart;
+    uint64_t hz = (uint64_t)frequency.QuadPart;
+    return ticks / hz * 1000000000ull + ticks % hz * 1000000000ull / hz;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_ns(&ts);
+#endif
+}
+
+uint64_t sn_clock_monotonic_coarse(void *data) {
+    SN_UNUSED(data);
+
+#if defined(SN_OS_WINDOWS)
+    return (uint64_t)GetTickCount64() * 1000000ull;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return timespec_ns(&ts);
+#endif
+}
+
+uint64_t sn_clock_realtime(void *data) {
+    SN_UNUSED(data);
+
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return timespec_ns(&ts);
+}
+
+#if CLOCK_HAS_TSC
+
+static uint64_t tsc_convert(uint64_t tsc, uint64_t tsc_base, uint64_t ns_base, uint64_t mult, uint32_t shift) {
+    // Counters of different cores may be slightly apart
+    uint64_t delta = tsc > tsc_base ? tsc - tsc_base : 0;
+
+    // mult is below 2^32, so neither product overflows
+    return ns_base + ((delta >> 32) * mult << (32 - shift)) + ((delta & 0xffffffffu) * mult >> shift);
+}
+
+static double tsc_period(const snTscClock *clock) {
+    return (double)clock->mult / (double)(1ull << clock->shift);
+}
+
+/**
+ * Publish a new conversion, readers retry while the version is odd or
+ * changed during their read.
+ */
+static void tsc_clock_update(snTscClock *clock, uint64_t tsc_base, uint64_t ns_base, double period) {
+    uint32_t shift = 32;
+    while (shift > 0 && period * (double)(1ull << shift) >= 4294967296.0)
+        --shift;
+
+    uint64_t version = clock->version;
+    sn_atomic_store_relaxed(&clock->version, version + 1);
+
+    sn_atomic_store_release(&clock->tsc_base, tsc_base);
+    sn_atomic_store_release(&clock->ns_base, ns_base);
+    sn_atomic_store_release(&clock->mult, (uint64_t)(period * (double)(1ull << shift)));
+    sn_atomic_store_release(&clock->shift, shift);
+
+    sn_atomic_store_release(&clock->version, version + 2);
+}
+
+#endif
+
+void sn_tsc_clock_init(snTscClock *clock, snClockFn reference, void *data, uint64_t interval) {
+    *clock = (snTscClock){
+        .reference = reference ? reference : sn_clock_monotonic,
+        .reference_data = data,
+        .interval = interval,
+    };
+
+#if CLOCK_HAS_TSC
+    uint64_t ns_start = clock->reference(data);
+    uint64_t tsc_start = __rdtsc();
+
+    uint64_t ns;
+    uint64_t tsc;
+    do {
+        ns = clock->reference(data);
+        tsc = __rdtsc();
+    } while (ns - ns_start < TSC_MEASURE_NS || tsc == tsc_start);
+
+    tsc_clock_update(clock, tsc, ns, (double)(ns - ns_start) / (double)(tsc - tsc_start));
+
+    clock->calibration_tsc = tsc;
+    clock->calibration_ns = ns;
+#endif
+}
+
+bool sn_tsc_clock_calibrate(snTscClock *clock) {
+#if CLOCK_HAS_TSC
+    uint64_t tsc = __rdtsc();
+    if (tsc <= clock->calibration_tsc) return false;
+
+    double ticks = (double)(tsc - clock->calibration_tsc);
+    double period = tsc_period(clock);
+    if (ticks * period < (double)clock->interval) return false;
+
+    uint64_t ns = clock->reference(clock->reference_data);
+    uint64_t estimate = tsc_convert(tsc, clock->tsc_base, clock->ns_base, clock->mult, clock->shift);
+    double error = (double)(int64_t)(ns - estimate);
+
+    // Take the measured period, adjusted to catch up with the reference
+    // over the next interval. Steps of the reference are only followed
+    // forward, the period stays within a factor of two.
+    double next = ((double)(int64_t)(ns - clock->calibration_ns) + error) / ticks;
+    next = SN_CLAMP(next, period / 2, period * 2);
+
+    bool step = error > (double)clock->interval;
+    tsc_clock_update(clock, tsc, step ? ns : estimate, next);
+
+    clock->calibration_tsc = tsc;
+    clock->calibration_ns = ns;
+    return true;
+#else
+    SN_UNUSED(clock);
+    return false;
+#endif
+}
+
+uint64_t sn_clock_tsc(void *data) {
+    snTscClock *clock = data;
+
+#if CLOCK_HAS_TSC
+    for (;;) {
+        uint64_t version = sn_atomic_load_acquire(&clock->version);
+        uint64_t tsc_base = sn_atomic_load_acquire(&clock->tsc_base);
+        uint64_t ns_base = sn_atomic_load_acquire(&clock->ns_base);
+        uint64_t mult = sn_atomic_load_acquire(&clock->mult);
+        uint32_t shift = (uint32_t)sn_atomic_load_acquire(&clock->shift);
+
+        if (!(version & 1) && sn_atomic_load_relaxed(&clock->version) == version)
+            return tsc_convert(__rdtsc(), tsc_base, ns_base, mult, shift);
+
+        sn_atomic_pause();
+    }
+#else
+    return clock->reference(clock->reference_data);
+#endif
+}
@@ -0,0 +1,197 @@
+#if !defined(_WIN32)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "snlogger/file_sink.h"
+
+#include <string.h>
+
+#if defined(SN_OS_WINDOWS)
+    #include <io.h>
+
+    typedef struct fileIov {
+        void *iov_base;
+        size_t iov_len;
+    } fileIov;
+#else
+    #include <errno.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+
+    typedef struct iovec fileIov;
+#endif
+
+// Records per writev() call, each takes two entries (message and newline)
+#define FILE_SINK_IOV_RECORDS 32
+
+static char newline = '\n';
+
+/**
+ * Write all the entries, retrying on partial writes.
+ *
+ * The entries are consumed. On failure the rest of the data is dropped.
+ */
+static void file_sink_write_iov(snFileSink *sink, fileIov *iov, int count) {
+    while (count > 0) {
+#if defined(SN_OS_WINDOWS)
+        // No gather write, one call per entry
+        long long written = _write(sink->fd, iov->iov_base, (unsigned int)iov->iov_len);
+#else
+        ssize_t written = writev(sink->fd, iov, count);
+#endif
+        sink->syscalls++;
+
+        if (written < 0) {
+#if !defined(SN_OS_WINDOWS)
+            if (errno == EINTR) continue;
+#endif
+            sink->errors++;
+            return;
+        }
+
+        sink->bytes_written += (uint64_t)written;
+
+        size_t left = (size_t)written;
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+}
+
+static void file_sink_write_buffer(snFileSink *sink) {
+    if (!sink->used) return;
+
+    fileIov iov = {.iov_base = sink->buffer, .iov_len = sink->used};
+    file_sink_write_iov(sink, &iov, 1);
+
+    sink->used = 0;
+    sink->pending_records = 0;
+}
+
+void sn_file_sink_init(snFileSink *sink, int fd, char *buffer, size_t buffer_size) {
+    *sink = (snFileSink){
+        .fd = fd,
+        .buffer = buffer,
+        .buffer_size = buffer ? buffer_size : 0,
+    };
+}
+
+bool sn_file_sink_init_alloc(snFileSink *sink, int fd, size_t buffer_size,
+        snMemoryAllocateFn alloc, snMemoryFreeFn free, void *data) {
+    char *buffer = buffer_size ? alloc(buffer_size, 1, data) : NULL;
+
+    sn_file_sink_init(sink, fd, buffer, buffer_size);
+    if (!buffer) return false;
+
+    sink->free = free;
+    sink->mem_data = data;
+
+    return true;
+}
+
+void sn_file_sink_deinit(snFileSink *sink) {
+    file_sink_write_buffer(sink);
+
+    if (sink->free && sink->buffer) sink->free(sink->buffer, sink->mem_data);
+
+    *sink = (snFileSink){0};
+}
+
+void sn_file_sink_write_batch(const snSinkRecord *records, size_t count, void *data) {
+    snFileSink *sink = data;
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += records[i].len + 1;
+
+    if (sink->used + total <= sink->buffer_size) {
+        char *out = sink->buffer + sink->used;
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(out, records[i].msg, records[i].len);
+            out[records[i].len] = '\n';
+            out += records[i].len + 1;
+        }
+
+        sink->used += total;
+        sink->pending_records += count;
+
+        size_t flush_bytes = sink->flush_bytes ? sink->flush_bytes : sink->buffer_size;
+        if (sink->used >= flush_bytes || (sink->flush_records && sink->pending_records >= sink->flush_records))
+            file_sink_write_buffer(sink);
+
+        return;
+    }
+
+    // Does not fit, write the buffer and the records together without copying them
+    fileIov iov[1 + 2 * FILE_SINK_IOV_RECORDS];
+    int iov_count = 0;
+
+    if (sink->used) iov[iov_count++] = (fileIov){.iov_base = sink->buffer, .iov_len = sink->used};
+
+    for (size_t i = 0; i < count; ++i) {
+        iov[iov_count++] = (fileIov){.iov_base = (void *)records[i].msg, .iov_len = records[i].len};
+        iov[iov_count++] = (fileIov){.iov_base = &newline, .iov_len = 1};
+
+        if (iov_count > 2 * FILE_SINK_IOV_RECORDS - 1 || i + 1 == count) {
+            file_sink_write_iov(sink, iov, iov_count);
+            iov_count = 0;
+        }
+    }
+
+    sink->used = 0;
+    sink->pending_records = 0;
+}
+
+void sn_file_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    snSinkRecord record = {.msg = msg, .len = len, .level = level};
+    sn_file_sink_write_batch(&record, 1, data);
+}
+
+void sn_file_sink_write_raw(snFileSink *sink, const void *data, size_t len) {
+    if (sink->used + len <= sink->buffer_size) {
+        memcpy(sink->buffer + sink->used, data, len);
+        sink->used += len;
+
+        size_t flush_bytes = sink->flush_bytes ? sink->flush_bytes : sink->buffer_size;
+        if (sink->used >= flush_bytes) file_sink_write_buffer(sink);
+
+        return;
+    }
+
+    fileIov iov[2];
+    int iov_count = 0;
+
+    if (sink->used) iov[iov_count++] = (fileIov){.iov_base = sink->buffer, .iov_len = sink->used};
+    iov[iov_count++] = (fileIov){.iov_base = (void *)data, .iov_len = len};
+
+    file_sink_write_iov(sink, iov, iov_count);
+
+    sink->used = 0;
+    sink->pending_records = 0;
+}
+
+void sn_file_sink_flush(void *data) {
+    snFileSink *sink = data;
+
+    file_sink_write_buffer(sink);
+
+    if (!sink->sync) return;
+
+#if defined(SN_OS_WINDOWS)
+    int result = _commit(sink->fd);
+#elif defined(SN_OS_MAC)
+    int result = fsync(sink->fd);
+#else
+    int result = fdatasync(sink->fd);
+#endif
+    sink->syscalls++;
+
+    if (result != 0) sink->errors++;
+}
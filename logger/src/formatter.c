@@ -1,10 +1,1283 @@
-#include "snlogger/formatter.h"
+#include "formatter.h"
 
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+// With SN_LOGGER_LIBC_FORMATTER every conversion goes through the C library
+#if defined(SN_LOGGER_LIBC_FORMATTER)
+    #define FORMAT_FAST 0
+#else
+    #define FORMAT_FAST 1
+#endif
+
+// Longest conversion specification that can be handed to snprintf, including '%'
+#define SPEC_MAX_LEN 32
+
+typedef enum argKind {
+    ARG_NONE,
+    ARG_STAR,
+    ARG_INT,
+    ARG_LONG,
+    ARG_LONG_LONG,
+    ARG_INTMAX,
+    ARG_SIZE,
+    ARG_PTRDIFF,
+    ARG_WINT,
+    ARG_DOUBLE,
+    ARG_LONG_DOUBLE,
+    ARG_POINTER,
+    ARG_STRING,
+    ARG_WIDE_STRING,
+    ARG_COUNT,
+    ARG_UNSUPPORTED,
+} argKind;
+
+typedef enum lengthModifier {
+    LEN_NONE,
+    LEN_HH,
+    LEN_H,
+    LEN_L,
+    LEN_LL,
+    LEN_J,
+    LEN_Z,
+    LEN_T,
+    LEN_BIG_L,
+} lengthModifier;
+
+#define FLAG_MINUS 0x01u
+#define FLAG_PLUS 0x02u
+#define FLAG_SPACE 0x04u
+#define FLAG_HASH 0x08u
+#define FLAG_ZERO 0x10u
+#define FLAG_GROUP 0x20u
+
+typedef struct formatSpec {
+    const char *start; // Points at '%'
+    size_t len; // Length of the specification including '%'
+    unsigned flags;
+    size_t width;
+    bool star_width;
+    bool star_precision;
+    bool has_precision;
+    int precision;
+    lengthModifier length;
+    char conversion;
+    argKind kind;
+} formatSpec;
+
+/**
+ * Parse the conversion specification starting at fmt (pointing at '%').
+ */
+static void parse_spec(const char *fmt, formatSpec *spec) {
+    const char *p = fmt + 1;
+
+    *spec = (formatSpec){.start = fmt, .kind = ARG_NONE};
+
+    for (;; ++p) {
+        if (*p == '-') spec->flags |= FLAG_MINUS;
+        else if (*p == '+') spec->flags |= FLAG_PLUS;
+        else if (*p == ' ') spec->flags |= FLAG_SPACE;
+        else if (*p == '#') spec->flags |= FLAG_HASH;
+        else if (*p == '0') spec->flags |= FLAG_ZERO;
+        else if (*p == '\'') spec->flags |= FLAG_GROUP;
+        else break;
+    }
+
+    if (*p == '*') {
+        spec->star_width = true;
+        ++p;
+    } else {
+        while (*p >= '0' && *p <= '9') {
+            if (spec->width < INT_MAX / 10) spec->width = spec->width * 10 + (size_t)(*p - '0');
+            ++p;
+        }
+    }
+
+    if (*p == '.') {
+        spec->has_precision = true;
+        ++p;
+        if (*p == '*') {
+            spec->star_precision = true;
+            ++p;
+        } else {
+            while (*p >= '0' && *p <= '9') {
+                if (spec->precision < INT_MAX / 10) spec->precision = spec->precision * 10 + (*p - '0');
+                ++p;
+            }
+        }
+    }
+
+    switch (*p) {
+        case 'h': ++p; spec->length = LEN_H; if (*p == 'h') { ++p; spec->length = LEN_HH; } break;
+        case 'l': ++p; spec->length = LEN_L; if (*p == 'l') { ++p; spec->length = LEN_LL; } break;
+        case 'j': ++p; spec->length = LEN_J; break;
+        case 'z': ++p; spec->length = LEN_Z; break;
+        case 't': ++p; spec->length = LEN_T; break;
+        case 'L': ++p; spec->length = LEN_BIG_L; break;
+        default: break;
+    }
+
+    spec->conversion = *p;
+
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'n':
+            switch (spec->length) {
+                case LEN_L: spec->kind = ARG_LONG; break;
+                case LEN_LL: spec->kind = ARG_LONG_LONG; break;
+                case LEN_J: spec->kind = ARG_INTMAX; break;
+                case LEN_Z: spec->kind = ARG_SIZE; break;
+                case LEN_T: spec->kind = ARG_PTRDIFF; break;
+                case LEN_BIG_L: spec->kind = ARG_UNSUPPORTED; break;
+                default: spec->kind = ARG_INT; break;
+            }
+            if (*p == 'n' && spec->kind != ARG_UNSUPPORTED) spec->kind = ARG_COUNT;
+            break;
+        case 'c':
+            spec->kind = spec->length == LEN_L ? ARG_WINT : ARG_INT;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->kind = spec->length == LEN_BIG_L ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+            break;
+        case 's':
+            spec->kind = spec->length == LEN_NONE ? ARG_STRING
+                : spec->length == LEN_L ? ARG_WIDE_STRING : ARG_UNSUPPORTED;
+            break;
+        case 'p':
+            spec->kind = ARG_POINTER;
+            break;
+        case '%':
+            spec->kind = ARG_NONE;
+            break;
+        default:
+            // Unknown conversions
+            spec->kind = ARG_UNSUPPORTED;
+            break;
+    }
+
+    if (*p) ++p;
+    spec->len = (size_t)(p - fmt);
+
+    if (spec->len >= SPEC_MAX_LEN) spec->kind = ARG_UNSUPPORTED;
+}
+
+#define CAPTURE_NULL_STRING UINT32_MAX
+
+typedef struct captureWriter {
+    unsigned char *buffer;
+    size_t size;
+    size_t offset;
+} captureWriter;
+
+static bool capture_put(captureWriter *w, const void *data, size_t size) {
+    if (w->size - w->offset < size) return false;
+    memcpy(w->buffer + w->offset, data, size);
+    w->offset += size;
+    return true;
+}
+
+#define CAPTURE_VALUE(w, T, args) do { \
+        T value_ = va_arg(args, T); \
+        if (!capture_put(w, &value_, sizeof(value_))) return false; \
+    } while (0)
+
+// Bounds of %s arguments in snFormatArgs
+#define BOUND_NONE (-1)
+#define BOUND_STAR (-2)
+
+/**
+ * Capture one argument, bound limits the length of %s strings.
+ */
+static bool capture_arg(captureWriter *w, argKind kind, int bound, va_list *args) {
+    switch (kind) {
+        case ARG_INT:
+        case ARG_STAR: CAPTURE_VALUE(w, int, *args); break;
+        case ARG_LONG: CAPTURE_VALUE(w, long, *args); break;
+        case ARG_LONG_LONG: CAPTURE_VALUE(w, long long, *args); break;
+        case ARG_INTMAX: CAPTURE_VALUE(w, intmax_t, *args); break;
+        case ARG_SIZE: CAPTURE_VALUE(w, size_t, *args); break;
+        case ARG_PTRDIFF: CAPTURE_VALUE(w, ptrdiff_t, *args); break;
+        case ARG_WINT: CAPTURE_VALUE(w, wint_t, *args); break;
+        case ARG_DOUBLE: CAPTURE_VALUE(w, double, *args); break;
+        case ARG_LONG_DOUBLE: CAPTURE_VALUE(w, long double, *args); break;
+        case ARG_POINTER: CAPTURE_VALUE(w, void *, *args); break;
+        case ARG_STRING: {
+            const char *str = va_arg(*args, const char *);
+
+            // NULL is kept as NULL so it is rendered the same way
+            uint32_t str_len = CAPTURE_NULL_STRING;
+            if (str) {
+                size_t l = 0;
+                // Precision bounds the read, the string may not be terminated
+                if (bound >= 0)
+                    while (l < (size_t)bound && str[l]) ++l;
+                else
+                    l = strlen(str);
+
+                if (l > INT_MAX) return false;
+                str_len = (uint32_t)l;
+            }
+
+            if (!capture_put(w, &str_len, sizeof(str_len))) return false;
+            if (str && !capture_put(w, str, str_len)) return false;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Whether the arguments of the conversion can be captured.
+ *
+ * %n needs the destination and %ls the string at format time.
+ */
+static bool spec_capturable(const formatSpec *spec) {
+    return spec->kind != ARG_UNSUPPORTED && spec->kind != ARG_COUNT && spec->kind != ARG_WIDE_STRING;
+}
+
+size_t format_capture(void *restrict buffer, size_t size, const char *restrict fmt, va_list args) {
+    captureWriter w = {.buffer = buffer, .size = size};
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+
+    bool ok = true;
+    for (const char *p = strchr(fmt, '%'); ok && p; p = strchr(p, '%')) {
+        formatSpec spec;
+        parse_spec(p, &spec);
+        p += spec.len;
+
+        if (spec.kind == ARG_NONE) continue;
+
+        if (!spec_capturable(&spec)) {
+            ok = false;
+            break;
+        }
+
+        int bound = spec.has_precision ? spec.precision : BOUND_NONE;
+        if (spec.star_width) ok = capture_arg(&w, ARG_STAR, 0, &args_copy);
+        if (ok && spec.star_precision) {
+            int precision = va_arg(args_copy, int);
+            ok = capture_put(&w, &precision, sizeof(precision));
+            bound = precision;
+        }
+
+        if (ok) ok = capture_arg(&w, spec.kind, bound, &args_copy);
+    }
+
+    va_end(args_copy);
+
+    return ok ? w.offset : FORMAT_CAPTURE_FAILED;
+}
+
+bool format_parse_args(const char *restrict fmt, snFormatArgs *restrict parsed) {
+    parsed->count = 0;
+
+    for (const char *p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+        formatSpec spec;
+        parse_spec(p, &spec);
+        p += spec.len;
+
+        if (spec.kind == ARG_NONE) continue;
+        if (!spec_capturable(&spec)) return false;
+
+        size_t needed = 1 + spec.star_width + spec.star_precision;
+        if (SN_FORMAT_MAX_ARGS - parsed->count < needed) return false;
+
+        if (spec.star_width) {
+            parsed->kinds[parsed->count] = ARG_STAR;
+            parsed->bounds[parsed->count++] = BOUND_NONE;
+        }
+        if (spec.star_precision) {
+            parsed->kinds[parsed->count] = ARG_STAR;
+            parsed->bounds[parsed->count++] = BOUND_NONE;
+        }
+
+        parsed->kinds[parsed->count] = (uint8_t)spec.kind;
+        parsed->bounds[parsed->count++] = spec.star_precision ? BOUND_STAR
+            : spec.has_precision ? spec.precision : BOUND_NONE;
+    }
+
+    return true;
+}
+
+size_t format_capture_args(void *restrict buffer, size_t size, const snFormatArgs *restrict parsed, va_list args) {
+    captureWriter w = {.buffer = buffer, .size = size};
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+
+    bool ok = true;
+    int star = 0;
+    for (uint32_t i = 0; ok && i < parsed->count; ++i) {
+        argKind kind = (argKind)parsed->kinds[i];
+
+        if (kind == ARG_STAR) {
+            star = va_arg(args_copy, int);
+            ok = capture_put(&w, &star, sizeof(star));
+            continue;
+        }
+
+        int bound = parsed->bounds[i] == BOUND_STAR ? star : parsed->bounds[i];
+        ok = capture_arg(&w, kind, bound, &args_copy);
+    }
+
+    va_end(args_copy);
+
+    return ok ? w.offset : FORMAT_CAPTURE_FAILED;
+}
+
+typedef struct captureReader {
+    const unsigned char *args;
+    size_t size;
+    size_t offset;
+} captureReader;
+
+static bool capture_get(captureReader *r, void *data, size_t size) {
+    if (r->size - r->offset < size) return false;
+    memcpy(data, r->args + r->offset, size);
+    r->offset += size;
+    return true;
+}
+
+static bool varint_put(captureWriter *w, uint64_t value) {
+    unsigned char bytes[10];
+    size_t n = 0;
+
+    while (value >= 0x80) {
+        bytes[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[n++] = (unsigned char)value;
+
+    return capture_put(w, bytes, n);
+}
+
+static bool varint_get(captureReader *r, uint64_t *value) {
+    *value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (r->offset == r->size) return false;
+
+        unsigned char byte = r->args[r->offset++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * Read a captured integer of the given kind, sign or zero extended.
+ */
+static bool capture_get_int(captureReader *r, argKind kind, bool is_signed, uint64_t *out) {
+#define GET_INT_(T, UT) do { \
+        T value_; \
+        if (!capture_get(r, &value_, sizeof(value_))) return false; \
+        *out = is_signed ? (uint64_t)(int64_t)value_ : (uint64_t)(UT)value_; \
+    } while (0)
+
+    switch (kind) {
+        case ARG_INT:
+        case ARG_STAR: GET_INT_(int, unsigned int); break;
+        case ARG_LONG: GET_INT_(long, unsigned long); break;
+        case ARG_LONG_LONG: GET_INT_(long long, unsigned long long); break;
+        case ARG_INTMAX: GET_INT_(intmax_t, uintmax_t); break;
+        case ARG_SIZE: GET_INT_(size_t, size_t); break;
+        case ARG_PTRDIFF: GET_INT_(ptrdiff_t, size_t); break;
+        case ARG_WINT: GET_INT_(wint_t, wint_t); break;
+        default: return false;
+    }
+
+#undef GET_INT_
+    return true;
+}
+
+static bool capture_put_int(captureWriter *w, argKind kind, uint64_t value) {
+#define PUT_INT_(T) do { \
+        T value_ = (T)value; \
+        return capture_put(w, &value_, sizeof(value_)); \
+    } while (0)
+
+    switch (kind) {
+        case ARG_INT:
+        case ARG_STAR: PUT_INT_(int);
+        case ARG_LONG: PUT_INT_(long);
+        case ARG_LONG_LONG: PUT_INT_(long long);
+        case ARG_INTMAX: PUT_INT_(intmax_t);
+        case ARG_SIZE: PUT_INT_(size_t);
+        case ARG_PTRDIFF: PUT_INT_(ptrdiff_t);
+        case ARG_WINT: PUT_INT_(wint_t);
+        default: return false;
+    }
+
+#undef PUT_INT_
+}
+
+/**
+ * Convert one captured argument between the native and the encoded layout.
+ *
+ * Integers are zigzag (signed conversions) or plain varints, floating
+ * point values little-endian IEEE doubles, strings a varint of their
+ * length plus one (0 for NULL) followed by the bytes.
+ */
+static bool convert_arg(captureReader *r, captureWriter *w, argKind kind, bool is_signed, bool encode) {
+    switch (kind) {
+        case ARG_DOUBLE:
+        case ARG_LONG_DOUBLE: {
+            double value;
+            uint64_t bits;
+
+            if (encode) {
+                if (kind == ARG_LONG_DOUBLE) {
+                    long double native;
+                    if (!capture_get(r, &native, sizeof(native))) return false;
+                    value = (double)native;
+                } else if (!capture_get(r, &value, sizeof(value))) {
+                    return false;
+                }
+
+                memcpy(&bits, &value, sizeof(bits));
+                unsigned char bytes[8];
+                for (int i = 0; i < 8; ++i) bytes[i] = (unsigned char)(bits >> (8 * i));
+                return capture_put(w, bytes, sizeof(bytes));
+            }
+
+            unsigned char bytes[8];
+            if (!capture_get(r, bytes, sizeof(bytes))) return false;
+            bits = 0;
+            for (int i = 0; i < 8; ++i) bits |= (uint64_t)bytes[i] << (8 * i);
+            memcpy(&value, &bits, sizeof(value));
+
+            if (kind == ARG_LONG_DOUBLE) {
+                long double native = value;
+                return capture_put(w, &native, sizeof(native));
+            }
+            return capture_put(w, &value, sizeof(value));
+        }
+        case ARG_POINTER: {
+            if (encode) {
+                void *value;
+                if (!capture_get(r, &value, sizeof(value))) return false;
+                return varint_put(w, (uint64_t)(uintptr_t)value);
+            }
+
+            uint64_t value;
+            if (!varint_get(r, &value)) return false;
+            void *native = (void *)(uintptr_t)value;
+            return capture_put(w, &native, sizeof(native));
+        }
+        case ARG_STRING: {
+            uint32_t len;
+
+            if (encode) {
+                if (!capture_get(r, &len, sizeof(len))) return false;
+                if (!varint_put(w, len == CAPTURE_NULL_STRING ? 0 : (uint64_t)len + 1)) return false;
+            } else {
+                uint64_t value;
+                if (!varint_get(r, &value) || value > (uint64_t)INT_MAX + 1) return false;
+                len = value ? (uint32_t)(value - 1) : CAPTURE_NULL_STRING;
+                if (!capture_put(w, &len, sizeof(len))) return false;
+            }
+
+            if (len == CAPTURE_NULL_STRING) return true;
+            if (r->size - r->offset < len) return false;
+            bool ok = capture_put(w, r->args + r->offset, len);
+            r->offset += len;
+            return ok;
+        }
+        default: {
+            uint64_t value;
+
+            if (encode) {
+                if (!capture_get_int(r, kind, is_signed, &value)) return false;
+                // Zigzag keeps small negative numbers short
+                if (is_signed) value = (value << 1) ^ (uint64_t)((int64_t)value >> 63);
+                return varint_put(w, value);
+            }
+
+            if (!varint_get(r, &value)) return false;
+            if (is_signed) value = (value >> 1) ^ (0 - (value & 1));
+            return capture_put_int(w, kind, value);
+        }
+    }
+}
+
+static size_t convert_captured(void *restrict out, size_t out_size, const char *restrict fmt,
+        const void *restrict args, size_t args_size, bool encode) {
+    captureReader r = {.args = args, .size = args_size};
+    captureWriter w = {.buffer = out, .size = out_size};
+
+    for (const char *p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+        formatSpec spec;
+        parse_spec(p, &spec);
+        p += spec.len;
+
+        if (spec.kind == ARG_NONE) continue;
+        if (!spec_capturable(&spec)) return FORMAT_CAPTURE_FAILED;
+
+        if (spec.star_width && !convert_arg(&r, &w, ARG_STAR, true, encode)) return FORMAT_CAPTURE_FAILED;
+        if (spec.star_precision && !convert_arg(&r, &w, ARG_STAR, true, encode)) return FORMAT_CAPTURE_FAILED;
+
+        bool is_signed = spec.conversion == 'd' || spec.conversion == 'i';
+        if (!convert_arg(&r, &w, spec.kind, is_signed, encode)) return FORMAT_CAPTURE_FAILED;
+    }
+
+    return r.offset == r.size ? w.offset : FORMAT_CAPTURE_FAILED;
+}
+
+size_t format_encode_captured(void *restrict out, size_t out_size, const char *restrict fmt, const void *restrict args, size_t args_size) {
+    return convert_captured(out, out_size, fmt, args, args_size, true);
+}
+
+size_t format_decode_captured(void *restrict out, size_t out_size, const char *restrict fmt, const void *restrict args, size_t args_size) {
+    return convert_captured(out, out_size, fmt, args, args_size, false);
+}
+
+/**
+ * Arguments are read either from a va_list (va is set) or from arguments
+ * captured by format_capture().
+ */
+typedef struct argSource {
+    va_list *va;
+    captureReader captured;
+} argSource;
+
+#define ARG_GET(src, T, out) ((src)->va \
+        ? (*(out) = va_arg(*(src)->va, T), true) \
+        : capture_get(&(src)->captured, (out), sizeof(T)))
+
+#define ARG_GET_BITS(src, T, bits) do { \
+        T value_; \
+        if (!ARG_GET(src, T, &value_)) return false; \
+        *(bits) = (uint64_t)value_; \
+    } while (0)
+
+/**
+ * Read an integer argument as its two's complement bits.
+ */
+static bool arg_get_integer(argSource *src, argKind kind, uint64_t *bits) {
+    switch (kind) {
+        case ARG_INT: ARG_GET_BITS(src, int, bits); return true;
+        case ARG_LONG: ARG_GET_BITS(src, long, bits); return true;
+        case ARG_LONG_LONG: ARG_GET_BITS(src, long long, bits); return true;
+        case ARG_INTMAX: ARG_GET_BITS(src, intmax_t, bits); return true;
+        case ARG_SIZE: ARG_GET_BITS(src, size_t, bits); return true;
+        case ARG_PTRDIFF: ARG_GET_BITS(src, ptrdiff_t, bits); return true;
+        default: return false;
+    }
+}
+
+/**
+ * Width in bits of the integer type of the conversion.
+ */
+static unsigned integer_bits(const formatSpec *spec) {
+    switch (spec->kind) {
+        case ARG_INT:
+            if (spec->length == LEN_HH) return CHAR_BIT;
+            if (spec->length == LEN_H) return sizeof(short) * CHAR_BIT;
+            return sizeof(int) * CHAR_BIT;
+        case ARG_LONG: return sizeof(long) * CHAR_BIT;
+        case ARG_LONG_LONG: return sizeof(long long) * CHAR_BIT;
+        case ARG_INTMAX: return sizeof(intmax_t) * CHAR_BIT;
+        case ARG_SIZE: return sizeof(size_t) * CHAR_BIT;
+        case ARG_PTRDIFF: return sizeof(ptrdiff_t) * CHAR_BIT;
+        default: return 64;
+    }
+}
+
+typedef struct renderWriter {
+    char *buffer;
+    size_t len;
+    size_t offset; // Total length, may exceed len
+} renderWriter;
+
+static void render_put(renderWriter *w, const char *data, size_t size) {
+    if (w->offset < w->len) {
+        size_t room = w->len - w->offset;
+        memcpy(w->buffer + w->offset, data, size < room ? size : room);
+    }
+    w->offset += size;
+}
+
+static void render_fill(renderWriter *w, char c, size_t count) {
+    if (!count) return;
+
+    if (w->offset < w->len) {
+        size_t room = w->len - w->offset;
+        memset(w->buffer + w->offset, c, count < room ? count : room);
+    }
+    w->offset += count;
+}
+
+/**
+ * Write prefix, zeros and body padded to the field width.
+ *
+ * With zero_pad the padding goes between prefix and body as zeros.
+ */
+static void render_padded(renderWriter *w, const formatSpec *spec, const char *prefix, size_t prefix_len,
+        size_t zeros, const char *body, size_t body_len, bool zero_pad) {
+    size_t total = prefix_len + zeros + body_len;
+    size_t pad = spec->width > total ? spec->width - total : 0;
+
+    if (zero_pad) {
+        zeros += pad;
+        pad = 0;
+    }
+
+    if (!(spec->flags & FLAG_MINUS)) render_fill(w, ' ', pad);
+    if (prefix_len) render_put(w, prefix, prefix_len);
+    render_fill(w, '0', zeros);
+    render_put(w, body, body_len);
+    if (spec->flags & FLAG_MINUS) render_fill(w, ' ', pad);
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint64_t pow10_table[] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull,
+};
+
+// Highest precision of %f and %g that is converted without the C library
+#define FLOAT_MAX_PRECISION 17
+
+/**
+ * Write the decimal digits of value ending at end, two at a time.
+ *
+ * Returns the number of digits.
+ */
+static size_t u64_to_dec(uint64_t value, char *end) {
+    char *p = end;
+
+    while (value >= 100) {
+        size_t pair = (size_t)(value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        memcpy(p, &digit_pairs[pair], 2);
+    }
+
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[value * 2], 2);
+    } else {
+        *--p = (char)('0' + value);
+    }
+
+    return (size_t)(end - p);
+}
+
+static size_t u64_digit_count(uint64_t value) {
+    size_t count = 1;
+    while (count < SN_ARRAY_LENGTH(pow10_table) && value >= pow10_table[count]) ++count;
+    return count;
+}
+
+static void render_integer(renderWriter *w, const formatSpec *spec, uint64_t bits) {
+    unsigned width = integer_bits(spec);
+    uint64_t mask = width >= 64 ? UINT64_MAX : (1ull << width) - 1;
+    uint64_t value = bits & mask;
+
+    char prefix[2];
+    size_t prefix_len = 0;
+
+    if (spec->conversion == 'd' || spec->conversion == 'i') {
+        bool negative = (value >> (width - 1)) & 1;
+        if (negative) value = (~value + 1) & mask;
+
+        if (negative) prefix[prefix_len++] = '-';
+        else if (spec->flags & FLAG_PLUS) prefix[prefix_len++] = '+';
+        else if (spec->flags & FLAG_SPACE) prefix[prefix_len++] = ' ';
+    }
+
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+
+    switch (spec->conversion) {
+        case 'x':
+        case 'X': {
+            const char *hex = spec->conversion == 'x' ? "0123456789abcdef" : "0123456789ABCDEF";
+            uint64_t v = value;
+            do {
+                *--p = hex[v & 0xf];
+                v >>= 4;
+            } while (v);
+
+            if ((spec->flags & FLAG_HASH) && value) {
+                prefix[prefix_len++] = '0';
+                prefix[prefix_len++] = spec->conversion;
+            }
+            break;
+        }
+        case 'o': {
+            uint64_t v = value;
+            do {
+                *--p = (char)('0' + (v & 0x7));
+                v >>= 3;
+            } while (v);
+            break;
+        }
+        default:
+            p -= u64_to_dec(value, end);
+            break;
+    }
+
+    // Zero with precision 0 has no digits
+    if (spec->has_precision && spec->precision == 0 && value == 0) p = end;
+
+    size_t count = (size_t)(end - p);
+    size_t zeros = spec->has_precision && (size_t)spec->precision > count ? (size_t)spec->precision - count : 0;
+
+    // Alternative form of octal always starts with 0
+    if (spec->conversion == 'o' && (spec->flags & FLAG_HASH) && zeros == 0 && (count == 0 || *p != '0'))
+        zeros = 1;
+
+    bool zero_pad = (spec->flags & FLAG_ZERO) && !(spec->flags & FLAG_MINUS) && !spec->has_precision;
+
+    render_padded(w, spec, prefix, prefix_len, zeros, p, count, zero_pad);
+}
+
+typedef struct u128 {
+    uint64_t hi;
+    uint64_t lo;
+} u128;
+
+static u128 u128_mul(uint64_t a, uint64_t b) {
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+
+    uint64_t p0 = a_lo * b_lo;
+    uint64_t p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo;
+    uint64_t p3 = a_hi * b_hi;
+
+    uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+
+    return (u128){
+        .hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32),
+        .lo = (mid << 32) | (uint32_t)p0,
+    };
+}
+
+// Low 64 bits of x >> shift, shift in [1, 127]
+static uint64_t u128_shr(u128 x, unsigned shift) {
+    if (shift >= 64) return x.hi >> (shift - 64);
+    return (x.hi << (64 - shift)) | (x.lo >> shift);
+}
+
+static bool u128_bit(u128 x, unsigned bit) {
+    return bit < 64 ? (x.lo >> bit) & 1 : (x.hi >> (bit - 64)) & 1;
+}
+
+// Whether any bit below the given one is set
+static bool u128_any_below(u128 x, unsigned bit) {
+    if (bit == 0) return false;
+    if (bit < 64) return (x.lo & ((1ull << bit) - 1)) != 0;
+    if (bit == 64) return x.lo != 0;
+    return x.lo != 0 || (x.hi & ((1ull << (bit - 64)) - 1)) != 0;
+}
+
+/**
+ * Split the bits of a non-negative finite double into integer part and
+ * fraction, the value is ipart + frac / 2^shift exactly.
+ *
+ * Fails if the integer part does not fit in 63 bits.
+ */
+static bool double_split(uint64_t bits, uint64_t *ipart, uint64_t *frac, unsigned *shift) {
+    unsigned exponent = (unsigned)(bits >> 52) & 0x7ff;
+    uint64_t mantissa = bits & ((1ull << 52) - 1);
+    int e2;
+
+    if (exponent == 0) {
+        e2 = -1074;
+    } else {
+        mantissa |= 1ull << 52;
+        e2 = (int)exponent - 1075;
+    }
+
+    if (e2 >= 0) {
+        if (e2 > 10 || (mantissa >> (63 - e2)) != 0) return false;
+        *ipart = mantissa << e2;
+        *frac = 0;
+        *shift = 0;
+        return true;
+    }
+
+    unsigned s = (unsigned)-e2;
+    if (s >= 64) {
+        *ipart = 0;
+        *frac = mantissa;
+    } else {
+        *ipart = mantissa >> s;
+        *frac = mantissa & ((1ull << s) - 1);
+    }
+    *shift = s;
+
+    return true;
+}
+
+/**
+ * Round the bits of a non-negative finite double to precision fractional
+ * digits.
+ *
+ * The result is exact, ties are rounded to even like the C library does in
+ * the default rounding mode.
+ */
+static bool double_fixed(uint64_t bits, int precision, uint64_t *ipart, uint64_t *fpart) {
+    uint64_t ip, frac;
+    unsigned shift;
+
+    if (precision > FLOAT_MAX_PRECISION || !double_split(bits, &ip, &frac, &shift)) return false;
+
+    uint64_t scale = pow10_table[precision];
+    uint64_t q = 0;
+    bool round_up = false;
+
+    // frac * scale < 2^110, with a larger shift the fraction is below one half
+    if (frac && shift <= 111) {
+        u128 scaled = u128_mul(frac, scale);
+        q = u128_shr(scaled, shift);
+
+        bool half = u128_bit(scaled, shift - 1);
+        bool odd = ((precision ? q : ip) & 1) != 0;
+        round_up = half && (odd || u128_any_below(scaled, shift - 1));
+    }
+
+    if (round_up && ++q == scale) {
+        q = 0;
+        ++ip;
+    }
+
+    *ipart = ip;
+    *fpart = q;
+    return true;
+}
+
+/**
+ * Decimal exponent of the bits of a non-negative finite double before
+ * rounding, fails for values too large or too small for double_fixed().
+ */
+static bool double_exponent(uint64_t bits, int *exponent) {
+    uint64_t ip, frac;
+    unsigned shift;
+
+    if (!bits) {
+        *exponent = 0;
+        return true;
+    }
+
+    if (!double_split(bits, &ip, &frac, &shift)) return false;
+
+    if (ip) {
+        *exponent = (int)u64_digit_count(ip) - 1;
+        return true;
+    }
+
+    if (shift > 111) return false;
+
+    // Truncated, rounding could move the exponent up
+    uint64_t q = u128_shr(u128_mul(frac, pow10_table[FLOAT_MAX_PRECISION]), shift);
+    if (!q) return false;
+
+    *exponent = (int)u64_digit_count(q) - (FLOAT_MAX_PRECISION + 1);
+    return true;
+}
+
+/**
+ * Format %f, %F, %g and %G.
+ *
+ * Returns false for values and precisions outside of the exact fast path
+ * and for the exponent style of %g, those go through the C library.
+ */
+static bool render_double(renderWriter *w, const formatSpec *spec, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    bool negative = (bits >> 63) != 0;
+    bits &= ~(1ull << 63);
+
+    char prefix[1];
+    size_t prefix_len = 0;
+    if (negative) prefix[prefix_len++] = '-';
+    else if (spec->flags & FLAG_PLUS) prefix[prefix_len++] = '+';
+    else if (spec->flags & FLAG_SPACE) prefix[prefix_len++] = ' ';
+
+    bool upper = spec->conversion == 'F' || spec->conversion == 'G';
+
+    // Infinity and NaN are never padded with zeros
+    if (((bits >> 52) & 0x7ff) == 0x7ff) {
+        const char *body = (bits & ((1ull << 52) - 1)) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+        render_padded(w, spec, prefix, prefix_len, 0, body, 3, false);
+        return true;
+    }
+
+    bool general = spec->conversion == 'g' || spec->conversion == 'G';
+    int precision = spec->has_precision ? spec->precision : 6;
+    uint64_t ipart, fpart;
+
+    if (general) {
+        int significant = precision == 0 ? 1 : precision;
+        int exponent;
+
+        if (significant > FLOAT_MAX_PRECISION || !double_exponent(bits, &exponent)) return false;
+        if (exponent >= significant || exponent < -5) return false;
+
+        precision = significant - 1 - exponent;
+        if (!double_fixed(bits, precision, &ipart, &fpart)) return false;
+
+        // Rounding carried into a new digit
+        if (ipart * pow10_table[precision] + fpart >= pow10_table[significant]) {
+            if (++exponent >= significant) return false;
+            precision = significant - 1 - exponent;
+            if (!double_fixed(bits, precision, &ipart, &fpart)) return false;
+        }
+
+        if (exponent < -4) return false;
+    } else if (!double_fixed(bits, precision, &ipart, &fpart)) {
+        return false;
+    }
+
+    size_t frac_digits = (size_t)precision;
+    if (general && !(spec->flags & FLAG_HASH)) {
+        while (frac_digits && fpart % 10 == 0) {
+            fpart /= 10;
+            --frac_digits;
+        }
+    }
+
+    char body[24 + 1 + FLOAT_MAX_PRECISION];
+    char *int_end = body + 24;
+    size_t int_digits = u64_to_dec(ipart, int_end);
+    char *start = int_end - int_digits;
+    char *end = int_end;
+
+    if (frac_digits || (spec->flags & FLAG_HASH)) *end++ = '.';
+
+    if (frac_digits) {
+        size_t written = u64_to_dec(fpart, end + frac_digits);
+        memset(end, '0', frac_digits - written);
+        end += frac_digits;
+    }
+
+    bool zero_pad = (spec->flags & FLAG_ZERO) && !(spec->flags & FLAG_MINUS);
+    render_padded(w, spec, prefix, prefix_len, 0, start, (size_t)(end - start), zero_pad);
+
+    return true;
+}
+
+// Format a single specification with its value through snprintf
+#define RENDER_VALUE(w, spec, stars, star_count, value) do { \
+        char spec_str_[SPEC_MAX_LEN + 2]; \
+        memcpy(spec_str_, (spec)->start, (spec)->len); \
+        spec_str_[(spec)->len] = 0; \
+        char *out_ = (w)->offset < (w)->len ? (w)->buffer + (w)->offset : NULL; \
+        size_t room_ = out_ ? (w)->len - (w)->offset : 0; \
+        int n_ = (star_count) == 0 ? snprintf(out_, room_, spec_str_, value) \
+            : (star_count) == 1 ? snprintf(out_, room_, spec_str_, stars[0], value) \
+            : snprintf(out_, room_, spec_str_, stars[0], stars[1], value); \
+        if (n_ > 0) (w)->offset += (size_t)n_; \
+    } while (0)
+
+#define RENDER_ARG(w, src, T, spec, stars, star_count) do { \
+        T value_; \
+        if (!ARG_GET(src, T, &value_)) return false; \
+        RENDER_VALUE(w, spec, stars, star_count, value_); \
+    } while (0)
+
+/**
+ * Format a string of known length through snprintf, the string does not
+ * need to be terminated.
+ */
+static void render_string_libc(renderWriter *w, const formatSpec *spec, const int *stars,
+        const char *str, size_t len) {
+    int bounded = (int)len;
+    if (spec->has_precision && spec->precision < bounded) bounded = spec->precision;
+
+    // Rewrite the precision as '*' so the length can be passed in
+    formatSpec str_spec = *spec;
+    char str_spec_str[SPEC_MAX_LEN + 2];
+    size_t width_end = spec->len - 1;
+    for (size_t i = 1; i < spec->len - 1; ++i) {
+        if (spec->start[i] == '.') {
+            width_end = i;
+            break;
+        }
+    }
+    memcpy(str_spec_str, spec->start, width_end);
+    memcpy(str_spec_str + width_end, ".*s", 3);
+    str_spec.start = str_spec_str;
+    str_spec.len = width_end + 3;
+
+    int str_stars[2];
+    int str_star_count = 0;
+    if (spec->star_width) str_stars[str_star_count++] = stars[0];
+    str_stars[str_star_count++] = bounded;
+
+    RENDER_VALUE(w, &str_spec, str_stars, str_star_count, str);
+}
+
+static bool render_string(renderWriter *w, const formatSpec *spec, argSource *src, const int *stars, int star_count) {
+    const char *str;
+    size_t len = 0;
+
+    if (src->va) {
+        str = va_arg(*src->va, const char *);
+        if (str) {
+            // Precision bounds the read, the string may not be terminated
+            size_t max = spec->has_precision ? (size_t)spec->precision : SIZE_MAX;
+            while (len < max && str[len]) ++len;
+        }
+    } else {
+        uint32_t str_len;
+        if (!capture_get(&src->captured, &str_len, sizeof(str_len))) return false;
+
+        if (str_len == CAPTURE_NULL_STRING) {
+            str = NULL;
+        } else {
+            captureReader *r = &src->captured;
+            if (r->size - r->offset < str_len) return false;
+            str = (const char *)r->args + r->offset;
+            r->offset += str_len;
+            len = str_len;
+        }
+    }
+
+    if (!FORMAT_FAST) {
+        if (str) render_string_libc(w, spec, stars, str, len);
+        else RENDER_VALUE(w, spec, stars, star_count, str);
+        return true;
+    }
+
+    if (!str) {
+#if defined(__GLIBC__)
+        // glibc prints nothing when the precision is too short for "(null)"
+        str = spec->has_precision && spec->precision < 6 ? "" : "(null)";
+        len = strlen(str);
+#else
+        RENDER_VALUE(w, spec, stars, star_count, str);
+        return true;
+#endif
+    }
+
+    if (spec->has_precision && (size_t)spec->precision < len) len = (size_t)spec->precision;
+    render_padded(w, spec, NULL, 0, 0, str, len, false);
+
+    return true;
+}
+
+static bool render_pointer(renderWriter *w, const formatSpec *spec, argSource *src, const int *stars, int star_count) {
+    void *value;
+    if (!ARG_GET(src, void *, &value)) return false;
+
+    // The style of %p is implementation defined, only glibc is mimicked
+#if defined(__GLIBC__)
+    if (FORMAT_FAST && !(spec->flags & ~FLAG_MINUS) && !spec->has_precision) {
+        if (!value) {
+            render_padded(w, spec, NULL, 0, 0, "(nil)", 5, false);
+            return true;
+        }
+
+        char digits[2 * sizeof(uintptr_t)];
+        char *end = digits + sizeof(digits);
+        char *p = end;
+        uintptr_t v = (uintptr_t)value;
+        do {
+            *--p = "0123456789abcdef"[v & 0xf];
+            v >>= 4;
+        } while (v);
+
+        render_padded(w, spec, "0x", 2, 0, p, (size_t)(end - p), false);
+        return true;
+    }
+#endif
+
+    RENDER_VALUE(w, spec, stars, star_count, value);
+    return true;
+}
+
+/**
+ * Store the number of characters so far for %n.
+ */
+static bool render_count(renderWriter *w, const formatSpec *spec, argSource *src) {
+    // Never captured
+    if (!src->va) return false;
+
+    void *ptr = va_arg(*src->va, void *);
+    if (!ptr) return true;
+
+    switch (spec->length) {
+        case LEN_HH: *(signed char *)ptr = (signed char)w->offset; break;
+        case LEN_H: *(short *)ptr = (short)w->offset; break;
+        case LEN_L: *(long *)ptr = (long)w->offset; break;
+        case LEN_LL: *(long long *)ptr = (long long)w->offset; break;
+        case LEN_J: *(intmax_t *)ptr = (intmax_t)w->offset; break;
+        case LEN_Z: *(size_t *)ptr = w->offset; break;
+        case LEN_T: *(ptrdiff_t *)ptr = (ptrdiff_t)w->offset; break;
+        default: *(int *)ptr = (int)w->offset; break;
+    }
+
+    return true;
+}
+
+/**
+ * Format one conversion, returns false when the arguments ran out.
+ *
+ * Conversions the engine does not handle itself are passed with their
+ * value to snprintf.
+ */
+static bool render_spec(renderWriter *w, const formatSpec *spec, argSource *src, const int *stars, int star_count) {
+    // Grouping depends on the locale
+    bool fast = FORMAT_FAST && !(spec->flags & FLAG_GROUP);
+
+    switch (spec->kind) {
+        case ARG_INT:
+        case ARG_LONG:
+        case ARG_LONG_LONG:
+        case ARG_INTMAX:
+        case ARG_SIZE:
+        case ARG_PTRDIFF: {
+            uint64_t bits;
+            if (!arg_get_integer(src, spec->kind, &bits)) return false;
+
+            if (spec->conversion == 'c') {
+                char c = (char)bits;
+                if (fast) render_padded(w, spec, NULL, 0, 0, &c, 1, false);
+                else RENDER_VALUE(w, spec, stars, star_count, (int)bits);
+            } else if (fast) {
+                render_integer(w, spec, bits);
+            } else {
+                switch (spec->kind) {
+                    case ARG_INT: RENDER_VALUE(w, spec, stars, star_count, (int)bits); break;
+                    case ARG_LONG: RENDER_VALUE(w, spec, stars, star_count, (long)bits); break;
+                    case ARG_LONG_LONG: RENDER_VALUE(w, spec, stars, star_count, (long long)bits); break;
+                    case ARG_INTMAX: RENDER_VALUE(w, spec, stars, star_count, (intmax_t)bits); break;
+                    case ARG_SIZE: RENDER_VALUE(w, spec, stars, star_count, (size_t)bits); break;
+                    default: RENDER_VALUE(w, spec, stars, star_count, (ptrdiff_t)bits); break;
+                }
+            }
+            return true;
+        }
+        case ARG_DOUBLE: {
+            double value;
+            if (!ARG_GET(src, double, &value)) return false;
+
+            bool supported = spec->conversion == 'f' || spec->conversion == 'F'
+                || spec->conversion == 'g' || spec->conversion == 'G';
+            if (!(fast && supported && render_double(w, spec, value)))
+                RENDER_VALUE(w, spec, stars, star_count, value);
+            return true;
+        }
+        case ARG_POINTER: return render_pointer(w, spec, src, stars, star_count);
+        case ARG_STRING: return render_string(w, spec, src, stars, star_count);
+        case ARG_WINT: RENDER_ARG(w, src, wint_t, spec, stars, star_count); return true;
+        case ARG_LONG_DOUBLE: RENDER_ARG(w, src, long double, spec, stars, star_count); return true;
+        case ARG_WIDE_STRING:
+            // Never captured
+            if (!src->va) return false;
+            RENDER_ARG(w, src, const wchar_t *, spec, stars, star_count);
+            return true;
+        case ARG_COUNT: return render_count(w, spec, src);
+        default: return true;
+    }
+}
+
+static size_t format_args(char *restrict buffer, size_t len, const char *restrict fmt, argSource *src) {
+    renderWriter w = {.buffer = buffer, .len = len};
+
+    const char *p = fmt;
+    while (*p) {
+        // Literal runs between conversions are short, a plain loop beats strchr
+        const char *percent = p;
+        while (*percent && *percent != '%') ++percent;
+        if (percent != p) render_put(&w, p, (size_t)(percent - p));
+        if (!*percent) break;
+
+        formatSpec spec;
+        parse_spec(percent, &spec);
+        p = percent + spec.len;
+
+        if (spec.kind == ARG_NONE) {
+            render_put(&w, "%", 1);
+            continue;
+        }
+
+        // Unknown conversions are printed as they are
+        if (spec.kind == ARG_UNSUPPORTED) {
+            render_put(&w, spec.start, spec.len);
+            continue;
+        }
+
+        int stars[2];
+        int star_count = 0;
+
+        if (spec.star_width) {
+            int width;
+            if (!ARG_GET(src, int, &width)) break;
+            stars[star_count++] = width;
+
+            // Negative width is taken as a '-' flag
+            if (width < 0) {
+                spec.flags |= FLAG_MINUS;
+                spec.width = (size_t)-(long long)width;
+            } else {
+                spec.width = (size_t)width;
+            }
+        }
+
+        if (spec.star_precision) {
+            int precision;
+            if (!ARG_GET(src, int, &precision)) break;
+            stars[star_count++] = precision;
+
+            // Negative precision is taken as if it was omitted
+            spec.has_precision = precision >= 0;
+            spec.precision = precision >= 0 ? precision : 0;
+        }
+
+        if (!render_spec(&w, &spec, src, stars, star_count)) break;
+    }
+
+    if (len) buffer[w.offset < len ? w.offset : len - 1] = 0;
+
+    return w.offset;
+}
 
 size_t format_string(char *restrict buffer, size_t len, const char *restrict fmt, va_list args) {
-    // for now vsnprintf
+#if defined(SN_LOGGER_LIBC_FORMATTER)
     int l = vsnprintf(buffer, len, fmt, args);
     if (l < 0) l = 0;
     return (size_t)l;
+#else
+    // Copied so it can be passed around by address on every ABI
+    va_list args_copy;
+    va_copy(args_copy, args);
+
+    argSource src = {.va = &args_copy};
+    size_t l = format_args(buffer, len, fmt, &src);
+
+    va_end(args_copy);
+    return l;
+#endif
+}
+
+size_t format_captured(char *restrict buffer, size_t len, const char *restrict fmt, const void *restrict args, size_t args_size) {
+    argSource src = {.captured = {.args = args, .size = args_size}};
+    return format_args(buffer, len, fmt, &src);
 }
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "snlogger/formatter.h"
+
+#include <stdarg.h>
+
+/**
+ * Format fmt with args into buffer like vsnprintf().
+ *
+ * Integers, %c, %s, %p, %f and the fixed style of %g are converted by the
+ * library itself without locale lookups, everything else (%e, %a, long
+ * double, wide characters, digits beyond 17 decimals) is handed to the C
+ * library one conversion at a time. Building with
+ * SN_LOGGER_LIBC_FORMATTER uses vsnprintf() for everything.
+ *
+ * Returns the length of the full message and writes at most len bytes
+ * including the null character.
+ */
+size_t format_string(char *restrict buffer, size_t len, const char *restrict fmt, va_list args);
+
+#define FORMAT_CAPTURE_FAILED ((size_t)-1)
+
+/**
+ * Capture the arguments of fmt into buffer so the message can be formatted
+ * later with format_captured().
+ *
+ * Integers, floating point values and pointers are stored by value and
+ * %s strings are copied. The format string itself is not copied.
+ *
+ * Returns the number of bytes written, or FORMAT_CAPTURE_FAILED if fmt
+ * contains a conversion that cannot be captured (like %n) or the arguments
+ * do not fit.
+ */
+size_t format_capture(void *restrict buffer, size_t size, const char *restrict fmt, va_list args);
+
+/**
+ * Parse the argument list of fmt for format_capture_args().
+ *
+ * Returns false if fmt contains a conversion that cannot be captured or
+ * takes more than SN_FORMAT_MAX_ARGS arguments.
+ */
+bool format_parse_args(const char *restrict fmt, snFormatArgs *restrict parsed);
+
+/**
+ * Same as format_capture() with the argument list parsed beforehand.
+ */
+size_t format_capture_args(void *restrict buffer, size_t size, const snFormatArgs *restrict parsed, va_list args);
+
+/**
+ * Format fmt with arguments captured by format_capture().
+ *
+ * Behaves like format_string(): returns the length of the full message and
+ * writes at most len bytes including the null character.
+ */
+size_t format_captured(char *restrict buffer, size_t len, const char *restrict fmt, const void *restrict args, size_t args_size);
+
+/**
+ * Encode arguments captured by format_capture() for storage.
+ *
+ * The encoding does not depend on the host: integers and pointers become
+ * varints, floating point values little-endian doubles (long double loses
+ * its extra precision), strings a varint length and their bytes.
+ *
+ * Returns the number of bytes written, or FORMAT_CAPTURE_FAILED if the
+ * arguments do not match fmt or do not fit.
+ */
+size_t format_encode_captured(void *restrict out, size_t out_size, const char *restrict fmt, const void *restrict args, size_t args_size);
+
+/**
+ * Decode arguments encoded by format_encode_captured() back into the
+ * layout of format_capture(), ready for format_captured().
+ *
+ * Returns the number of bytes written, or FORMAT_CAPTURE_FAILED if the
+ * arguments do not match fmt or do not fit.
+ */
+size_t format_decode_captured(void *restrict out, size_t out_size, const char *restrict fmt, const void *restrict args, size_t args_size);
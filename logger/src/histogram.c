@@ -0,0 +1,100 @@
+#include "snlogger/histogram.h"
+
+#include "snlogger/atomic.h"
+
+#if defined(SN_COMPILER_MSVC)
+    #include <intrin.h>
+#endif
+
+// Index of the highest set bit, value must not be 0
+static unsigned histogram_log2(uint64_t value) {
+#if defined(SN_COMPILER_MSVC)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (unsigned)index;
+#else
+    return 63u - (unsigned)__builtin_clzll(value);
+#endif
+}
+
+static size_t histogram_index(uint64_t value) {
+    if (value < SN_HISTOGRAM_SUB_BUCKETS) return (size_t)value;
+
+    // value >> shift keeps the SN_HISTOGRAM_SUB_BITS bits below the top one
+    unsigned shift = histogram_log2(value) - SN_HISTOGRAM_SUB_BITS;
+    return (size_t)(shift + 1) * SN_HISTOGRAM_SUB_BUCKETS + (size_t)((value >> shift) - SN_HISTOGRAM_SUB_BUCKETS);
+}
+
+uint64_t sn_histogram_bucket_upper(size_t index) {
+    if (index < SN_HISTOGRAM_SUB_BUCKETS) return index;
+
+    unsigned shift = (unsigned)(index / SN_HISTOGRAM_SUB_BUCKETS) - 1;
+    uint64_t sub = index % SN_HISTOGRAM_SUB_BUCKETS + SN_HISTOGRAM_SUB_BUCKETS;
+
+    // The top bucket ends at UINT64_MAX, which would overflow
+    if (sub + 1 == 2 * SN_HISTOGRAM_SUB_BUCKETS && shift == 64 - SN_HISTOGRAM_SUB_BITS - 1) return UINT64_MAX;
+
+    return ((sub + 1) << shift) - 1;
+}
+
+void sn_histogram_init(snHistogram *histogram) {
+    *histogram = (snHistogram){.min = UINT64_MAX};
+}
+
+void sn_histogram_record(snHistogram *histogram, uint64_t value) {
+    sn_atomic_fetch_add_relaxed(&histogram->counts[histogram_index(value)], 1);
+    sn_atomic_fetch_add_relaxed(&histogram->count, 1);
+    sn_atomic_fetch_add_relaxed(&histogram->sum, value);
+
+    uint64_t min = sn_atomic_load_relaxed(&histogram->min);
+    while (value < min && !sn_atomic_cas(&histogram->min, &min, value));
+
+    uint64_t max = sn_atomic_load_relaxed(&histogram->max);
+    while (value > max && !sn_atomic_cas(&histogram->max, &max, value));
+}
+
+void sn_histogram_snapshot(snHistogram *histogram, snHistogram *out, bool reset) {
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < SN_HISTOGRAM_BUCKETS; ++i) {
+        out->counts[i] = reset
+            ? sn_atomic_exchange_relaxed(&histogram->counts[i], 0)
+            : sn_atomic_load_relaxed(&histogram->counts[i]);
+        count += out->counts[i];
+    }
+
+    // Values recorded during the copy may be missing from the buckets,
+    // the count always matches them
+    out->count = count;
+
+    if (reset) {
+        sn_atomic_exchange_relaxed(&histogram->count, 0);
+        out->sum = sn_atomic_exchange_relaxed(&histogram->sum, 0);
+        out->min = sn_atomic_exchange_relaxed(&histogram->min, UINT64_MAX);
+        out->max = sn_atomic_exchange_relaxed(&histogram->max, 0);
+    } else {
+        out->sum = sn_atomic_load_relaxed(&histogram->sum);
+        out->min = sn_atomic_load_relaxed(&histogram->min);
+        out->max = sn_atomic_load_relaxed(&histogram->max);
+    }
+}
+
+uint64_t sn_histogram_percentile(const snHistogram *histogram, double percentile) {
+    if (!histogram->count) return 0;
+
+    if (percentile < 0.0) percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+
+    // Rank of the value, counted from 1
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > histogram->count) rank = histogram->count;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < SN_HISTOGRAM_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) return SN_MIN(sn_histogram_bucket_upper(i), histogram->max);
+    }
+
+    return histogram->max;
+}
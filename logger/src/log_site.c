@@ -0,0 +1,88 @@
+#include "snlogger/log_site.h"
+
+#include "formatter.h"
+
+#include <string.h>
+
+// Registered sites as an snLogSiteState pointer, new sites are pushed to
+// the front. Kept as an integer for the atomic helpers.
+static uintptr_t site_list;
+
+uint32_t sn_log_site_register(const snLogSite *site) {
+    snLogSiteState *state = site->state;
+
+    // Only the first thread to get here links the site
+    uint32_t flags = 0;
+    if (!sn_atomic_cas(&state->flags, &flags, SN_LOG_SITE_REGISTERED)) return flags;
+
+    state->site = site;
+
+    uintptr_t head = (uintptr_t)sn_atomic_load_relaxed(&site_list);
+    do {
+        state->next = (snLogSiteState *)head;
+    } while (!sn_atomic_cas(&site_list, &head, (uintptr_t)state));
+
+    return SN_LOG_SITE_REGISTERED;
+}
+
+void sn_log_site_set_mode(const snLogSite *site, snLogSiteMode mode) {
+    uint32_t mode_flags = mode == SN_LOG_SITE_ENABLED ? SN_LOG_SITE_FORCE_ON
+        : mode == SN_LOG_SITE_DISABLED ? SN_LOG_SITE_FORCE_OFF : 0;
+
+    uint32_t flags = (uint32_t)sn_atomic_load_relaxed(&site->state->flags);
+    while (!sn_atomic_cas(&site->state->flags, &flags,
+                (flags & ~(SN_LOG_SITE_FORCE_ON | SN_LOG_SITE_FORCE_OFF)) | mode_flags));
+}
+
+snLogSiteMode sn_log_site_get_mode(const snLogSite *site) {
+    uint32_t flags = (uint32_t)sn_atomic_load_relaxed(&site->state->flags);
+
+    if (flags & SN_LOG_SITE_FORCE_ON) return SN_LOG_SITE_ENABLED;
+    if (flags & SN_LOG_SITE_FORCE_OFF) return SN_LOG_SITE_DISABLED;
+    return SN_LOG_SITE_DEFAULT;
+}
+
+const snLogSite *sn_log_site_next(const snLogSite *site) {
+    snLogSiteState *state = site ? site->state->next
+        : (snLogSiteState *)(uintptr_t)sn_atomic_load_acquire(&site_list);
+    return state ? state->site : NULL;
+}
+
+static bool ends_with(const char *str, const char *suffix) {
+    size_t str_len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return str_len >= suffix_len && memcmp(str + str_len - suffix_len, suffix, suffix_len) == 0;
+}
+
+size_t sn_log_sites_set_mode(const char *file, uint32_t line, const char *function, snLogSiteMode mode) {
+    size_t count = 0;
+
+    for (const snLogSite *site = sn_log_site_next(NULL); site; site = sn_log_site_next(site)) {
+        if (file && !ends_with(site->file, file)) continue;
+        if (line && site->line != line) continue;
+        if (function && strcmp(site->function, function) != 0) continue;
+
+        sn_log_site_set_mode(site, mode);
+        ++count;
+    }
+
+    return count;
+}
+
+const snFormatArgs *sn_log_site_args(const snLogSite *site) {
+    snLogSiteState *state = site->state;
+
+    uint32_t args_state = sn_atomic_load_acquire(&state->args_state);
+    if (args_state == SN_LOG_SITE_ARGS_READY) return &state->args;
+    if (args_state != SN_LOG_SITE_ARGS_UNPARSED) return NULL;
+
+    // Only one thread parses, the others capture by scanning the format meanwhile
+    uint32_t expected = SN_LOG_SITE_ARGS_UNPARSED;
+    if (!sn_atomic_cas(&state->args_state, &expected, SN_LOG_SITE_ARGS_PARSING)) return NULL;
+
+    bool ok = format_parse_args(site->fmt, &state->args);
+    sn_atomic_store_release(&state->args_state, ok ? SN_LOG_SITE_ARGS_READY : SN_LOG_SITE_ARGS_UNSUPPORTED);
+
+    return ok ? &state->args : NULL;
+}
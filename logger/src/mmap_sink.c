@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "snlogger/mmap_sink.h"
+
+#include "snlogger/clock.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Longest segment path, base path included
+#define MMAP_SINK_PATH_MAX 4096
+
+static size_t page_size(void) {
+    static size_t size;
+    if (!size) size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static bool mmap_sink_open(snMmapSink *sink) {
+    char path[MMAP_SINK_PATH_MAX];
+    int fd;
+
+    // Segments of earlier runs are kept, the next unused index is taken
+    for (;;) {
+        int path_len = snprintf(path, sizeof(path), "%s.%06u", sink->path, (unsigned)sink->segment);
+        if (path_len < 0 || (size_t)path_len >= sizeof(path)) goto retry;
+
+        sink->syscalls++;
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) break;
+        if (errno != EEXIST || sink->segment == UINT32_MAX) goto retry;
+
+        sink->segment++;
+    }
+
+    // Reserve the blocks up front so page faults never hit a full disk
+    sink->syscalls++;
+#if defined(SN_OS_LINUX)
+    bool allocated = posix_fallocate(fd, 0, (off_t)sink->segment_size) == 0;
+#else
+    bool allocated = false;
+#endif
+    if (!allocated) {
+        sink->syscalls++;
+        if (ftruncate(fd, (off_t)sink->segment_size) != 0) goto fail;
+    }
+
+    sink->syscalls++;
+    void *map = mmap(NULL, sink->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) goto fail;
+
+    sink->fd = fd;
+    sink->map = map;
+    sink->used = 0;
+    sink->synced = 0;
+    sink->segments++;
+
+    return true;
+
+fail:
+    close(fd);
+    unlink(path);
+
+retry:
+    sink->errors++;
+    sink->retry_at = sn_clock_monotonic(NULL) + SN_MMAP_SINK_RETRY_NS;
+    return false;
+}
+
+static void mmap_sink_unmap(snMmapSink *sink) {
+    sink->syscalls += 3;
+    if (munmap(sink->map, sink->segment_size) != 0) sink->errors++;
+    if (ftruncate(sink->fd, (off_t)sink->used) != 0) sink->errors++;
+    if (close(sink->fd) != 0) sink->errors++;
+
+    sink->map = NULL;
+    sink->fd = -1;
+}
+
+void sn_mmap_sink_close(void *data) {
+    snMmapSink *sink = data;
+
+    sink->closed = true;
+    if (sink->map) mmap_sink_unmap(sink);
+}
+
+static void mmap_sink_sync(snMmapSink *sink, int flags) {
+    if (!sink->map || sink->used == sink->synced) return;
+
+    // msync() needs a page aligned start
+    size_t start = sink->synced & ~(page_size() - 1);
+
+    sink->syscalls++;
+    if (msync(sink->map + start, sink->used - start, flags) != 0) sink->errors++;
+
+    sink->synced = sink->used;
+}
+
+void sn_mmap_sink_flush(void *data) {
+    mmap_sink_sync(data, MS_SYNC);
+}
+
+static bool mmap_sink_roll(snMmapSink *sink) {
+    if (sink->map) {
+        // Start the writeback without waiting for it, processing is not
+        // held up by the disk
+        mmap_sink_sync(sink, MS_ASYNC);
+        mmap_sink_unmap(sink);
+        sink->segment++;
+    } else if (sn_clock_monotonic(NULL) < sink->retry_at) {
+        // Back off after a failed segment instead of retrying every batch
+        return false;
+    }
+
+    return mmap_sink_open(sink);
+}
+
+static bool mmap_sink_append(snMmapSink *sink, const char *data, size_t len) {
+    while (len) {
+        size_t space = sink->segment_size - sink->used;
+        if (!space) {
+            if (!mmap_sink_roll(sink)) return false;
+            continue;
+        }
+
+        size_t n = SN_MIN(space, len);
+        memcpy(sink->map + sink->used, data, n);
+        sink->used += n;
+        sink->bytes_written += n;
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+bool sn_mmap_sink_init(snMmapSink *sink, const char *path, size_t segment_size) {
+    *sink = (snMmapSink){
+        .path = path,
+        .segment_size = segment_size,
+        .fd = -1,
+    };
+
+    return segment_size && mmap_sink_open(sink);
+}
+
+void sn_mmap_sink_write_batch(const snSinkRecord *records, size_t count, void *data) {
+    snMmapSink *sink = data;
+
+    if (sink->closed) {
+        sink->dropped += count;
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t size = records[i].len + 1;
+
+        // Keep records whole unless they are larger than a segment
+        bool roll = !sink->map || (sink->used && size > sink->segment_size - sink->used);
+        if (roll && !mmap_sink_roll(sink)) {
+            sink->dropped += count - i;
+            return;
+        }
+
+        // A record larger than a segment is cut short when the next one fails
+        if (!mmap_sink_append(sink, records[i].msg, records[i].len) || !mmap_sink_append(sink, "\n", 1)) sink->dropped++;
+    }
+}
+
+void sn_mmap_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    snSinkRecord record = {.msg = msg, .len = len, .level = level};
+    sn_mmap_sink_write_batch(&record, 1, data);
+}
@@ -0,0 +1,158 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE
+#elif !defined(_WIN32)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "notifier.h"
+
+#include "snlogger/atomic.h"
+#include "snlogger/clock.h"
+
+#include <time.h>
+
+#if defined(SN_OS_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <poll.h>
+    #include <sched.h>
+    #include <unistd.h>
+#endif
+
+#if defined(SN_OS_LINUX)
+    #include <linux/futex.h>
+    #include <sys/eventfd.h>
+    #include <sys/syscall.h>
+#endif
+
+// Longest sleep of the polling fallback
+#define POLL_SLICE_NS 1000000ull
+
+void notifier_yield(void) {
+#if defined(SN_OS_WINDOWS)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void notifier_wait_address(uint32_t *addr, uint32_t expected, uint64_t timeout) {
+#if defined(SN_OS_LINUX)
+    struct timespec ts = {
+        .tv_sec = (time_t)(timeout / 1000000000ull),
+        .tv_nsec = (long)(timeout % 1000000000ull),
+    };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout == SN_NOTIFIER_WAIT_FOREVER ? NULL : &ts, NULL, 0);
+#elif defined(SN_OS_WINDOWS)
+    DWORD ms = timeout == SN_NOTIFIER_WAIT_FOREVER ? INFINITE : (DWORD)SN_MIN((timeout + 999999) / 1000000, (uint64_t)INFINITE - 1);
+    WaitOnAddress(addr, &expected, sizeof(expected), ms);
+#else
+    // No public address wait, sleep in short slices
+    if (sn_atomic_load_acquire(addr) != expected) return;
+
+    uint64_t slice = SN_MIN(timeout, POLL_SLICE_NS);
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = (long)slice};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+void notifier_wake_address(uint32_t *addr) {
+#if defined(SN_OS_LINUX)
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+#elif defined(SN_OS_WINDOWS)
+    WakeByAddressAll(addr);
+#else
+    SN_UNUSED(addr);
+#endif
+}
+
+bool sn_notifier_init(snNotifier *notifier, snNotifierKind kind) {
+    *notifier = (snNotifier){
+        .kind = kind,
+        .fd = -1,
+    };
+
+    if (kind == SN_NOTIFIER_FUTEX) return true;
+
+#if defined(SN_OS_LINUX)
+    notifier->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return notifier->fd >= 0;
+#else
+    return false;
+#endif
+}
+
+void sn_notifier_deinit(snNotifier *notifier) {
+#if !defined(SN_OS_WINDOWS)
+    if (notifier->fd >= 0) close(notifier->fd);
+#endif
+
+    *notifier = (snNotifier){.fd = -1};
+}
+
+void sn_notifier_notify(void *data) {
+    snNotifier *notifier = data;
+
+    sn_atomic_fetch_add_relaxed(&notifier->notifications, 1);
+
+#if defined(SN_OS_LINUX)
+    if (notifier->kind == SN_NOTIFIER_EVENTFD) {
+        uint64_t one = 1;
+        ssize_t written = write(notifier->fd, &one, sizeof(one));
+        SN_UNUSED(written);
+        return;
+    }
+#endif
+
+    sn_atomic_fetch_add_relaxed(&notifier->signal, 1);
+    notifier_wake_address(&notifier->signal);
+}
+
+#if defined(SN_OS_LINUX)
+
+static bool notifier_wait_eventfd(snNotifier *notifier, uint64_t timeout) {
+    uint64_t value;
+    if (read(notifier->fd, &value, sizeof(value)) == sizeof(value)) return true;
+    if (!timeout) return false;
+
+    struct timespec ts = {
+        .tv_sec = (time_t)(timeout / 1000000000ull),
+        .tv_nsec = (long)(timeout % 1000000000ull),
+    };
+    struct pollfd pfd = {.fd = notifier->fd, .events = POLLIN};
+    ppoll(&pfd, 1, timeout == SN_NOTIFIER_WAIT_FOREVER ? NULL : &ts, NULL);
+
+    return read(notifier->fd, &value, sizeof(value)) == sizeof(value);
+}
+
+#endif
+
+bool sn_notifier_wait(snNotifier *notifier, uint64_t timeout) {
+#if defined(SN_OS_LINUX)
+    if (notifier->kind == SN_NOTIFIER_EVENTFD) return notifier_wait_eventfd(notifier, timeout);
+#endif
+
+    uint64_t deadline = 0;
+    if (timeout && timeout != SN_NOTIFIER_WAIT_FOREVER) deadline = sn_clock_monotonic(NULL) + timeout;
+
+    for (;;) {
+        uint32_t signal = (uint32_t)sn_atomic_load_acquire(&notifier->signal);
+        if (signal != notifier->seen) {
+            notifier->seen = signal;
+            return true;
+        }
+
+        if (!timeout) return false;
+
+        uint64_t remaining = SN_NOTIFIER_WAIT_FOREVER;
+        if (deadline) {
+            uint64_t now = sn_clock_monotonic(NULL);
+            if (now >= deadline) return false;
+            remaining = deadline - now;
+        }
+
+        // Wakes up spuriously at times, the loop checks again
+        notifier_wait_address(&notifier->signal, signal, remaining);
+    }
+}
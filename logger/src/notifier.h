@@ -0,0 +1,21 @@
+#pragma once
+
+#include "snlogger/notifier.h"
+
+// Platform wait primitives shared with the async logger, not part of the API
+
+/**
+ * Sleep while *addr holds expected, for at most timeout nanoseconds.
+ * May return spuriously.
+ */
+void notifier_wait_address(uint32_t *addr, uint32_t expected, uint64_t timeout);
+
+/**
+ * Wake every thread sleeping on addr.
+ */
+void notifier_wake_address(uint32_t *addr);
+
+/**
+ * Give the processor to another thread.
+ */
+void notifier_yield(void);
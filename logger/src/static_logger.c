@@ -1,6 +1,9 @@
 #include "snlogger/static_logger.h"
 
-#include "snlogger/formatter.h"
+#include "snlogger/atomic.h"
+#include "snlogger/clock.h"
+
+#include "formatter.h"
 
 void sn_static_logger_init(snStaticLogger *logger, char *buffer, size_t buffer_size,
         snSink *sinks, size_t sink_count) {
@@ -11,7 +14,8 @@ void sn_static_logger_init(snStaticLogger *logger, char *buffer, size_t buffer_s
         .sinks = sinks,
         .sink_count = sink_count,
 
-        .level = SN_LOG_LEVEL_TRACE,
+        .level = sn_sinks_min_level(sinks, sink_count),
+        .requested_level = SN_LOG_LEVEL_TRACE,
     };
 
     for (size_t i = 0; i < sink_count; ++i)
@@ -32,9 +36,25 @@ void sn_static_logger_flush(snStaticLogger *logger) {
         if (logger->sinks[i].flush) logger->sinks[i].flush(logger->sinks[i].data);
 }
 
-void sn_static_logger_log_va(snStaticLogger *logger, snLogLevel level, const char *fmt, va_list args) {
-    if (level < logger->level) return;
+static void static_logger_write(snStaticLogger *logger, const snSinkRecord *record) {
+    for (size_t i = 0; i < logger->sink_count; ++i) {
+        snSink *sink = &logger->sinks[i];
+        if (!sn_sink_accepts(sink, record->level)) continue;
+
+        if (sink->write_histogram) {
+            uint64_t start = sn_clock_monotonic(NULL);
+            sn_sink_write(sink, record);
+            sn_histogram_record(sink->write_histogram, sn_clock_monotonic(NULL) - start);
+        } else {
+            sn_sink_write(sink, record);
+        }
+
+        sn_atomic_fetch_add_relaxed(&sink->calls, 1);
+        sn_atomic_fetch_add_relaxed(&sink->records, 1);
+    }
+}
 
+static void static_logger_log(snStaticLogger *logger, snLogLevel level, const snLogSite *site, const char *fmt, va_list args) {
     size_t len = format_string(logger->buffer, logger->buffer_size, fmt, args);
 
     if (len >= logger->buffer_size) {
@@ -45,14 +65,26 @@ void sn_static_logger_log_va(snStaticLogger *logger, snLogLevel level, const cha
         return;
     }
 
-    for (size_t i = 0; i < logger->sink_count; ++i)
-        logger->sinks[i].write(logger->buffer, len, level, logger->sinks[i].data);
+    snSinkRecord record = {.msg = logger->buffer, .len = len, .level = level, .site = site};
+    static_logger_write(logger, &record);
+}
+
+void sn_static_logger_log_va(snStaticLogger *logger, snLogLevel level, const char *fmt, va_list args) {
+    if (level < logger->level) return;
+
+    static_logger_log(logger, level, NULL, fmt, args);
+}
+
+void sn_static_logger_log_site_va(snStaticLogger *logger, const snLogSite *site, va_list args) {
+    if (!sn_log_site_enabled(site, logger->level)) return;
+
+    static_logger_log(logger, site->level, site, site->fmt, args);
 }
 
 void sn_static_logger_log_raw(snStaticLogger *logger, snLogLevel level, const char *msg, size_t len) {
     if (level < logger->level) return;
 
-    for (size_t i = 0; i < logger->sink_count; ++i)
-        logger->sinks[i].write(msg, len, level, logger->sinks[i].data);
+    snSinkRecord record = {.msg = msg, .len = len, .level = level};
+    static_logger_write(logger, &record);
 }
 
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+
+#include "snlogger/uring_sink.h"
+
+#include "snlogger/atomic.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define URING_STREAM_OFFSET ((uint64_t)-1)
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_close(snUringSink *sink) {
+    if (sink->sqes) munmap(sink->sqes, sink->sqes_size);
+    if (sink->cq_ring && sink->cq_ring != sink->sq_ring) munmap(sink->cq_ring, sink->cq_ring_size);
+    if (sink->sq_ring) munmap(sink->sq_ring, sink->sq_ring_size);
+    if (sink->ring_fd >= 0) close(sink->ring_fd);
+
+    sink->sqes = sink->cq_ring = sink->sq_ring = NULL;
+    sink->ring_fd = -1;
+}
+
+static bool uring_open(snUringSink *sink, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    sink->ring_fd = uring_setup(entries, &params);
+    if (sink->ring_fd < 0) return false;
+
+    sink->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    sink->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sink->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Both rings share one mapping on recent kernels
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sink->sq_ring_size = sink->cq_ring_size = SN_MAX(sink->sq_ring_size, sink->cq_ring_size);
+
+    void *sq_ring = mmap(NULL, sink->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            sink->ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) goto fail;
+    sink->sq_ring = sq_ring;
+
+    if (single_mmap) {
+        sink->cq_ring = sq_ring;
+    } else {
+        void *cq_ring = mmap(NULL, sink->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                sink->ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) goto fail;
+        sink->cq_ring = cq_ring;
+    }
+
+    void *sqes = mmap(NULL, sink->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            sink->ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) goto fail;
+    sink->sqes = sqes;
+
+    char *sq = sink->sq_ring;
+    sink->sq_head = (uint32_t *)(sq + params.sq_off.head);
+    sink->sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    sink->sq_mask = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    sink->sq_array = (uint32_t *)(sq + params.sq_off.array);
+
+    char *cq = sink->cq_ring;
+    sink->cq_head = (uint32_t *)(cq + params.cq_off.head);
+    sink->cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    sink->cq_mask = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    sink->cqes = cq + params.cq_off.cqes;
+
+    return true;
+
+fail:
+    uring_close(sink);
+    return false;
+}
+
+/**
+ * Hand the queued entries to the kernel and optionally wait for completions.
+ *
+ * Returns false if io_uring_enter failed.
+ */
+static bool uring_enter_pending(snUringSink *sink, unsigned min_complete) {
+    unsigned to_submit = *sink->sq_tail - sn_atomic_load_acquire(sink->sq_head);
+    if (!to_submit && !min_complete) return true;
+
+    int result;
+    do {
+        result = uring_enter(sink->ring_fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+        sink->syscalls++;
+    } while (result < 0 && errno == EINTR);
+
+    // Entries left in the queue are submitted by the next call
+    if (result < 0) sink->errors++;
+
+    return result >= 0;
+}
+
+/**
+ * Give up on the writes in flight after io_uring_enter failed, so waiting
+ * for them cannot spin forever. Their data is dropped.
+ */
+static void uring_abandon(snUringSink *sink) {
+    // Entries the kernel has not consumed are taken back, late
+    // completions of the others carry an old generation and are ignored
+    sn_atomic_store_release(sink->sq_tail, sn_atomic_load_acquire(sink->sq_head));
+    sink->generation++;
+
+    for (uint32_t i = 0; i < sink->buffer_count; ++i) {
+        snUringBuffer *buffer = &sink->buffers[i];
+        if (!buffer->in_flight) continue;
+
+        sink->errors++;
+        *buffer = (snUringBuffer){.data = buffer->data};
+    }
+
+    sink->in_flight = 0;
+}
+
+static void uring_queue_write(snUringSink *sink, uint32_t index) {
+    snUringBuffer *buffer = &sink->buffers[index];
+
+    uint32_t tail = *sink->sq_tail;
+    uint32_t slot = tail & sink->sq_mask;
+
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)sink->sqes + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = sink->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(buffer->data + buffer->start);
+    sqe->len = (uint32_t)(buffer->len - buffer->start);
+    sqe->off = buffer->offset;
+    sqe->user_data = (uint64_t)sink->generation << 32 | index;
+
+    sink->sq_array[slot] = slot;
+    sn_atomic_store_release(sink->sq_tail, tail + 1);
+
+    buffer->in_flight = true;
+    sink->in_flight++;
+    sink->submissions++;
+}
+
+/**
+ * Process the available completions, waiting for at least one if wait is set.
+ *
+ * Partially written buffers are queued again with the rest of their data.
+ * When waiting fails, the writes in flight are abandoned.
+ */
+static void uring_reap(snUringSink *sink, bool wait) {
+    if (wait && !uring_enter_pending(sink, 1)) {
+        uring_abandon(sink);
+        return;
+    }
+
+    bool requeued = false;
+    uint32_t head = *sink->cq_head;
+
+    while (head != sn_atomic_load_acquire(sink->cq_tail)) {
+        struct io_uring_cqe *cqe = (struct io_uring_cqe *)sink->cqes + (head & sink->cq_mask);
+        uint32_t index = (uint32_t)cqe->user_data;
+        uint32_t generation = (uint32_t)(cqe->user_data >> 32);
+        int32_t result = cqe->res;
+
+        sn_atomic_store_release(sink->cq_head, ++head);
+
+        if (generation != sink->generation) continue;
+
+        snUringBuffer *buffer = &sink->buffers[index];
+        buffer->in_flight = false;
+        sink->in_flight--;
+
+        bool retry = result == -EINTR || result == -EAGAIN;
+        if (retry && ++buffer->retries <= SN_URING_SINK_MAX_RETRIES) {
+            // Queued again below
+        } else if (result <= 0) {
+            // A write of 0 bytes makes no progress and would be requeued forever
+            sink->errors++;
+            buffer->start = buffer->len;
+        } else {
+            sink->bytes_written += (uint64_t)result;
+            buffer->start += (size_t)result;
+            buffer->retries = 0;
+            if (buffer->offset != URING_STREAM_OFFSET) buffer->offset += (uint64_t)result;
+        }
+
+        if (buffer->start < buffer->len) {
+            uring_queue_write(sink, index);
+            requeued = true;
+        } else {
+            buffer->start = buffer->len = 0;
+            buffer->retries = 0;
+        }
+    }
+
+    if (requeued) uring_enter_pending(sink, 0);
+}
+
+/**
+ * Submit the current buffer and move on to the next one, waiting for it
+ * to be written if it is still in flight.
+ */
+static void uring_submit_current(snUringSink *sink) {
+    snUringBuffer *buffer = &sink->buffers[sink->current];
+    if (!buffer->len) return;
+
+    // Streams have no offsets, keep their writes in order
+    bool stream = sink->offset == URING_STREAM_OFFSET;
+    while (stream && sink->in_flight) uring_reap(sink, true);
+
+    buffer->offset = sink->offset;
+    if (!stream) sink->offset += buffer->len;
+
+    uring_queue_write(sink, sink->current);
+    uring_enter_pending(sink, 0);
+
+    sink->current = (sink->current + 1) % sink->buffer_count;
+    while (sink->buffers[sink->current].in_flight) uring_reap(sink, true);
+}
+
+static void uring_append(snUringSink *sink, const char *data, size_t len) {
+    while (len) {
+        snUringBuffer *buffer = &sink->buffers[sink->current];
+
+        size_t space = sink->buffer_size - buffer->len;
+        if (!space) {
+            uring_submit_current(sink);
+            continue;
+        }
+
+        size_t n = SN_MIN(space, len);
+        memcpy(buffer->data + buffer->len, data, n);
+        buffer->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+bool sn_uring_sink_init(snUringSink *sink, int fd, char *buffer, size_t buffer_size, uint32_t buffer_count) {
+    *sink = (snUringSink){
+        .fd = fd,
+        .ring_fd = -1,
+    };
+
+    buffer_count = SN_MIN(buffer_count, SN_URING_SINK_MAX_BUFFERS);
+    size_t size = buffer_count ? buffer_size / buffer_count : 0;
+
+    if (!buffer || !size || !uring_open(sink, buffer_count)) {
+        sn_file_sink_init(&sink->file, fd, buffer, buffer_size);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < buffer_count; ++i)
+        sink->buffers[i] = (snUringBuffer){.data = buffer + i * size};
+
+    sink->buffer_count = buffer_count;
+    sink->buffer_size = size;
+    sink->active = true;
+
+    // Appending files ignore offsets, treat them like streams
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    int flags = fcntl(fd, F_GETFL);
+    sink->offset = position < 0 || flags < 0 || (flags & O_APPEND) ? URING_STREAM_OFFSET : (uint64_t)position;
+
+    return true;
+}
+
+void sn_uring_sink_deinit(snUringSink *sink) {
+    if (!sink->active) {
+        sn_file_sink_deinit(&sink->file);
+        *sink = (snUringSink){0};
+        return;
+    }
+
+    sink->sync = false;
+    sn_uring_sink_flush(sink);
+
+    // Writes used explicit offsets, leave the file position after them
+    if (sink->offset != URING_STREAM_OFFSET) lseek(sink->fd, (off_t)sink->offset, SEEK_SET);
+
+    uring_close(sink);
+
+    *sink = (snUringSink){0};
+}
+
+void sn_uring_sink_write_batch(const snSinkRecord *records, size_t count, void *data) {
+    snUringSink *sink = data;
+
+    if (!sink->active) {
+        sn_file_sink_write_batch(records, count, &sink->file);
+        return;
+    }
+
+    // Free the buffers of finished writes without a system call
+    uring_reap(sink, false);
+
+    for (size_t i = 0; i < count; ++i) {
+        uring_append(sink, records[i].msg, records[i].len);
+        uring_append(sink, "\n", 1);
+    }
+}
+
+void sn_uring_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    snSinkRecord record = {.msg = msg, .len = len, .level = level};
+    sn_uring_sink_write_batch(&record, 1, data);
+}
+
+void sn_uring_sink_flush(void *data) {
+    snUringSink *sink = data;
+
+    if (!sink->active) {
+        sn_file_sink_flush(&sink->file);
+        return;
+    }
+
+    uring_submit_current(sink);
+    while (sink->in_flight) uring_reap(sink, true);
+
+    if (!sink->sync) return;
+
+    sink->syscalls++;
+    if (fdatasync(sink->fd) != 0) sink->errors++;
+}
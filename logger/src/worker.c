@@ -0,0 +1,188 @@
+#if defined(__linux__)
+    #define _GNU_SOURCE
+#elif !defined(_WIN32)
+    #define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "snlogger/worker.h"
+
+#include "snlogger/atomic.h"
+#include "snlogger/clock.h"
+
+#if defined(SN_OS_WINDOWS)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <pthread.h>
+    #include <sched.h>
+#endif
+
+// Pauses between two polls of an idle busy-polling worker
+#define BUSY_POLL_PAUSES 32
+
+void sn_worker_config_default(snWorkerConfig *config) {
+    *config = (snWorkerConfig){
+        .mode = SN_WORKER_BLOCKING,
+        .cpu = -1,
+        .batch = SN_ASYNC_LOGGER_BATCH_SIZE,
+        .flush_interval = 100000000ull,
+        .idle_timeout = 10000000ull,
+        .notify_records = 4 * SN_ASYNC_LOGGER_BATCH_SIZE,
+    };
+}
+
+void sn_worker_init(snWorker *worker, const snWorkerConfig *config) {
+    *worker = (snWorker){0};
+
+    if (config) {
+        worker->config = *config;
+    } else {
+        sn_worker_config_default(&worker->config);
+    }
+
+    if (!worker->config.batch) worker->config.batch = SN_ASYNC_LOGGER_BATCH_SIZE;
+
+    sn_notifier_init(&worker->notifier, SN_NOTIFIER_FUTEX);
+}
+
+bool sn_worker_add(snWorker *worker, snAsyncLogger *logger) {
+    if (worker->logger_count >= SN_WORKER_MAX_LOGGERS) return false;
+
+    worker->loggers[worker->logger_count++] = logger;
+
+    if (worker->config.mode == SN_WORKER_BLOCKING)
+        sn_async_logger_set_notifier(logger, sn_notifier_notify, &worker->notifier,
+                worker->config.notify_records, logger->buffer_size / 2, 0);
+
+    return true;
+}
+
+static void worker_flush(snWorker *worker) {
+    for (size_t i = 0; i < worker->logger_count; ++i)
+        sn_async_logger_flush(worker->loggers[i]);
+}
+
+static void worker_run(snWorker *worker) {
+    const snWorkerConfig *config = &worker->config;
+    uint64_t next_flush = config->flush_interval ? sn_clock_monotonic(NULL) + config->flush_interval : 0;
+
+    while (sn_atomic_load_acquire(&worker->running)) {
+        // One batch per logger in turn, so a busy logger does not starve the others
+        size_t processed = 0;
+        for (size_t i = 0; i < worker->logger_count; ++i)
+            processed += sn_async_logger_process_n(worker->loggers[i], config->batch);
+
+        worker->processed += processed;
+
+        uint64_t now = 0;
+        if (next_flush) {
+            now = sn_clock_monotonic(NULL);
+            if (now >= next_flush) {
+                worker_flush(worker);
+                worker->flushes++;
+                next_flush = now + config->flush_interval;
+            }
+        }
+
+        if (processed) continue;
+
+        if (config->mode == SN_WORKER_BUSY_POLL) {
+            for (size_t i = 0; i < BUSY_POLL_PAUSES; ++i)
+                sn_atomic_pause();
+            continue;
+        }
+
+        uint64_t timeout = config->idle_timeout;
+        if (next_flush) timeout = SN_MIN(timeout, next_flush - now);
+
+        worker->sleeps++;
+        sn_notifier_wait(&worker->notifier, timeout);
+    }
+}
+
+static void worker_pin(snWorker *worker) {
+    if (worker->config.cpu < 0) return;
+
+#if defined(SN_OS_LINUX)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->config.cpu, &set);
+    worker->pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(SN_OS_WINDOWS)
+    worker->pinned = worker->config.cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << worker->config.cpu) != 0;
+#else
+    // macOS only offers affinity hints
+    worker->pinned = false;
+#endif
+}
+
+#if defined(SN_OS_WINDOWS)
+
+static DWORD WINAPI worker_main(LPVOID arg) {
+    snWorker *worker = arg;
+    worker_pin(worker);
+    worker_run(worker);
+    return 0;
+}
+
+#else
+
+static void *worker_main(void *arg) {
+    snWorker *worker = arg;
+
+#if defined(SN_OS_LINUX)
+    pthread_setname_np(pthread_self(), "snlogger");
+#endif
+
+    worker_pin(worker);
+    worker_run(worker);
+    return NULL;
+}
+
+#endif
+
+bool sn_worker_start(snWorker *worker) {
+    if (worker->started) return true;
+
+    sn_atomic_store_release(&worker->running, 1);
+
+#if defined(SN_OS_WINDOWS)
+    HANDLE thread = CreateThread(NULL, 0, worker_main, worker, 0, NULL);
+    if (!thread) return false;
+    worker->thread = (uintptr_t)thread;
+#else
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker_main, worker) != 0) return false;
+    worker->thread = (uintptr_t)thread;
+#endif
+
+    worker->started = true;
+    return true;
+}
+
+void sn_worker_stop(snWorker *worker) {
+    if (worker->started) {
+        sn_atomic_store_release(&worker->running, 0);
+        sn_notifier_notify(&worker->notifier);
+
+#if defined(SN_OS_WINDOWS)
+        WaitForSingleObject((HANDLE)worker->thread, INFINITE);
+        CloseHandle((HANDLE)worker->thread);
+#else
+        pthread_join((pthread_t)worker->thread, NULL);
+#endif
+
+        worker->started = false;
+    }
+
+    // Records still queued when the thread stopped
+    for (size_t i = 0; i < worker->logger_count; ++i) {
+        worker->processed += sn_async_logger_drain(worker->loggers[i]);
+
+        if (worker->config.mode == SN_WORKER_BLOCKING)
+            sn_async_logger_set_notifier(worker->loggers[i], NULL, NULL, 0, 0, 0);
+    }
+
+    worker_flush(worker);
+    sn_notifier_deinit(&worker->notifier);
+}
@@ -50,35 +50,6 @@ void log_msg(snStaticLogger *lg,
     va_end(args);
 }
 
-void loga_msg(snAsyncLogger *lg,
-        snLogLevel level, const char *file,
-        const char *function, long line,
-        const char *format_string, ...) {
-    if (level < lg->level) return;
-
-    const char *level_string = NULL;
-    const char *level_strings[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
-    level_string = level_strings[level];
-
-    char buffer[1024] = {0};
-    size_t buffer_size = ARRAY_LEN(buffer);
-    size_t len = snprintf(buffer, buffer_size, FORMAT, FORMAT_ARGS);
-
-    if (len < 0) abort();
-
-    if (len >= buffer_size) {
-        loga_msg(lg, SN_LOG_LEVEL_ERROR, file, function, line, "Too long message, try increasing the buffer size or decreasing message length!");
-        return;
-    }
-
-    buffer[len] = 0;
-
-    va_list args;
-    va_start(args, format_string);
-    sn_async_logger_log_va(lg, level, buffer, args);
-    va_end(args);
-}
-
 #define log_trace(lg, msg, ...) log_msg(lg, SN_LOG_LEVEL_TRACE, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
 #define log_debug(lg, msg, ...) log_msg(lg, SN_LOG_LEVEL_DEBUG, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
 #define log_info(lg, msg, ...) log_msg(lg, SN_LOG_LEVEL_INFO, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
@@ -86,21 +57,12 @@ void loga_msg(snAsyncLogger *lg,
 #define log_error(lg, msg, ...) log_msg(lg, SN_LOG_LEVEL_ERROR, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
 #define log_fatal(lg, msg, ...) log_msg(lg, SN_LOG_LEVEL_FATAL, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
 
-#define loga_trace(lg, msg, ...) loga_msg(lg, SN_LOG_LEVEL_TRACE, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
-#define loga_debug(lg, msg, ...) loga_msg(lg, SN_LOG_LEVEL_DEBUG, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
-#define loga_info(lg, msg, ...) loga_msg(lg, SN_LOG_LEVEL_INFO, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
-#define loga_warn(lg, msg, ...) loga_msg(lg, SN_LOG_LEVEL_WARN, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
-#define loga_error(lg, msg, ...) loga_msg(lg, SN_LOG_LEVEL_ERROR, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
-#define loga_fatal(lg, msg, ...) loga_msg(lg, SN_LOG_LEVEL_FATAL, __FILE__, __func__, __LINE__, msg, ##__VA_ARGS__)
-
 typedef struct stdout_stderr_sink {
     // 0 -> stdout, 1 -> stderr
     bool colored_enabled[2];
 } stdout_stderr_sink;
 
-void stdout_stderr_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
-    stdout_stderr_sink *sink = (stdout_stderr_sink *)data;
-
+static FILE *stdout_stderr_sink_begin(stdout_stderr_sink *sink, snLogLevel level) {
     bool error = level > SN_LOG_LEVEL_WARN;
     FILE *out_file = error ? stderr : stdout;
 
@@ -129,11 +91,37 @@ void stdout_stderr_sink_write(const char *msg, size_t len, snLogLevel level, voi
         }
     }
 
-    fwrite(msg, sizeof(char), len, out_file);
+    return out_file;
+}
 
+static void stdout_stderr_sink_end(stdout_stderr_sink *sink, snLogLevel level, FILE *out_file) {
+    bool error = level > SN_LOG_LEVEL_WARN;
     if (sink->colored_enabled[(int)error]) fputs("\x1b[0m", out_file);
 }
 
+void stdout_stderr_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    stdout_stderr_sink *sink = (stdout_stderr_sink *)data;
+
+    FILE *out_file = stdout_stderr_sink_begin(sink, level);
+    fwrite(msg, sizeof(char), len, out_file);
+    stdout_stderr_sink_end(sink, level, out_file);
+}
+
+// The call site provides the source location, the message is not copied again
+void stdout_stderr_sink_write_record(const snSinkRecord *record, void *data) {
+    stdout_stderr_sink *sink = (stdout_stderr_sink *)data;
+
+    const char *level_strings[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+    FILE *out_file = stdout_stderr_sink_begin(sink, record->level);
+    if (record->site)
+        fprintf(out_file, "[%s]: %s:%u in funtion %s: ", level_strings[record->level],
+                record->site->file, (unsigned)record->site->line, record->site->function);
+    fwrite(record->msg, sizeof(char), record->len, out_file);
+    fputc('\n', out_file);
+    stdout_stderr_sink_end(sink, record->level, out_file);
+}
+
 void stdout_stderr_sink_open(void *data) {
     stdout_stderr_sink *sink = (stdout_stderr_sink *)data;
 #if defined(SN_OS_WINDOWS)
@@ -173,7 +161,7 @@ int main(void) {
             (snSink){
                 .open = stdout_stderr_sink_open,
                 .flush = stdout_stderr_sink_flush,
-                .write = stdout_stderr_sink_write,
+                .write_record = stdout_stderr_sink_write_record,
                 .data = &sink_data[1]
             }
         }
@@ -190,14 +178,14 @@ int main(void) {
         log_error(&sl, "Static error message %.2f", 3.1415);
         log_fatal(&sl, "Static fatal message %.2f", 3.1415);
 
-        loga_trace(&al, "Async trace message %.2f", 3.1415);
-        loga_debug(&al, "Async debug message %.2f", 3.1415);
+        SN_ALOG_TRACE(&al, "Async trace message %.2f", 3.1415);
+        SN_ALOG_DEBUG(&al, "Async debug message %.2f", 3.1415);
         sn_async_logger_process(&al);
-        loga_info(&al, "Async info message %.2f", 3.1415);
-        loga_warn(&al, "Async warn message %.2f", 3.1415);
+        SN_ALOG_INFO(&al, "Async info message %.2f", 3.1415);
+        SN_ALOG_WARN(&al, "Async warn message %.2f", 3.1415);
         sn_async_logger_process(&al);
-        loga_error(&al, "Async error message %.2f", 3.1415);
-        loga_fatal(&al, "Async fatal message %.2f", 3.1415);
+        SN_ALOG_ERROR(&al, "Async error message %.2f", 3.1415);
+        SN_ALOG_FATAL(&al, "Async fatal message %.2f", 3.1415);
     }
 
     sn_static_logger_deinit(&sl);
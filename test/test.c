@@ -13,6 +13,18 @@
 #include <stdatomic.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+
+#ifdef SN_LOGGER_TEST_URING
+#include <snlogger/uring_sink.h>
+#endif
+
+#ifdef SN_LOGGER_TEST_WORKER
+#include <snlogger/worker.h>
+#include <sched.h>
+#endif
 
 #define MAX_LOGS 100000
 #define MAX_LEN  16
@@ -43,6 +55,27 @@ static void test_sink_write(const char *msg, size_t len, snLogLevel level, void
     sink->count++;
 }
 
+#define LINE_LOGS 64
+#define LINE_LEN 256
+
+typedef struct {
+    char logs[LINE_LOGS][LINE_LEN];
+    size_t count;
+} LineSink;
+
+static void line_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    (void)level;
+    LineSink *sink = data;
+
+    if (sink->count >= LINE_LOGS)
+        return;
+
+    size_t copy = len < LINE_LEN - 1 ? len : LINE_LEN - 1;
+    memcpy(sink->logs[sink->count], msg, copy);
+    sink->logs[sink->count][copy] = 0;
+    sink->count++;
+}
+
 static void flush_sink_flush(void *data) {
     FlushSink *fs = data;
     fs->flush_count++;
@@ -149,6 +182,94 @@ static void test_static_log_level(void) {
     printf("✓ passed\n");
 }
 
+#define CHECK_FORMAT(logger, sink, ...) do { \
+        char expected_[LINE_LEN]; \
+        snprintf(expected_, sizeof(expected_), __VA_ARGS__); \
+        (sink)->count = 0; \
+        sn_static_logger_log(logger, SN_LOG_LEVEL_INFO, __VA_ARGS__); \
+        if ((sink)->count != 1 || strcmp((sink)->logs[0], expected_) != 0) \
+            printf("mismatch: \"%s\" != \"%s\"\n", (sink)->count ? (sink)->logs[0] : "", expected_); \
+        assert((sink)->count == 1 && strcmp((sink)->logs[0], expected_) == 0); \
+    } while (0)
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void test_static_formatting(void) {
+    printf("Running test_static_formatting...\n");
+
+    char buffer[LINE_LEN];
+    static LineSink sink;
+
+    snSink sinks[] = {
+        {.write = line_sink_write, .data = &sink}
+    };
+
+    snStaticLogger sl;
+    sn_static_logger_init(&sl, buffer, sizeof(buffer), sinks, 1);
+
+    CHECK_FORMAT(&sl, &sink, "|%d|%i|%u|%x|%X|%o|", 0, -1, 4294967295u, 0xdeadbeefu, 0xabcu, 0755u);
+    CHECK_FORMAT(&sl, &sink, "|%d|%d|%ld|%lld|", INT_MIN, INT_MAX, LONG_MIN, LLONG_MIN);
+    CHECK_FORMAT(&sl, &sink, "|%lu|%llu|%zu|%zd|%td|%jd|", ULONG_MAX, ULLONG_MAX, SIZE_MAX, (ssize_t)-5, (ptrdiff_t)-7, (intmax_t)INT64_MIN);
+    CHECK_FORMAT(&sl, &sink, "|%hhd|%hhu|%hd|%hu|%hhx|", -1, 300, 70000, 70000, 511);
+    CHECK_FORMAT(&sl, &sink, "|%5d|%-5d|%05d|%+d|% d|%+ d|%-05d|", 42, 42, -42, 7, 7, 7, 3);
+    CHECK_FORMAT(&sl, &sink, "|%.3d|%8.3d|%-8.3d|%08.3d|%.0d|%+.0d|%5.0d|", 7, -7, 7, 7, 0, 0, 0);
+    CHECK_FORMAT(&sl, &sink, "|%#x|%#X|%#o|%#x|%#o|%#.0o|%#8x|%#08x|%#-8x|", 255u, 255u, 8u, 0u, 0u, 0u, 255u, 255u, 255u);
+    CHECK_FORMAT(&sl, &sink, "|%#.5o|%.5x|%*d|%-*d|%*d|", 8u, 255u, 6, 12, 4, 3, -6, 5);
+    CHECK_FORMAT(&sl, &sink, "|%c|%3c|%-3c|%%|", 'a', 'b', 'c');
+
+    CHECK_FORMAT(&sl, &sink, "|%s|%10s|%-10s|%.2s|%5.1s|%.*s|%.*s|", "hello", "hi", "hi", "hello", "xyz", 3, "abcdef", -1, "abc");
+    CHECK_FORMAT(&sl, &sink, "|%s|%.3s|%.6s|%8s|%-8s|", (char *)NULL, (char *)NULL, (char *)NULL, (char *)NULL, (char *)NULL);
+    CHECK_FORMAT(&sl, &sink, "|%p|%p|%20p|%-20p|%10p|", (void *)&sl, (void *)NULL, (void *)&sl, (void *)&sl, (void *)NULL);
+
+    CHECK_FORMAT(&sl, &sink, "|%f|%.0f|%.0f|%.0f|%.0f|%#.0f|%.1f|", 0.0, 0.5, 1.5, 2.5, -0.0, 2.5, 0.25);
+    CHECK_FORMAT(&sl, &sink, "|%010.3f|%-10.2f|%+f|% f|%+.2f|%.17f|%.18f|", -3.14159, 2.5, 1.0, 1.0, -0.004, 0.1, 0.1);
+    CHECK_FORMAT(&sl, &sink, "|%f|%F|%f|%F|%010f|%-6f|%+f|", 1.0 / 0.0, 1.0 / 0.0, -(0.0 / 0.0), 0.0 / 0.0, -1.0 / 0.0, 1.0 / 0.0, 1.0 / 0.0);
+    CHECK_FORMAT(&sl, &sink, "|%f|%f|%.3f|%f|", 1e18, 9.3e18, 1e300, 5e-324);
+    CHECK_FORMAT(&sl, &sink, "|%g|%g|%g|%g|%g|%g|%g|", 0.0, -0.0, 100000.0, 1e6, 0.0001, 0.00001, 999999.5);
+    CHECK_FORMAT(&sl, &sink, "|%#g|%#.3g|%.0g|%.1g|%G|%g|%g|", 1.0, 1.0, 0.5, 9.5, 1e-10, 123456789.0, 0.000123456);
+    CHECK_FORMAT(&sl, &sink, "|%10.3g|%-10g|%010g|%+g|%.17g|%.20g|", 3.14159, 2.5, -2.5, 1.0, 0.1, 0.1);
+    CHECK_FORMAT(&sl, &sink, "|%e|%E|%a|%Lf|%'d|", 12345.678, 0.001, 1.0, (long double)1.5, 1234567);
+    CHECK_FORMAT(&sl, &sink, "|%y|%|");
+
+    static const char *double_formats[] = {
+        "|%f|", "|%.0f|", "|%.3f|", "|%.17f|", "|%g|", "|%.1g|", "|%.10g|", "|%#.17g|", "|%G|", "|%e|"
+    };
+
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    for (int i = 0; i < 20000; ++i) {
+        double value;
+        if (i % 2) {
+            // Any bit pattern, including NaN, infinity and subnormals
+            uint64_t bits = next_random(&state);
+            memcpy(&value, &bits, sizeof(value));
+        } else {
+            // Values around the range handled without the C library
+            value = (double)(next_random(&state) >> 11) / (double)(1ull << 53);
+            int scale = (int)(next_random(&state) % 40) - 20;
+            for (; scale > 0; --scale) value *= 10.0;
+            for (; scale < 0; ++scale) value /= 10.0;
+        }
+
+        for (size_t j = 0; j < SN_ARRAY_LENGTH(double_formats); ++j)
+            CHECK_FORMAT(&sl, &sink, double_formats[j], value);
+    }
+
+    for (int i = 0; i < 20000; ++i) {
+        uint64_t bits = next_random(&state);
+        CHECK_FORMAT(&sl, &sink, "|%d|%u|%x|%lld|%llu|%llo|%+.3d|", (int)bits, (unsigned)bits, (unsigned)bits,
+                (long long)bits, (unsigned long long)bits, (unsigned long long)bits, (int)(bits >> 48));
+    }
+
+    sn_static_logger_deinit(&sl);
+
+    printf("✓ passed\n");
+}
+
 static void test_async_single_thread_ordering(void) {
     printf("Running test_async_single_thread_ordering...\n");
 
@@ -252,6 +373,136 @@ static void *consumer_thread(void *arg) {
     return NULL;
 }
 
+static void test_async_backpressure_blocking(snBackpressure policy, snBackpressureWait wait, bool lock_free) {
+    enum {
+        PRODUCERS = 2,
+        MSGS_PER_PRODUCER = 2000
+    };
+
+    char buffer[512];
+    static TestSink sink;
+    sink.count = 0;
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_lock_free(&al, lock_free);
+    sn_async_logger_set_backpressure(&al, policy, wait);
+    sn_async_logger_set_backpressure_levels(&al, SN_LOG_LEVEL_DEBUG, SN_LOG_LEVEL_INFO);
+
+    MutexCtx mctx;
+    pthread_mutex_init(&mctx.mutex, NULL);
+    sn_async_logger_set_lock_hooks(&al, lock_wrapper, unlock_wrapper, &mctx);
+
+    pthread_t prod[PRODUCERS];
+    ProducerArgs pargs[PRODUCERS];
+
+    atomic_int done = 0;
+    ConsumerArgs cargs = {.logger = &al, .done = &done};
+    pthread_t consumer;
+
+    pthread_create(&consumer, NULL, consumer_thread, &cargs);
+
+    for (int i = 0; i < PRODUCERS; ++i) {
+        pargs[i] = (ProducerArgs){
+            .logger = &al,
+            .thread_id = i,
+            .count = MSGS_PER_PRODUCER
+        };
+        pthread_create(&prod[i], NULL, producer_thread, &pargs[i]);
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i)
+        pthread_join(prod[i], NULL);
+
+    atomic_store(&done, 1);
+    pthread_join(consumer, NULL);
+
+    // Nothing lost, producers had to wait for the consumer
+    assert(al.dropped == 0 && al.blocked > 0 && al.waiters == 0);
+    assert(sink.count == PRODUCERS * MSGS_PER_PRODUCER);
+
+    int last[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; ++i) last[i] = -1;
+
+    for (size_t i = 0; i < sink.count; ++i) {
+        uint64_t seq;
+        int thread_id, msg;
+        int fields = sscanf(sink.logs[i], "%lu t%d-%d", &seq, &thread_id, &msg);
+        assert(fields == 3);
+        assert(thread_id >= 0 && thread_id < PRODUCERS);
+        assert(msg == last[thread_id] + 1);
+        last[thread_id] = msg;
+    }
+
+    sn_async_logger_deinit(&al);
+    pthread_mutex_destroy(&mctx.mutex);
+}
+
+static void test_async_backpressure(void) {
+    printf("Running test_async_backpressure...\n");
+
+    char buffer[512];
+    static TestSink sink;
+    sink.count = 0;
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    assert(al.backpressure == SN_BACKPRESSURE_DROP_NEWEST);
+
+    // Drop oldest keeps the most recent records, without gaps
+    sn_async_logger_set_backpressure(&al, SN_BACKPRESSURE_DROP_OLDEST, SN_BACKPRESSURE_WAIT_YIELD);
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+
+    assert(al.overwritten > 0 && al.dropped == al.overwritten);
+    size_t kept = sn_async_logger_drain(&al);
+    assert(kept == sink.count && kept + al.overwritten == 100);
+    for (size_t i = 0; i < kept; ++i) {
+        char expected[MAX_LEN];
+        snprintf(expected, sizeof(expected), "msg-%zu", 100 - kept + i);
+        assert(strcmp(sink.logs[i], expected) == 0);
+    }
+
+    // The ring cursors stay consistent for the consumer
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "after");
+    size_t drained = sn_async_logger_drain(&al);
+    assert(drained == 1 && strcmp(sink.logs[sink.count - 1], "after") == 0);
+
+    // Level-aware: debug is shed while a quarter of the ring is still free
+    sn_async_logger_set_backpressure(&al, SN_BACKPRESSURE_LEVEL, SN_BACKPRESSURE_WAIT_YIELD);
+    size_t dropped = al.dropped;
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_DEBUG, "debug-%d", i);
+    assert(al.shed > 0 && al.dropped - dropped == al.shed);
+
+    sn_async_logger_log(&al, SN_LOG_LEVEL_WARN, "warn");
+    assert(al.dropped - dropped == al.shed);
+
+    // Without lock hooks nobody can free space, so even warnings drop
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_WARN, "warn-%d", i);
+    assert(al.dropped - dropped > al.shed && al.blocked == 0);
+
+    sn_async_logger_deinit(&al);
+
+    // Blocking producers lose nothing, with every wait strategy
+    test_async_backpressure_blocking(SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_SPIN, false);
+    test_async_backpressure_blocking(SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_YIELD, false);
+    test_async_backpressure_blocking(SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_FUTEX, false);
+    test_async_backpressure_blocking(SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_FUTEX, true);
+    test_async_backpressure_blocking(SN_BACKPRESSURE_LEVEL, SN_BACKPRESSURE_WAIT_FUTEX, false);
+
+    printf("✓ passed\n");
+}
+
 static void test_async_multi_producer_ordering(void) {
     printf("Running test_async_multi_producer_ordering...\n");
 
@@ -317,11 +568,17 @@ static void test_async_multi_producer_ordering(void) {
     printf("✓ passed\n");
 }
 
-static void test_async_process_n(void) {
-    printf("Running test_async_process_n...\n");
+static void test_async_lock_free_multi_producer(void) {
+    printf("Running test_async_lock_free_multi_producer...\n");
 
-    char buffer[4096];
-    TestSink sink = {0};
+    enum {
+        PRODUCERS = 8,
+        MSGS_PER_PRODUCER = 5000
+    };
+
+    static char buffer[16384];
+    static TestSink sink;
+    sink.count = 0;
 
     snSink sinks[] = {
         {.write = test_sink_write, .data = &sink}
@@ -329,32 +586,68 @@ static void test_async_process_n(void) {
 
     snAsyncLogger al;
     sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_lock_free(&al, true);
 
-    for (int i = 0; i < 20; ++i)
-        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+    pthread_t prod[PRODUCERS];
+    ProducerArgs pargs[PRODUCERS];
 
-    size_t p1 = sn_async_logger_process_n(&al, 7);
-    assert(p1 == 7);
-    assert(sink.count == 7);
+    atomic_int done = 0;
+    ConsumerArgs cargs = {.logger = &al, .done = &done};
+    pthread_t consumer;
 
-    size_t p2 = sn_async_logger_process_n(&al, 7);
-    assert(p2 == 7);
-    assert(sink.count == 14);
+    pthread_create(&consumer, NULL, consumer_thread, &cargs);
 
-    size_t p3 = sn_async_logger_process_n(&al, 100);
-    assert(p3 == 6);
-    assert(sink.count == 20);
+    for (int i = 0; i < PRODUCERS; ++i) {
+        pargs[i] = (ProducerArgs){
+            .logger = &al,
+            .thread_id = i,
+            .count = MSGS_PER_PRODUCER
+        };
+        pthread_create(&prod[i], NULL, producer_thread, &pargs[i]);
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i)
+        pthread_join(prod[i], NULL);
+
+    atomic_store(&done, 1);
+    pthread_join(consumer, NULL);
 
+    size_t dropped = al.dropped;
     sn_async_logger_deinit(&al);
 
-    printf("✓ passed\n");
+    assert(sink.count + dropped == PRODUCERS * MSGS_PER_PRODUCER);
+
+    // Records of a single producer stay in enqueue order
+    int last[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; ++i) last[i] = -1;
+
+    for (size_t i = 0; i < sink.count; ++i) {
+        uint64_t seq;
+        int thread_id, msg;
+        int fields = sscanf(sink.logs[i], "%lu t%d-%d", &seq, &thread_id, &msg);
+        assert(fields == 3);
+        assert(thread_id >= 0 && thread_id < PRODUCERS);
+        assert(msg > last[thread_id]);
+        last[thread_id] = msg;
+    }
+
+    printf("✓ passed (dropped=%zu)\n", dropped);
 }
 
-static void test_async_drain(void) {
-    printf("Running test_async_drain...\n");
+static void test_async_sharded_multi_producer(void) {
+    printf("Running test_async_sharded_multi_producer...\n");
 
-    char buffer[4096];
-    TestSink sink = {0};
+    enum {
+        PRODUCERS = 4,
+        SHARDS = 3,
+        CONSUMERS = 3,
+        MSGS_PER_PRODUCER = 5000
+    };
+
+    static char buffer[4096];
+    static char shard_buffer[SHARDS * 4096];
+    static TestSink sink;
+    sink.count = 0;
 
     snSink sinks[] = {
         {.write = test_sink_write, .data = &sink}
@@ -362,89 +655,2312 @@ static void test_async_drain(void) {
 
     snAsyncLogger al;
     sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_memory_hooks(&al, malloc_wrapper, free_wrapper, NULL);
 
-    for (int i = 0; i < 50; ++i)
-        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+    MutexCtx mctx;
+    pthread_mutex_init(&mctx.mutex, NULL);
+    sn_async_logger_set_lock_hooks(&al, lock_wrapper, unlock_wrapper, &mctx);
 
-    size_t drained = sn_async_logger_drain(&al);
+    // One producer has no shard and goes through the shared ring
+    snAsyncShard shards[SHARDS];
+    sn_async_logger_set_shards(&al, shards, SHARDS, shard_buffer, sizeof(shard_buffer));
 
-    assert(drained == 50);
-    assert(sink.count == 50);
+    pthread_t prod[PRODUCERS];
+    ProducerArgs pargs[PRODUCERS];
+
+    atomic_int done = 0;
+    ConsumerArgs cargs = {.logger = &al, .done = &done};
+    pthread_t consumers[CONSUMERS];
+
+    // Consumers take turns, records stay in order
+    for (int i = 0; i < CONSUMERS; ++i)
+        pthread_create(&consumers[i], NULL, consumer_thread, &cargs);
+
+    for (int i = 0; i < PRODUCERS; ++i) {
+        pargs[i] = (ProducerArgs){
+            .logger = &al,
+            .thread_id = i,
+            .count = MSGS_PER_PRODUCER
+        };
+        pthread_create(&prod[i], NULL, producer_thread, &pargs[i]);
+    }
+
+    for (int i = 0; i < PRODUCERS; ++i)
+        pthread_join(prod[i], NULL);
+
+    atomic_store(&done, 1);
+    for (int i = 0; i < CONSUMERS; ++i)
+        pthread_join(consumers[i], NULL);
 
+    assert(al.dropped == 0);
+    assert(sinks[0].records == PRODUCERS * MSGS_PER_PRODUCER && sinks[0].calls == sinks[0].records);
     sn_async_logger_deinit(&al);
+    pthread_mutex_destroy(&mctx.mutex);
+
+    assert(sink.count == PRODUCERS * MSGS_PER_PRODUCER);
+
+    int last[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; ++i) last[i] = -1;
+
+    for (size_t i = 0; i < sink.count; ++i) {
+        uint64_t seq;
+        int thread_id, msg;
+        int fields = sscanf(sink.logs[i], "%lu t%d-%d", &seq, &thread_id, &msg);
+        assert(fields == 3);
+        assert(thread_id >= 0 && thread_id < PRODUCERS);
+        assert(msg == last[thread_id] + 1);
+        last[thread_id] = msg;
+    }
 
     printf("✓ passed\n");
 }
 
-static void test_async_flush_only(void) {
-    printf("Running test_async_flush_only...\n");
+typedef struct {
+    snAsyncLogger *loggers;
+    size_t logger_count;
+} ShardLoggerArgs;
 
-    char buffer[4096];
-    FlushSink sink = {0};
+static void *shard_logger_thread(void *arg) {
+    ShardLoggerArgs *args = arg;
 
-    snSink sinks[] = {
-        {
-            .write = test_sink_write,
-            .flush = flush_sink_flush,
-            .data = &sink
-        }
-    };
+    // More loggers than thread cache entries, then the first one again
+    for (size_t i = 0; i <= args->logger_count; ++i)
+        sn_async_logger_log(&args->loggers[i % args->logger_count], SN_LOG_LEVEL_INFO, "logger %zu", i);
 
-    snAsyncLogger al;
-    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    return NULL;
+}
 
-    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "hello");
+static void test_async_shard_reclaim(void) {
+    printf("Running test_async_shard_reclaim...\n");
 
-    sn_async_logger_flush(&al);
+    enum { LOGGERS = 6, THREADS = 5 };
 
-    assert(sink.flush_count == 1);
-    assert(sink.base.count == 0); // NOT processed
+    static char buffers[LOGGERS][1024];
+    static char shard_buffers[LOGGERS][1024];
+    static TestSink sink;
+    sink.count = 0;
 
-    sn_async_logger_deinit(&al);
+    snSink sinks[] = {{.write = test_sink_write, .data = &sink}};
+    snAsyncLogger loggers[LOGGERS];
+    snAsyncShard shards[LOGGERS];
+    MutexCtx mctx[LOGGERS];
+
+    for (size_t i = 0; i < LOGGERS; ++i) {
+        sn_async_logger_init(&loggers[i], buffers[i], sizeof(buffers[i]), sinks, 1);
+        pthread_mutex_init(&mctx[i].mutex, NULL);
+        sn_async_logger_set_lock_hooks(&loggers[i], lock_wrapper, unlock_wrapper, &mctx[i]);
+        sn_async_logger_set_shards(&loggers[i], &shards[i], 1, shard_buffers[i], sizeof(shard_buffers[i]));
+    }
+
+    // Each thread takes the single shard of every logger, keeps it across
+    // cache evictions and gives it back when it exits
+    ShardLoggerArgs args = {.loggers = loggers, .logger_count = LOGGERS};
+    for (int t = 0; t < THREADS; ++t) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, shard_logger_thread, &args);
+        pthread_join(thread, NULL);
+
+        for (size_t i = 0; i < LOGGERS; ++i) {
+            assert(loggers[i].shard_claimed == (size_t)t + 1);
+            assert(loggers[i].shard_released == (size_t)t + 1);
+            assert(shards[i].owner == 0);
+        }
+    }
+
+    for (size_t i = 0; i < LOGGERS; ++i) {
+        // Records of the exited threads are all in the shard
+        assert(loggers[i].write_offset == 0);
+        size_t drained = sn_async_logger_drain(&loggers[i]);
+        assert(drained == (i == 0 ? 2u : 1u) * THREADS);
+        sn_async_logger_deinit(&loggers[i]);
+        pthread_mutex_destroy(&mctx[i].mutex);
+    }
+
+    assert(sink.count == (LOGGERS + 1) * THREADS);
 
     printf("✓ passed\n");
 }
 
-static void test_async_drain_and_flush(void) {
-    printf("Running test_async_drain_and_flush...\n");
+static void test_async_deferred_formatting(void) {
+    printf("Running test_async_deferred_formatting...\n");
 
     char buffer[4096];
-    FlushSink sink = {0};
+    char format_buffer[LINE_LEN];
+    static LineSink sink;
+    sink.count = 0;
 
     snSink sinks[] = {
-        {
-            .write = test_sink_write,
-            .flush = flush_sink_flush,
-            .data = &sink
-        }
+        {.write = line_sink_write, .data = &sink}
     };
 
     snAsyncLogger al;
     sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+
+    char name[] = "world";
+    char unterminated[3] = {'a', 'b', 'c'};
+    int n = 0;
+
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "plain message");
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "hello %s, %-8s|%5.2s|", name, name, name);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "%d %u %ld %lu %llu %zu %x %#o %c %%",
+            -42, 42u, -1234567L, 1234567UL, 123456789012345ULL, (size_t)77, 0xbeefu, 8u, 'z');
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "%f %.3f %g %e %10.4f", 3.5, 2.0 / 3.0, 1e-5, 12345.678, -1.25);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "%*d|%-*d|%.*s|%.*f", 6, 12, 4, 3, 2, unterminated, 2, 1.0 / 3.0);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "%s %p", (char *)NULL, (void *)&al);
+    // Not capturable, formatted eagerly
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "count%n %d", &n, 5);
+
+    // The copy must not depend on the original string
+    strcpy(name, "xxxxx");
+
+    sn_async_logger_drain(&al);
+    assert(al.dropped == 0);
+
+    char expected[7][LINE_LEN];
+    snprintf(expected[0], LINE_LEN, "plain message");
+    snprintf(expected[1], LINE_LEN, "hello %s, %-8s|%5.2s|", "world", "world", "world");
+    snprintf(expected[2], LINE_LEN, "%d %u %ld %lu %llu %zu %x %#o %c %%",
+            -42, 42u, -1234567L, 1234567UL, 123456789012345ULL, (size_t)77, 0xbeefu, 8u, 'z');
+    snprintf(expected[3], LINE_LEN, "%f %.3f %g %e %10.4f", 3.5, 2.0 / 3.0, 1e-5, 12345.678, -1.25);
+    snprintf(expected[4], LINE_LEN, "%*d|%-*d|%.*s|%.*f", 6, 12, 4, 3, 2, "ab", 2, 1.0 / 3.0);
+    snprintf(expected[5], LINE_LEN, "%s %p", (char *)NULL, (void *)&al);
+    snprintf(expected[6], LINE_LEN, "count %d", 5);
 
-    for (int i = 0; i < 10; ++i)
-        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+    assert(sink.count == 7);
+    for (size_t i = 0; i < sink.count; ++i)
+        assert(strcmp(sink.logs[i], expected[i]) == 0);
 
-    sn_async_logger_drain_and_flush(&al);
+    // An empty buffer disables deferred formatting
+    sn_async_logger_set_deferred_formatting(&al, format_buffer, 0);
+    assert(al.format_buffer == NULL);
 
-    assert(sink.base.count == 10);
-    assert(sink.flush_count == 1);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "hello %s", name);
+    sn_async_logger_drain(&al);
+    assert(sink.count == 8 && strcmp(sink.logs[7], "hello xxxxx") == 0);
 
     sn_async_logger_deinit(&al);
 
     printf("✓ passed\n");
 }
 
-int main(void) {
-    test_static_basic();
-    test_static_truncation();
-    test_static_log_level();
+typedef struct {
+    LineSink lines;
+    size_t calls;
+    uint64_t last_sequence;
+} BatchSink;
+
+static void batch_sink_write_batch(const snSinkRecord *records, size_t count, void *data) {
+    BatchSink *sink = data;
+
+    assert(count > 0 && count <= SN_ASYNC_LOGGER_BATCH_SIZE);
+    ++sink->calls;
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(records[i].sequence > sink->last_sequence);
+        sink->last_sequence = records[i].sequence;
+        line_sink_write(records[i].msg, records[i].len, records[i].level, &sink->lines);
+    }
+}
+
+static void test_async_write_batch(void) {
+    printf("Running test_async_write_batch...\n");
+
+    for (int deferred = 0; deferred < 2; ++deferred) {
+        char buffer[4096];
+        // Only fits a few messages, batches are delivered in parts
+        char format_buffer[40];
+        static BatchSink batch;
+        static LineSink lines;
+        memset(&batch, 0, sizeof(batch));
+        memset(&lines, 0, sizeof(lines));
+
+        snSink sinks[] = {
+            {.write_batch = batch_sink_write_batch, .data = &batch},
+            {.write = line_sink_write, .data = &lines},
+        };
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 2);
+        if (deferred) sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+
+        for (int i = 0; i < 50; ++i)
+            sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "message %d", i);
+
+        size_t processed = sn_async_logger_process_n(&al, 5);
+        assert(processed == 5);
+        assert(batch.lines.count == 5 && lines.count == 5);
+        assert(batch.calls == (deferred ? 2u : 1u));
+
+        size_t drained = sn_async_logger_drain(&al);
+        assert(drained == 45);
+        assert(al.dropped == 0);
+
+        assert(batch.lines.count == 50 && lines.count == 50);
+        assert(batch.calls < 50);
+        for (int i = 0; i < 50; ++i) {
+            char expected[LINE_LEN];
+            snprintf(expected, sizeof(expected), "message %d", i);
+            assert(strcmp(batch.lines.logs[i], expected) == 0);
+            assert(strcmp(lines.logs[i], expected) == 0);
+        }
+
+        sn_async_logger_deinit(&al);
+    }
+
+    printf("✓ passed\n");
+}
+
+static void test_sink_levels(void) {
+    printf("Running test_sink_levels...\n");
+
+    static LineSink all, errors, holes;
+    static BatchSink batch;
+
+    for (int async = 0; async < 2; ++async) {
+        memset(&all, 0, sizeof(all));
+        memset(&errors, 0, sizeof(errors));
+        memset(&holes, 0, sizeof(holes));
+        memset(&batch, 0, sizeof(batch));
+
+        snSink sinks[] = {
+            {.write = line_sink_write, .data = &all},
+            {.write = line_sink_write, .data = &errors},
+            {.write = line_sink_write, .data = &holes},
+            // Static records carry no sequence, the batch sink checks them
+            async ? (snSink){.write_batch = batch_sink_write_batch, .data = &batch}
+                  : (snSink){.write = line_sink_write, .data = &batch.lines},
+        };
+        sn_sink_set_min_level(&sinks[0], SN_LOG_LEVEL_INFO);
+        sn_sink_set_min_level(&sinks[1], SN_LOG_LEVEL_ERROR);
+        sn_sink_set_levels(&sinks[2], SN_LOG_LEVEL_BIT(SN_LOG_LEVEL_DEBUG) | SN_LOG_LEVEL_BIT(SN_LOG_LEVEL_ERROR));
+        sn_sink_set_levels(&sinks[3], SN_LOG_LEVEL_BIT(SN_LOG_LEVEL_WARN));
+        assert(sn_sinks_min_level(sinks, 4) == SN_LOG_LEVEL_DEBUG);
+
+        char buffer[4096];
+        snAsyncLogger al;
+        snStaticLogger sl;
+        snLogLevel level;
+
+        if (async) {
+            sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 4);
+            level = al.level;
+        } else {
+            sn_static_logger_init(&sl, buffer, STATIC_BUF_SIZE, sinks, 4);
+            level = sl.level;
+        }
+
+        // Nobody wants TRACE, it is rejected before formatting
+        assert(level == SN_LOG_LEVEL_DEBUG);
+
+        for (int l = SN_LOG_LEVEL_TRACE; l <= SN_LOG_LEVEL_FATAL; ++l) {
+            if (async) {
+                sn_async_logger_log(&al, (snLogLevel)l, "level %d", l);
+            } else {
+                sn_static_logger_log(&sl, (snLogLevel)l, "level %d", l);
+            }
+        }
+
+        if (async) {
+            snAsyncLoggerStats stats;
+            sn_async_logger_get_stats(&al, &stats);
+            assert(stats.enqueued[SN_LOG_LEVEL_TRACE] == 0 && stats.enqueued[SN_LOG_LEVEL_DEBUG] == 1);
+            size_t drained = sn_async_logger_drain(&al);
+            assert(drained == 5);
+        }
+
+        assert(all.count == 4 && strcmp(all.logs[0], "level 2") == 0);
+        assert(errors.count == 2 && strcmp(errors.logs[0], "level 4") == 0);
+        assert(holes.count == 2 && strcmp(holes.logs[0], "level 1") == 0 && strcmp(holes.logs[1], "level 4") == 0);
+        assert(sinks[0].records == 4 && sinks[1].records == 2 && sinks[2].records == 2);
+        assert(batch.lines.count == 1 && strcmp(batch.lines.logs[0], "level 3") == 0);
+
+        // The requested level still applies, and follows sink changes
+        if (async) {
+            sn_async_logger_set_level(&al, SN_LOG_LEVEL_WARN);
+            assert(al.level == SN_LOG_LEVEL_WARN);
+            sn_sink_set_levels(&sinks[2], 0);
+            sn_async_logger_set_level(&al, SN_LOG_LEVEL_TRACE);
+            assert(al.level == SN_LOG_LEVEL_TRACE);
+            sn_sink_set_min_level(&sinks[2], SN_LOG_LEVEL_FATAL);
+            sn_async_logger_refresh_level(&al);
+            assert(al.level == SN_LOG_LEVEL_INFO);
+            sn_async_logger_deinit(&al);
+        } else {
+            sn_static_logger_set_level(&sl, SN_LOG_LEVEL_WARN);
+            assert(sl.level == SN_LOG_LEVEL_WARN);
+            sn_sink_set_levels(&sinks[2], 0);
+            sn_static_logger_refresh_level(&sl);
+            assert(sl.level == SN_LOG_LEVEL_WARN);
+            sn_static_logger_set_level(&sl, SN_LOG_LEVEL_TRACE);
+            assert(sl.level == SN_LOG_LEVEL_TRACE);
+            sn_static_logger_deinit(&sl);
+        }
+    }
+
+    // Deferred records are delivered to the sinks accepting them only
+    char buffer[4096];
+    char format_buffer[256];
+    memset(&all, 0, sizeof(all));
+    memset(&errors, 0, sizeof(errors));
+
+    snSink sinks[] = {
+        {.write = line_sink_write, .data = &all},
+        {.write = line_sink_write, .data = &errors, .levels = SN_LOG_LEVELS_FROM(SN_LOG_LEVEL_ERROR)},
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 2);
+    sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, i % 10 ? SN_LOG_LEVEL_INFO : SN_LOG_LEVEL_ERROR, "deferred %d", i);
+
+    size_t drained = sn_async_logger_drain(&al);
+    assert(drained == 100);
+    assert(all.count == LINE_LOGS && errors.count == 10);
+    for (int i = 0; i < 10; ++i) {
+        char expected[LINE_LEN];
+        snprintf(expected, sizeof(expected), "deferred %d", i * 10);
+        assert(strcmp(errors.logs[i], expected) == 0);
+    }
+
+    sn_async_logger_deinit(&al);
+
+    printf("✓ passed\n");
+}
+
+static void len_sink_write(const char *msg, size_t len, snLogLevel level, void *data) {
+    (void)msg;
+    (void)level;
+    *(size_t *)data = len;
+}
+
+typedef struct {
+    snAsyncLogger *logger;
+    size_t sink;
+    atomic_int *done;
+} SinkConsumerArgs;
+
+static void *sink_consumer_thread(void *arg) {
+    SinkConsumerArgs *args = arg;
+
+    while (!atomic_load(args->done))
+        sn_async_logger_process_sink_n(args->logger, args->sink, SN_ASYNC_LOGGER_BATCH_SIZE);
+
+    while (sn_async_logger_process_sink_n(args->logger, args->sink, SIZE_MAX));
+    return NULL;
+}
+
+static void test_sink_cursors(void) {
+    printf("Running test_sink_cursors...\n");
+
+    char buffer[1024];
+    static TestSink fast, slow;
+    memset(&fast, 0, sizeof(fast));
+    memset(&slow, 0, sizeof(slow));
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &fast},
+        {.write = test_sink_write, .data = &slow},
+    };
+    snAsyncSinkCursor cursors[2];
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 2);
+    sn_async_logger_set_sink_cursors(&al, cursors, 0);
+
+    for (int i = 0; i < 10; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "m %d", i);
+
+    // The ring space is released once both sinks wrote the records
+    uint64_t records;
+    size_t processed = sn_async_logger_process_sink_n(&al, 0, SIZE_MAX);
+    assert(processed == 10);
+    assert(fast.count == 10 && slow.count == 0);
+    assert(sn_async_logger_sink_lag(&al, 0, &records) == 0 && records == 0);
+    assert(sn_async_logger_sink_lag(&al, 1, &records) == al.write_offset && records == 10);
+    assert(al.read_offset == 0);
+
+    processed = sn_async_logger_process_sink_n(&al, 1, 4);
+    assert(processed == 4);
+    assert(sn_async_logger_sink_lag(&al, 1, &records) > 0 && records == 6);
+    assert(al.read_offset == cursors[1].read_offset && al.read_offset > 0);
+
+    processed = sn_async_logger_process_n(&al, SIZE_MAX);
+    assert(processed == 6);
+    assert(fast.count == 10 && slow.count == 10);
+    assert(al.read_offset == al.write_offset);
+    for (int i = 0; i < 10; ++i) {
+        char expected[MAX_LEN];
+        snprintf(expected, sizeof(expected), "m %d", i);
+        assert(strcmp(fast.logs[i], expected) == 0 && strcmp(slow.logs[i], expected) == 0);
+    }
+
+    // A stalled sink holds the ring, the fast one alone does not free space
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "m %d", i);
+
+    size_t dropped = al.dropped;
+    assert(dropped > 0);
+    sn_async_logger_process_sink_n(&al, 0, SIZE_MAX);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "full");
+    assert(al.dropped == dropped + 1);
+
+    size_t drained = sn_async_logger_drain(&al);
+    assert(drained == 100 - dropped);
+    assert(fast.count == slow.count);
+    sn_async_logger_deinit(&al);
+
+    // A sink lagging beyond the threshold is detached, the others keep going
+    memset(&fast, 0, sizeof(fast));
+    memset(&slow, 0, sizeof(slow));
+
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 2);
+    sn_async_logger_set_sink_cursors(&al, cursors, 256);
+
+    for (int i = 0; i < 20; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "m %d", i);
+
+    processed = sn_async_logger_process_sink_n(&al, 0, SIZE_MAX);
+    assert(processed == 20);
+    assert(cursors[1].detached && cursors[1].detaches == 1);
+    assert(al.read_offset == al.write_offset);
+    assert(sn_async_logger_sink_lag(&al, 1, &records) == 0 && records == 0);
+    processed = sn_async_logger_process_sink_n(&al, 1, SIZE_MAX);
+    assert(processed == 0);
+
+    for (int i = 0; i < 100; ++i) {
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "m %d", i);
+        sn_async_logger_process_n(&al, SIZE_MAX);
+    }
+    assert(al.dropped == 0 && fast.count == 120 && slow.count == 0);
+
+    sn_async_logger_attach_sink(&al, 1);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "again");
+    drained = sn_async_logger_drain(&al);
+    assert(drained == 1);
+    assert(slow.count == 1 && strcmp(slow.logs[0], "again") == 0);
+    sn_async_logger_deinit(&al);
+
+    // Only the sinks formatting messages share the format buffer
+    size_t text_len = 0;
+    size_t deferred_len = 1;
+    char format_buffer[2 * SN_ASYNC_SINK_FORMAT_MIN];
+    char long_arg[SN_ASYNC_SINK_FORMAT_MIN + 32];
+    memset(long_arg, 'a', sizeof(long_arg) - 1);
+    long_arg[sizeof(long_arg) - 1] = 0;
+
+    snSink mixed[] = {
+        {.write = len_sink_write, .data = &text_len},
+        {.write = len_sink_write, .data = &deferred_len, .flags = SN_SINK_DEFERRED},
+    };
+
+    sn_async_logger_init(&al, buffer, sizeof(buffer), mixed, 2);
+    sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+    sn_async_logger_set_sink_cursors(&al, cursors, 0);
+
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "%s", long_arg);
+    drained = sn_async_logger_drain(&al);
+    assert(drained == 1);
+    assert(text_len == strlen(long_arg) && deferred_len == 0);
+    sn_async_logger_deinit(&al);
+
+    // One thread per sink
+    enum { MSGS = 5000 };
+
+    memset(&fast, 0, sizeof(fast));
+    memset(&slow, 0, sizeof(slow));
+
+    char mt_buffer[4096];
+    sn_async_logger_init(&al, mt_buffer, sizeof(mt_buffer), sinks, 2);
+    sn_async_logger_set_sink_cursors(&al, cursors, 0);
+
+    MutexCtx mctx;
+    pthread_mutex_init(&mctx.mutex, NULL);
+    sn_async_logger_set_lock_hooks(&al, lock_wrapper, unlock_wrapper, &mctx);
+
+    atomic_int done = 0;
+    SinkConsumerArgs args[2];
+    pthread_t consumers[2];
+    for (size_t i = 0; i < 2; ++i) {
+        args[i] = (SinkConsumerArgs){.logger = &al, .sink = i, .done = &done};
+        pthread_create(&consumers[i], NULL, sink_consumer_thread, &args[i]);
+    }
+
+    for (int i = 0; i < MSGS; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "%d", i);
+
+    atomic_store(&done, 1);
+    for (size_t i = 0; i < 2; ++i)
+        pthread_join(consumers[i], NULL);
+
+    sn_async_logger_drain(&al);
+    assert(al.read_offset == al.write_offset);
+    assert(fast.count == MSGS - al.dropped && slow.count == fast.count);
+    for (size_t i = 0; i < fast.count; ++i)
+        assert(strcmp(fast.logs[i], slow.logs[i]) == 0);
+
+    sn_async_logger_deinit(&al);
+    pthread_mutex_destroy(&mctx.mutex);
+
+    printf("✓ passed\n");
+}
+
+static void *test_alloc(size_t size, size_t align, void *data) {
+    (void)align;
+    ++*(int *)data;
+    return malloc(size);
+}
+
+static void test_free(void *ptr, void *data) {
+    --*(int *)data;
+    free(ptr);
+}
+
+static size_t read_file(FILE *file, char *out, size_t size) {
+    fflush(file);
+    ssize_t n = pread(fileno(file), out, size - 1, 0);
+    assert(n >= 0);
+    out[n] = 0;
+    return (size_t)n;
+}
+
+static void test_async_overflow_segments(void) {
+    printf("Running test_async_overflow_segments...\n");
+
+    char buffer[512];
+    static TestSink sink;
+    sink.count = 0;
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    int allocations = 0;
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_memory_hooks(&al, test_alloc, test_free, &allocations);
+
+    // Records share segments, a new one is linked when the last is full
+    int logged = 0;
+    for (; logged < 3000; ++logged)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", logged);
+
+    assert(al.dropped == 0);
+    assert(allocations == 2 && al.segment_count == 2 && al.segment_high_watermark == 2);
+
+    // Freed ring space is used again while the segments are consumed
+    size_t processed = sn_async_logger_process_n(&al, 100);
+    assert(processed == 100);
+    for (int i = 0; i < 10; ++i, ++logged)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", logged);
+    assert(allocations == 2);
+
+    size_t drained = sn_async_logger_drain(&al);
+    assert(drained == (size_t)logged - 100);
+
+    // The last drained segment is kept as a spare
+    assert(allocations == 1 && al.segment_count == 1 && al.segment_spare && !al.segment_head);
+
+    for (int i = 0; i < 1000; ++i, ++logged)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", logged);
+    assert(allocations == 1 && !al.segment_spare);
+    sn_async_logger_drain(&al);
+
+    // Larger than a segment, gets a segment of its own
+    static char large[SN_ASYNC_SEGMENT_SIZE + 100];
+    memset(large, 'z', sizeof(large));
+    sn_async_logger_log_raw(&al, SN_LOG_LEVEL_INFO, large, sizeof(large));
+    assert(allocations == 2 && al.segment_count == 2);
+
+    sn_async_logger_drain(&al);
+    assert(allocations == 1 && al.segment_count == 1);
+    assert(al.dropped == 0);
+
+    assert(sink.count == (size_t)logged + 1);
+    for (int i = 0; i < logged; ++i) {
+        char expected[MAX_LEN];
+        snprintf(expected, sizeof(expected), "msg-%d", i);
+        assert(strcmp(sink.logs[i], expected) == 0);
+    }
+
+    sn_async_logger_deinit(&al);
+    assert(allocations == 0);
+
+    printf("✓ passed\n");
+}
+
+typedef struct {
+    snAsyncLogger *logger;
+    atomic_int *done;
+    size_t scrapes;
+} ScraperArgs;
+
+static void *stats_scraper_thread(void *arg) {
+    ScraperArgs *sa = arg;
+
+    // Counters only grow while records flow
+    snAsyncLoggerStats previous = {0};
+    while (!atomic_load(sa->done)) {
+        snAsyncLoggerStats stats;
+        sn_async_logger_get_stats(sa->logger, &stats);
+
+        assert(stats.enqueued[SN_LOG_LEVEL_INFO] >= previous.enqueued[SN_LOG_LEVEL_INFO]);
+        assert(stats.processed[SN_LOG_LEVEL_INFO] >= previous.processed[SN_LOG_LEVEL_INFO]);
+        assert(stats.ring_used <= stats.ring_size && stats.ring_high_watermark <= stats.ring_size);
+
+        previous = stats;
+        ++sa->scrapes;
+    }
+    return NULL;
+}
+
+static void test_async_stats(void) {
+    printf("Running test_async_stats...\n");
+
+    char buffer[512];
+    static TestSink sink;
+    sink.count = 0;
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    int allocations = 0;
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+    snAsyncLoggerStats stats;
+    sn_async_logger_get_stats(&al, &stats);
+    assert(stats.ring_size == sizeof(buffer) && stats.ring_used == 0 && stats.pending == 0);
+
+    for (int i = 0; i < 5; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "info-%d", i);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_ERROR, "error");
+
+    sn_async_logger_get_stats(&al, &stats);
+    assert(stats.enqueued[SN_LOG_LEVEL_INFO] == 5 && stats.enqueued[SN_LOG_LEVEL_ERROR] == 1);
+    assert(stats.pending == 6 && stats.ring_used > 0 && stats.ring_high_watermark == stats.ring_used);
+
+    // The ring fills up, the records that do not fit are dropped
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_DEBUG, "debug-%d", i);
+
+    sn_async_logger_get_stats(&al, &stats);
+    assert(stats.dropped[SN_LOG_LEVEL_DEBUG] > 0 && stats.dropped[SN_LOG_LEVEL_INFO] == 0);
+    assert(stats.dropped_total == stats.dropped[SN_LOG_LEVEL_DEBUG]);
+    assert(stats.enqueued[SN_LOG_LEVEL_DEBUG] + stats.dropped[SN_LOG_LEVEL_DEBUG] == 100);
+
+    size_t processed = sn_async_logger_drain(&al);
+
+    sn_async_logger_get_stats(&al, &stats);
+    assert(stats.processed[SN_LOG_LEVEL_INFO] == 5 && stats.processed[SN_LOG_LEVEL_ERROR] == 1);
+    assert(stats.processed[SN_LOG_LEVEL_DEBUG] == stats.enqueued[SN_LOG_LEVEL_DEBUG]);
+    assert(stats.pending == 0 && stats.ring_used == 0);
+    assert(stats.batch_max_records == SN_ASYNC_LOGGER_BATCH_SIZE || stats.batch_max_records == processed);
+    assert(stats.sink_calls == processed && stats.sink_records == processed);
+    assert(sinks[0].calls == processed && sinks[0].records == processed);
+
+    // Wrapping around the ring, then into overflow segments
+    sn_async_logger_set_memory_hooks(&al, test_alloc, test_free, &allocations);
+    for (int i = 0; i < 100; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "info-%d", i);
+
+    sn_async_logger_get_stats(&al, &stats);
+    assert(stats.wraps == 1 && stats.ring_high_watermark > sizeof(buffer) / 2);
+    assert(stats.overflow_records > 0 && stats.overflow_bytes >= stats.overflow_records * sizeof(snLogRecordHeader));
+    assert(stats.segment_count == 1 && stats.segment_high_watermark == 1);
+    assert(stats.enqueued[SN_LOG_LEVEL_INFO] == 105 && stats.dropped[SN_LOG_LEVEL_INFO] == 0);
+
+    sn_async_logger_drain(&al);
+    sn_async_logger_deinit(&al);
+
+    // Scraped from another thread while producers and a consumer run
+    enum {
+        PRODUCERS = 2,
+        MSGS_PER_PRODUCER = 2000
+    };
+
+    char ring[4096];
+    sink.count = 0;
+    sinks[0] = (snSink){.write = test_sink_write, .data = &sink};
+
+    for (int lock_free = 0; lock_free < 2; ++lock_free) {
+        sn_async_logger_init(&al, ring, sizeof(ring), sinks, 1);
+        sn_async_logger_set_lock_free(&al, lock_free);
+        sn_async_logger_set_backpressure(&al, SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_YIELD);
+
+        MutexCtx mctx;
+        pthread_mutex_init(&mctx.mutex, NULL);
+        sn_async_logger_set_lock_hooks(&al, lock_wrapper, unlock_wrapper, &mctx);
+
+        atomic_int done = 0;
+        atomic_int scraping = 0;
+        ConsumerArgs cargs = {.logger = &al, .done = &done};
+        ScraperArgs sargs = {.logger = &al, .done = &scraping};
+        pthread_t consumer, scraper;
+
+        pthread_create(&consumer, NULL, consumer_thread, &cargs);
+        pthread_create(&scraper, NULL, stats_scraper_thread, &sargs);
+
+        pthread_t prod[PRODUCERS];
+        ProducerArgs pargs[PRODUCERS];
+        for (int i = 0; i < PRODUCERS; ++i) {
+            pargs[i] = (ProducerArgs){.logger = &al, .thread_id = i, .count = MSGS_PER_PRODUCER};
+            pthread_create(&prod[i], NULL, producer_thread, &pargs[i]);
+        }
+
+        for (int i = 0; i < PRODUCERS; ++i)
+            pthread_join(prod[i], NULL);
+
+        atomic_store(&done, 1);
+        pthread_join(consumer, NULL);
+        atomic_store(&scraping, 1);
+        pthread_join(scraper, NULL);
+
+        sn_async_logger_get_stats(&al, &stats);
+        assert(stats.enqueued[SN_LOG_LEVEL_INFO] == PRODUCERS * MSGS_PER_PRODUCER);
+        assert(stats.processed[SN_LOG_LEVEL_INFO] == PRODUCERS * MSGS_PER_PRODUCER);
+        assert(stats.dropped_total == 0 && stats.pending == 0 && stats.ring_used == 0);
+        assert(stats.wraps > 0 && stats.batch_max_records > 0);
+
+        sn_async_logger_deinit(&al);
+        pthread_mutex_destroy(&mctx.mutex);
+    }
+
+    assert(allocations == 0);
+
+    printf("✓ passed\n");
+}
+
+static void test_file_sink(void) {
+    printf("Running test_file_sink...\n");
+
+    static char contents[16384];
+    static char expected[16384];
+
+    // Batches go to the buffer, the buffer is written once full
+    {
+        FILE *file = tmpfile();
+        assert(file);
+
+        char file_buffer[256];
+        snFileSink file_sink;
+        sn_file_sink_init(&file_sink, fileno(file), file_buffer, sizeof(file_buffer));
+
+        char buffer[8192];
+        snSink sinks[] = {sn_file_sink(&file_sink)};
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+        size_t expected_len = 0;
+        for (int i = 0; i < 100; ++i) {
+            sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "record %d", i);
+            expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "record %d\n", i);
+        }
+
+        sn_async_logger_drain(&al);
+        assert(file_sink.syscalls > 0 && file_sink.syscalls < 10);
+        assert(file_sink.bytes_written + file_sink.used == expected_len);
+
+        sn_async_logger_flush(&al);
+        assert(file_sink.used == 0 && file_sink.bytes_written == expected_len);
+        assert(file_sink.errors == 0);
+
+        size_t file_len = read_file(file, contents, sizeof(contents));
+        assert(file_len == expected_len);
+        assert(strcmp(contents, expected) == 0);
+
+        // Larger than the buffer, written with the buffered data in one call
+        char large[600];
+        memset(large, 'x', sizeof(large) - 1);
+        large[sizeof(large) - 1] = 0;
+
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "small");
+        sn_async_logger_drain(&al);
+        assert(file_sink.used == 6);
+
+        uint64_t syscalls = file_sink.syscalls;
+        sn_async_logger_log_raw(&al, SN_LOG_LEVEL_INFO, large, sizeof(large) - 1);
+        sn_async_logger_drain(&al);
+        assert(file_sink.syscalls == syscalls + 1 && file_sink.used == 0);
+
+        expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "small\n%s\n", large);
+        file_len = read_file(file, contents, sizeof(contents));
+        assert(file_len == expected_len);
+        assert(strcmp(contents, expected) == 0);
+
+        sn_async_logger_deinit(&al);
+        sn_file_sink_deinit(&file_sink);
+        fclose(file);
+    }
+
+    // Record threshold, allocated buffer and the static logger
+    {
+        FILE *file = tmpfile();
+        assert(file);
+
+        int allocations = 0;
+        snFileSink file_sink;
+        bool initialized = sn_file_sink_init_alloc(&file_sink, fileno(file), 4096, test_alloc, test_free, &allocations);
+        assert(initialized);
+        assert(allocations == 1);
+        sn_file_sink_set_thresholds(&file_sink, 0, 4);
+        sn_file_sink_set_sync(&file_sink, true);
+
+        char buffer[STATIC_BUF_SIZE];
+        snSink sinks[] = {sn_file_sink(&file_sink)};
+
+        snStaticLogger sl;
+        sn_static_logger_init(&sl, buffer, sizeof(buffer), sinks, 1);
+
+        for (int i = 0; i < 10; ++i)
+            sn_static_logger_log(&sl, SN_LOG_LEVEL_INFO, "static %d", i);
+
+        assert(file_sink.syscalls == 2 && file_sink.used == strlen("static 8\nstatic 9\n"));
+
+        // Write and sync
+        sn_static_logger_flush(&sl);
+        assert(file_sink.syscalls == 4 && file_sink.errors == 0);
+        size_t file_len = read_file(file, contents, sizeof(contents));
+        assert(file_len == file_sink.bytes_written);
+        assert(strncmp(contents, "static 0\nstatic 1\n", 18) == 0);
+
+        sn_static_logger_deinit(&sl);
+        sn_file_sink_deinit(&file_sink);
+        assert(allocations == 0);
+        fclose(file);
+    }
+
+    printf("✓ passed\n");
+}
+
+static uint64_t binary_read_varint(const unsigned char *data, size_t *offset) {
+    uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        unsigned char byte = data[(*offset)++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
+
+/**
+ * Decode a binary log file into newline terminated messages.
+ */
+static size_t binary_decode(const unsigned char *data, size_t size, char *out, size_t out_size, size_t *text_records) {
+    static char fmts[16][LINE_LEN];
+    size_t fmt_count = 0;
+    size_t len = 0;
+    uint64_t sequence = 0;
+
+    assert(size >= SN_BINARY_HEADER_SIZE && memcmp(data, SN_BINARY_MAGIC, 4) == 0 && data[4] == SN_BINARY_VERSION);
+    *text_records = 0;
+
+    size_t offset = SN_BINARY_HEADER_SIZE;
+    while (offset < size) {
+        unsigned tag = data[offset++];
+        unsigned type = tag & 0x3u;
+
+        if (type == SN_BINARY_RECORD_DESCRIPTOR) {
+            uint64_t id = binary_read_varint(data, &offset);
+            assert(id == fmt_count);
+            binary_read_varint(data, &offset);
+            // File and function
+            for (int i = 0; i < 2; ++i)
+                offset += binary_read_varint(data, &offset);
+
+            size_t fmt_len = binary_read_varint(data, &offset);
+            assert(fmt_count < 16 && fmt_len < LINE_LEN);
+            memcpy(fmts[fmt_count], data + offset, fmt_len);
+            fmts[fmt_count++][fmt_len] = 0;
+            offset += fmt_len;
+            continue;
+        }
+
+        // Sequence numbers grow by one per record
+        uint64_t delta = binary_read_varint(data, &offset);
+        sequence += (delta >> 1) ^ (0 - (delta & 1));
+        assert(delta == 2);
+        // No clock
+        uint64_t timestamp = binary_read_varint(data, &offset);
+        assert(timestamp == 0);
+
+        if (type == SN_BINARY_RECORD_ARGS) {
+            uint64_t id = binary_read_varint(data, &offset);
+            size_t args_size = binary_read_varint(data, &offset);
+            assert(id < fmt_count);
+
+            size_t n = sn_binary_format(out + len, out_size - len, fmts[id], data + offset, args_size);
+            assert(n != (size_t)-1 && len + n < out_size);
+            len += n;
+            offset += args_size;
+        } else {
+            assert(type == SN_BINARY_RECORD_TEXT);
+            size_t n = binary_read_varint(data, &offset);
+            assert(len + n < out_size);
+            memcpy(out + len, data + offset, n);
+            len += n;
+            offset += n;
+            ++*text_records;
+        }
+
+        out[len++] = '\n';
+        assert(offset <= size);
+    }
+
+    out[len] = 0;
+    return len;
+}
+
+static void test_binary_sink(void) {
+    printf("Running test_binary_sink...\n");
+
+    static char contents[65536];
+    static char expected[65536];
+    static char decoded[65536];
+
+    for (int deferred = 0; deferred < 2; ++deferred) {
+        FILE *binary_file = tmpfile();
+        FILE *text_file = tmpfile();
+        assert(binary_file && text_file);
+
+        char binary_buffer[512];
+        char text_buffer[512];
+        snFileSink binary_out;
+        snFileSink text_out;
+        sn_file_sink_init(&binary_out, fileno(binary_file), binary_buffer, sizeof(binary_buffer));
+        sn_file_sink_init(&text_out, fileno(text_file), text_buffer, sizeof(text_buffer));
+
+        static snBinarySink binary;
+        sn_binary_sink_init(&binary, &binary_out);
+
+        char buffer[8192];
+        char format_buffer[1024];
+        snSink sinks[] = {sn_binary_sink(&binary), sn_file_sink(&text_out)};
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 2);
+        if (deferred) sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+
+        int n = 0;
+        for (int i = 0; i < 200; ++i) {
+            SN_ALOG_INFO(&al, "request %d from %s took %.3f ms (status %u, %c, %lld)",
+                    i, "10.20.30.40", i * 0.125, 200u, 'a' + i % 26, -1000000000000LL * i);
+            if (i % 50 == 0) {
+                sn_async_logger_log(&al, SN_LOG_LEVEL_WARN, "plain %d %s %p|%*d", -i, (char *)NULL, (void *)&al, 5, i);
+                SN_ALOG_ERROR(&al, "no arguments");
+                // Not capturable, formatted eagerly and stored as text
+                SN_ALOG_WARN(&al, "count%n %d", &n, i);
+            }
+            if (i % 20 == 0) sn_async_logger_drain(&al);
+        }
+
+        sn_async_logger_drain(&al);
+        sn_async_logger_flush(&al);
+        assert(al.dropped == 0);
+        assert(binary_out.errors == 0 && binary_out.used == 0);
+        assert(binary.records == 212);
+        assert(binary.text_records == (deferred ? 4u : 212u));
+        assert(binary.descriptor_count == (deferred ? 3u : 0u));
+
+        size_t expected_len = read_file(text_file, expected, sizeof(expected));
+        size_t binary_len = read_file(binary_file, contents, sizeof(contents));
+        assert(binary_len == binary_out.bytes_written);
+
+        size_t text_records;
+        size_t decoded_len = binary_decode((const unsigned char *)contents, binary_len, decoded, sizeof(decoded), &text_records);
+        assert(text_records == binary.text_records);
+        assert(decoded_len == expected_len && strcmp(decoded, expected) == 0);
+
+        // Arguments take less space than the messages
+        if (deferred) assert(binary_len * 2 < expected_len);
+
+        sn_async_logger_deinit(&al);
+        sn_file_sink_deinit(&binary_out);
+        sn_file_sink_deinit(&text_out);
+        fclose(binary_file);
+        fclose(text_file);
+    }
+
+    // Mismatched arguments are rejected
+    char out[64];
+    unsigned char args[] = {0x80};
+    size_t formatted = sn_binary_format(out, sizeof(out), "%d", args, sizeof(args));
+    assert(formatted == (size_t)-1);
+    formatted = sn_binary_format(out, sizeof(out), "%d %d", args, 0);
+    assert(formatted == (size_t)-1);
+    unsigned char value[] = {0x53};
+    formatted = sn_binary_format(out, sizeof(out), "[%d]", value, sizeof(value));
+    assert(formatted == 5 && strcmp(out, "[-42]") == 0);
+
+    printf("✓ passed\n");
+}
+
+static void test_mmap_sink(void) {
+    printf("Running test_mmap_sink...\n");
+
+    static char contents[16384];
+    static char expected[16384];
+
+    char dir[] = "/tmp/sn_logger_test_XXXXXX";
+    char *created = mkdtemp(dir);
+    assert(created);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/app.log", dir);
+
+    const size_t segment_size = 4096;
+    snMmapSink segments;
+    bool opened = sn_mmap_sink_init(&segments, path, segment_size);
+    assert(opened);
+
+    char buffer[16384];
+    snSink sinks[] = {sn_mmap_sink(&segments)};
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+    size_t expected_len = 0;
+    for (int i = 0; i < 500; ++i) {
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "segment record %d", i);
+        expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "segment record %d\n", i);
+        if (i % 100 == 99) sn_async_logger_drain(&al);
+    }
+
+    // Larger than a segment, split
+    static char large[6000];
+    memset(large, 'y', sizeof(large) - 1);
+    large[sizeof(large) - 1] = 0;
+    sn_async_logger_log_raw(&al, SN_LOG_LEVEL_INFO, large, sizeof(large) - 1);
+    expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "%s\n", large);
+
+    sn_async_logger_drain(&al);
+
+    // Batches only copy, system calls are per segment
+    uint64_t syscalls = segments.syscalls;
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "last");
+    expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "last\n");
+    sn_async_logger_drain(&al);
+    assert(segments.syscalls == syscalls);
+
+    sn_async_logger_flush(&al);
+    assert(segments.syscalls == syscalls + 1 && segments.synced == segments.used);
+    assert(segments.bytes_written == expected_len && segments.errors == 0);
+
+    uint64_t segment_count = segments.segments;
+    assert(segment_count > expected_len / segment_size);
+
+    // Closing truncates the last segment
+    sn_async_logger_deinit(&al);
+    assert(segments.map == NULL);
+
+    // Writes after closing are dropped
+    sn_mmap_sink_write("late", 4, SN_LOG_LEVEL_INFO, &segments);
+    assert(segments.dropped == 1 && segments.map == NULL);
+
+    // A restarted sink keeps the segments of the earlier run
+    snMmapSink restarted;
+    opened = sn_mmap_sink_init(&restarted, path, segment_size);
+    assert(opened);
+    assert(restarted.segment == segment_count);
+    sn_mmap_sink_write("restarted", 9, SN_LOG_LEVEL_INFO, &restarted);
+    expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "restarted\n");
+    sn_mmap_sink_close(&restarted);
+    ++segment_count;
+
+    size_t read_len = 0;
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        char segment_path[80];
+        snprintf(segment_path, sizeof(segment_path), "%s.%06u", path, (unsigned)i);
+
+        FILE *file = fopen(segment_path, "rb");
+        assert(file);
+        size_t n = fread(contents + read_len, 1, sizeof(contents) - 1 - read_len, file);
+        assert(n <= segment_size);
+        // Records are only split when larger than a segment
+        assert(n == segment_size || contents[read_len + n - 1] == '\n');
+        read_len += n;
+        fclose(file);
+        remove(segment_path);
+    }
+    contents[read_len] = 0;
+
+    assert(read_len == expected_len);
+    assert(strcmp(contents, expected) == 0);
+
+    // A failed segment is not created again on every write
+    snprintf(path, sizeof(path), "%s/missing/app.log", dir);
+    snMmapSink missing;
+    opened = sn_mmap_sink_init(&missing, path, segment_size);
+    assert(!opened);
+    sn_mmap_sink_write("lost", 4, SN_LOG_LEVEL_INFO, &missing);
+    assert(missing.errors == 1 && missing.syscalls == 1 && missing.dropped == 1);
+    sn_mmap_sink_close(&missing);
+
+    rmdir(dir);
+
+    printf("✓ passed\n");
+}
+
+#ifdef SN_LOGGER_TEST_URING
+static void test_uring_sink(void) {
+    printf("Running test_uring_sink...\n");
+
+    static char contents[16384];
+    static char expected[16384];
+
+    // Files, pipes, and the fallback when no buffers are given
+    for (int mode = 0; mode < 3; ++mode) {
+        FILE *file = NULL;
+        int fds[2] = {-1, -1};
+        int fd;
+
+        if (mode == 1) {
+            int piped = pipe(fds);
+            assert(piped == 0);
+            fd = fds[1];
+        } else {
+            file = tmpfile();
+            assert(file);
+            fd = fileno(file);
+        }
+
+        static char sink_buffer[4 * 256];
+        snUringSink uring_sink;
+        bool active = sn_uring_sink_init(&uring_sink, fd, sink_buffer, sizeof(sink_buffer), mode == 2 ? 0 : 4);
+        if (mode == 2) assert(!active);
+        // io_uring may be unavailable (old kernel, seccomp), the sink falls back
+        if (!active) assert(uring_sink.file.buffer == sink_buffer);
+
+        char buffer[8192];
+        snSink sinks[] = {sn_uring_sink(&uring_sink)};
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+        size_t expected_len = 0;
+        for (int i = 0; i < 300; ++i) {
+            sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "uring record %d", i);
+            expected_len += (size_t)snprintf(expected + expected_len, sizeof(expected) - expected_len, "uring record %d\n", i);
+            if (i % 50 == 49) sn_async_logger_drain(&al);
+        }
+
+        sn_async_logger_drain_and_flush(&al);
+
+        if (active) {
+            assert(uring_sink.in_flight == 0 && uring_sink.errors == 0);
+            assert(uring_sink.bytes_written == expected_len);
+            assert(uring_sink.submissions >= expected_len / 256);
+        } else {
+            assert(uring_sink.file.bytes_written == expected_len);
+        }
+
+        if (mode == 1) {
+            size_t read_len = 0;
+            while (read_len < expected_len) {
+                ssize_t n = read(fds[0], contents + read_len, sizeof(contents) - 1 - read_len);
+                assert(n > 0);
+                read_len += (size_t)n;
+            }
+            contents[read_len] = 0;
+            assert(read_len == expected_len);
+        } else {
+            size_t file_len = read_file(file, contents, sizeof(contents));
+            assert(file_len == expected_len);
+        }
+        assert(strcmp(contents, expected) == 0);
+
+        sn_async_logger_deinit(&al);
+        sn_uring_sink_deinit(&uring_sink);
+
+        if (file) {
+            // The file position is left after the written records
+            assert(lseek(fd, 0, SEEK_CUR) == (off_t)expected_len);
+            fclose(file);
+        }
+        if (fds[0] >= 0) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+
+    // A flush gives up on its writes when io_uring_enter fails
+    FILE *file = tmpfile();
+    assert(file);
+
+    static char sink_buffer[4 * 256];
+    snUringSink uring_sink;
+    if (sn_uring_sink_init(&uring_sink, fileno(file), sink_buffer, sizeof(sink_buffer), 4)) {
+        int ring_fd = uring_sink.ring_fd;
+
+        // Not an io_uring instance
+        uring_sink.ring_fd = fileno(file);
+        sn_uring_sink_write("lost", 4, SN_LOG_LEVEL_INFO, &uring_sink);
+        sn_uring_sink_flush(&uring_sink);
+        assert(uring_sink.in_flight == 0 && uring_sink.errors > 0 && uring_sink.bytes_written == 0);
+
+        // The abandoned write is not submitted later
+        uring_sink.ring_fd = ring_fd;
+        uint64_t errors = uring_sink.errors;
+        sn_uring_sink_write("kept", 4, SN_LOG_LEVEL_INFO, &uring_sink);
+        sn_uring_sink_flush(&uring_sink);
+        assert(uring_sink.errors == errors && uring_sink.bytes_written == 5);
+        // The offsets of the dropped data are left as a hole
+        size_t file_len = read_file(file, contents, sizeof(contents));
+        assert(file_len == 10 && memcmp(contents + 5, "kept\n", 5) == 0);
+    }
+
+    sn_uring_sink_deinit(&uring_sink);
+    fclose(file);
+
+    printf("✓ passed\n");
+}
+#endif
+
+typedef struct {
+    LineSink lines;
+    const snLogSite *sites[LINE_LOGS];
+    snLogLevel levels[LINE_LOGS];
+} SiteSink;
+
+static void site_sink_write_record(const snSinkRecord *record, void *data) {
+    SiteSink *sink = data;
+
+    if (sink->lines.count < LINE_LOGS) {
+        sink->sites[sink->lines.count] = record->site;
+        sink->levels[sink->lines.count] = record->level;
+    }
+
+    line_sink_write(record->msg, record->len, record->level, &sink->lines);
+}
+
+static int evaluated;
+
+static int count_evaluation(void) {
+    return ++evaluated;
+}
+
+static void test_async_log_sites(void) {
+    printf("Running test_async_log_sites...\n");
+
+    for (int deferred = 0; deferred < 2; ++deferred) {
+        char buffer[4096];
+        char format_buffer[LINE_LEN];
+        static SiteSink sink;
+        memset(&sink, 0, sizeof(sink));
+
+        snSink sinks[] = {
+            {.write_record = site_sink_write_record, .data = &sink}
+        };
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+        sn_async_logger_set_level(&al, SN_LOG_LEVEL_DEBUG);
+        if (deferred) sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+
+        evaluated = 0;
+        int n = 0;
+
+        int first_line = __LINE__ + 2;
+        for (int i = 0; i < 3; ++i)
+            SN_ALOG_INFO(&al, "site %d %s|%.*s|%5.1f", i, "x", 2, "abcdef", 2.25);
+        SN_ALOG_TRACE(&al, "filtered %d", count_evaluation());
+        SN_ALOG_ERROR(&al, "no arguments");
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "plain %d", 5);
+        // Not capturable, formatted eagerly
+        SN_ALOG_WARN(&al, "count%n %d", &n, 7);
+
+        sn_async_logger_drain(&al);
+        assert(al.dropped == 0);
+        assert(evaluated == 0);
+
+        assert(sink.lines.count == 6);
+        assert(strcmp(sink.lines.logs[0], "site 0 x|ab|  2.2") == 0);
+        assert(strcmp(sink.lines.logs[2], "site 2 x|ab|  2.2") == 0);
+        assert(strcmp(sink.lines.logs[3], "no arguments") == 0);
+        assert(strcmp(sink.lines.logs[4], "plain 5") == 0);
+        assert(strcmp(sink.lines.logs[5], "count 7") == 0);
+
+        const snLogSite *site = sink.sites[0];
+        assert(site && sink.sites[1] == site && sink.sites[2] == site);
+        assert(site->line == (uint32_t)first_line);
+        assert(site->level == SN_LOG_LEVEL_INFO && sink.levels[0] == SN_LOG_LEVEL_INFO);
+        assert(strcmp(site->function, "test_async_log_sites") == 0);
+        assert(strstr(site->file, "test.c"));
+        assert(strcmp(site->fmt, "site %d %s|%.*s|%5.1f") == 0);
+
+        assert(sink.sites[3] && sink.sites[3]->level == SN_LOG_LEVEL_ERROR);
+        assert(sink.sites[4] == NULL);
+        assert(sink.sites[5] && sink.levels[5] == SN_LOG_LEVEL_WARN);
+
+        // Parsed on first use only when capturing
+        assert(site->state->args_state == (deferred ? SN_LOG_SITE_ARGS_READY : SN_LOG_SITE_ARGS_UNPARSED));
+        if (deferred) assert(sink.sites[5]->state->args_state == SN_LOG_SITE_ARGS_UNSUPPORTED);
+
+        sn_async_logger_deinit(&al);
+    }
+
+    printf("✓ passed\n");
+}
+
+static void log_site_modes_emit(snStaticLogger *logger, int i) {
+    SN_SLOG_DEBUG(logger, "debug %d", i);
+    SN_SLOG_INFO(logger, "info %d", i);
+}
+
+static void test_log_site_modes(void) {
+    printf("Running test_log_site_modes...\n");
+
+    char buffer[LINE_LEN];
+    static SiteSink sink;
+    memset(&sink, 0, sizeof(sink));
+
+    snSink sinks[] = {
+        {.write_record = site_sink_write_record, .data = &sink}
+    };
+
+    snStaticLogger sl;
+    sn_static_logger_init(&sl, buffer, sizeof(buffer), sinks, 1);
+    sn_static_logger_set_level(&sl, SN_LOG_LEVEL_INFO);
+
+    // Sites register on first execution even when filtered
+    log_site_modes_emit(&sl, 0);
+    assert(sink.lines.count == 1);
+    assert(strcmp(sink.lines.logs[0], "info 0") == 0);
+
+    const snLogSite *debug_site = NULL;
+    const snLogSite *info_site = sink.sites[0];
+    size_t found = 0;
+    for (const snLogSite *site = sn_log_site_next(NULL); site; site = sn_log_site_next(site)) {
+        if (strcmp(site->function, "log_site_modes_emit") != 0) continue;
+        if (site->level == SN_LOG_LEVEL_DEBUG) debug_site = site;
+        ++found;
+    }
+    assert(found == 2 && debug_site && info_site);
+    assert(debug_site->line + 1 == info_site->line);
+
+    // Enable a single debug site without lowering the logger level
+    size_t changed = sn_log_sites_set_mode("test.c", debug_site->line, NULL, SN_LOG_SITE_ENABLED);
+    assert(changed == 1);
+    assert(sn_log_site_get_mode(debug_site) == SN_LOG_SITE_ENABLED);
+    sn_log_site_set_mode(info_site, SN_LOG_SITE_DISABLED);
+    log_site_modes_emit(&sl, 1);
+    assert(sink.lines.count == 2);
+    assert(strcmp(sink.lines.logs[1], "debug 1") == 0);
+    assert(sink.sites[1] == debug_site && sink.levels[1] == SN_LOG_LEVEL_DEBUG);
+
+    // Back to the logger level
+    changed = sn_log_sites_set_mode(NULL, 0, "log_site_modes_emit", SN_LOG_SITE_DEFAULT);
+    assert(changed == 2);
+    assert(sn_log_site_get_mode(info_site) == SN_LOG_SITE_DEFAULT);
+    log_site_modes_emit(&sl, 2);
+    assert(sink.lines.count == 3);
+    assert(strcmp(sink.lines.logs[2], "info 2") == 0);
+
+    changed = sn_log_sites_set_mode("missing.c", 0, NULL, SN_LOG_SITE_ENABLED);
+    assert(changed == 0);
+
+    sn_static_logger_deinit(&sl);
+
+    printf("✓ passed\n");
+}
+
+typedef struct {
+    LineSink lines;
+    uint64_t sequences[LINE_LOGS];
+    uint64_t timestamps[LINE_LOGS];
+} ClockSink;
+
+static void clock_sink_write_record(const snSinkRecord *record, void *data) {
+    ClockSink *sink = data;
+
+    if (sink->lines.count < LINE_LOGS) {
+        sink->sequences[sink->lines.count] = record->sequence;
+        sink->timestamps[sink->lines.count] = record->timestamp;
+    }
+
+    line_sink_write(record->msg, record->len, record->level, &sink->lines);
+}
+
+static uint64_t manual_clock(void *data) {
+    return *(uint64_t *)data;
+}
+
+static uint64_t offset_clock(void *data) {
+    return (uint64_t)((int64_t)sn_clock_monotonic(NULL) + *(int64_t *)data);
+}
+
+static void *tsc_reader_thread(void *arg) {
+    snTscClock *tsc = arg;
+
+    uint64_t last = 0;
+    for (int i = 0; i < 100000; ++i) {
+        uint64_t now = sn_clock_tsc(tsc);
+        // Conversions are never torn by a concurrent calibration
+        assert(now + 1000000000 > last);
+        last = now;
+    }
+
+    return NULL;
+}
+
+static void test_async_clock(void) {
+    printf("Running test_async_clock...\n");
+
+    // Timestamps are taken when logging, not when processing
+    for (int deferred = 0; deferred < 2; ++deferred) {
+        char buffer[4096];
+        char format_buffer[LINE_LEN];
+        static ClockSink sink;
+        memset(&sink, 0, sizeof(sink));
+
+        snSink sinks[] = {
+            {.write_record = clock_sink_write_record, .data = &sink}
+        };
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+        if (deferred) sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "no clock");
+
+        uint64_t now = 1000;
+        sn_async_logger_set_clock(&al, manual_clock, &now);
+
+        for (int i = 0; i < 5; ++i) {
+            now += 100;
+            if (i & 1)
+                SN_ALOG_INFO(&al, "site %d", i);
+            else
+                sn_async_logger_log_raw(&al, SN_LOG_LEVEL_INFO, "raw", 3);
+        }
+
+        now = 5000;
+        sn_async_logger_drain(&al);
+
+        assert(sink.lines.count == 6);
+        assert(sink.timestamps[0] == 0 && sink.sequences[0] == 1);
+        for (size_t i = 1; i < 6; ++i) {
+            assert(sink.sequences[i] == i + 1);
+            assert(sink.timestamps[i] == 1000 + 100 * i);
+        }
+        assert(strcmp(sink.lines.logs[2], "site 1") == 0);
+
+        sn_async_logger_deinit(&al);
+    }
+
+    // Built-in clocks
+    uint64_t monotonic = sn_clock_monotonic(NULL);
+    uint64_t coarse = sn_clock_monotonic_coarse(NULL);
+    uint64_t realtime = sn_clock_realtime(NULL);
+    assert(monotonic > 0 && coarse > 0);
+    assert(sn_clock_monotonic(NULL) >= monotonic);
+    assert(realtime / 1000000000u >= (uint64_t)time(NULL) - 1 && realtime / 1000000000u <= (uint64_t)time(NULL));
+
+    // The TSC clock follows its reference
+    {
+        int64_t offset = 0;
+        static snTscClock tsc;
+        sn_tsc_clock_init(&tsc, offset_clock, &offset, 1000000);
+
+        const uint64_t tolerance = 20000000;
+        uint64_t reference = sn_clock_monotonic(NULL);
+        uint64_t value = sn_clock_tsc(&tsc);
+        assert(value + tolerance > reference && value < reference + tolerance);
+
+        // Not before the interval elapsed
+        bool recalibrated = sn_tsc_clock_calibrate(&tsc);
+        assert(!recalibrated || sn_clock_monotonic(NULL) - reference > 1000000);
+
+        usleep(5000);
+        recalibrated = sn_tsc_clock_calibrate(&tsc);
+        assert(recalibrated);
+        uint64_t calibrated = sn_clock_tsc(&tsc);
+        assert(calibrated > value);
+        reference = sn_clock_monotonic(NULL);
+        assert(calibrated + tolerance > reference && calibrated < reference + tolerance);
+
+        // Forward steps are followed
+        offset = 10000000000;
+        usleep(2000);
+        recalibrated = sn_tsc_clock_calibrate(&tsc);
+        assert(recalibrated);
+        value = sn_clock_tsc(&tsc);
+        reference = offset_clock(&offset);
+        assert(value + tolerance > reference && value < reference + tolerance);
+
+        // Backward steps are not
+        offset = 0;
+        for (int i = 0; i < 3; ++i) {
+            usleep(2000);
+            sn_tsc_clock_calibrate(&tsc);
+
+            uint64_t next = sn_clock_tsc(&tsc);
+            assert(next >= value);
+            value = next;
+        }
+    }
+
+    // Calibration while other threads read the clock
+    {
+        static snTscClock tsc;
+        sn_tsc_clock_init(&tsc, NULL, NULL, 0);
+
+        pthread_t reader;
+        pthread_create(&reader, NULL, tsc_reader_thread, &tsc);
+        for (int i = 0; i < 1000; ++i)
+            sn_tsc_clock_calibrate(&tsc);
+        pthread_join(reader, NULL);
+    }
+
+    printf("✓ passed\n");
+}
+
+typedef struct {
+    snAsyncLogger *logger;
+    snNotifier *notifier;
+    atomic_int *done;
+} NotifiedConsumerArgs;
+
+typedef struct {
+    snHistogram *histogram;
+    int count;
+} RecorderArgs;
+
+static void *histogram_recorder_thread(void *arg) {
+    RecorderArgs *ra = arg;
+
+    for (int i = 0; i < ra->count; ++i)
+        sn_histogram_record(ra->histogram, (uint64_t)i);
+    return NULL;
+}
+
+static void test_histogram(void) {
+    printf("Running test_histogram...\n");
+
+    static snHistogram histogram, snapshot;
+    sn_histogram_init(&histogram);
+    assert(sn_histogram_percentile(&histogram, 50.0) == 0 && histogram.min == UINT64_MAX);
+
+    // Bucket bounds grow and cover the whole range
+    for (size_t i = 1; i < SN_HISTOGRAM_BUCKETS; ++i)
+        assert(sn_histogram_bucket_upper(i) > sn_histogram_bucket_upper(i - 1));
+    assert(sn_histogram_bucket_upper(SN_HISTOGRAM_BUCKETS - 1) == UINT64_MAX);
+
+    for (uint64_t v = 1; v <= 1000000; v += 7)
+        sn_histogram_record(&histogram, v * 1000);
+    sn_histogram_record(&histogram, UINT64_MAX);
+
+    sn_histogram_snapshot(&histogram, &snapshot, false);
+    assert(snapshot.count == histogram.count && snapshot.min == 1000 && snapshot.max == UINT64_MAX);
+
+    // Percentiles are rounded up by at most one sub-bucket
+    uint64_t p50 = sn_histogram_percentile(&snapshot, 50.0);
+    assert(p50 >= 500000000ull && p50 <= 500000000ull + 500000000ull / SN_HISTOGRAM_SUB_BUCKETS + 7000);
+    uint64_t p99 = sn_histogram_percentile(&snapshot, 99.0);
+    assert(p99 >= 990000000ull && p99 <= 990000000ull + 990000000ull / SN_HISTOGRAM_SUB_BUCKETS + 7000);
+    assert(sn_histogram_percentile(&snapshot, 100.0) == UINT64_MAX);
+    assert(sn_histogram_percentile(&snapshot, 0.0) <= 1000 + 1000 / SN_HISTOGRAM_SUB_BUCKETS);
+
+    // Reset hands every value to exactly one snapshot, even while recording
+    sn_histogram_snapshot(&histogram, &snapshot, true);
+    assert(histogram.count == 0 && histogram.max == 0 && histogram.min == UINT64_MAX);
+
+    enum { RECORDS = 200000 };
+    RecorderArgs args = {.histogram = &histogram, .count = RECORDS};
+    pthread_t recorder;
+    pthread_create(&recorder, NULL, histogram_recorder_thread, &args);
+
+    uint64_t total = 0;
+    for (int i = 0; i < 100; ++i) {
+        sn_histogram_snapshot(&histogram, &snapshot, true);
+        total += snapshot.count;
+    }
+
+    pthread_join(recorder, NULL);
+    sn_histogram_snapshot(&histogram, &snapshot, true);
+    total += snapshot.count;
+    assert(total == RECORDS);
+
+    // Queue residency and sink write durations of the loggers
+    char buffer[4096];
+    static TestSink sink;
+    static BatchSink batch;
+    sink.count = 0;
+    memset(&batch, 0, sizeof(batch));
+
+    static snHistogram queue, writes, batch_writes;
+    sn_histogram_init(&queue);
+    sn_histogram_init(&writes);
+    sn_histogram_init(&batch_writes);
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink, .write_histogram = &writes},
+        {.write_batch = batch_sink_write_batch, .data = &batch, .write_histogram = &batch_writes},
+    };
+
+    uint64_t now = 1000;
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 2);
+    sn_async_logger_set_clock(&al, manual_clock, &now);
+    sn_async_logger_set_queue_histogram(&al, &queue);
+
+    for (int i = 0; i < 3; ++i) {
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+        now += 100;
+    }
+
+    // Queued 300, 200 and 100 ns
+    now = 1300;
+    size_t drained = sn_async_logger_drain(&al);
+    assert(drained == 3);
+
+    sn_histogram_snapshot(&queue, &snapshot, false);
+    assert(snapshot.count == 3 && snapshot.min == 100 && snapshot.max == 300 && snapshot.sum == 600);
+    assert(sn_histogram_percentile(&snapshot, 50.0) >= 200 && sn_histogram_percentile(&snapshot, 50.0) < 300);
+
+    // One sample per write call, one per batch for write_batch
+    assert(writes.count == 3 && batch_writes.count == 1);
+
+    sn_async_logger_deinit(&al);
+
+    snStaticLogger sl;
+    char static_buffer[STATIC_BUF_SIZE];
+    sn_static_logger_init(&sl, static_buffer, sizeof(static_buffer), sinks, 1);
+    sn_static_logger_log(&sl, SN_LOG_LEVEL_INFO, "static");
+    assert(writes.count == 4);
+    sn_static_logger_deinit(&sl);
+
+    printf("✓ passed\n");
+}
+
+static void *notified_consumer_thread(void *arg) {
+    NotifiedConsumerArgs *ca = arg;
+
+    while (!atomic_load(ca->done)) {
+        sn_notifier_wait(ca->notifier, 50000000); // 50ms
+        sn_async_logger_process(ca->logger);
+    }
+
+    while (sn_async_logger_process(ca->logger));
+    return NULL;
+}
+
+typedef struct {
+    snAsyncLogger *logger;
+    int count;
+} RateProducerArgs;
+
+static void *rate_producer_thread(void *arg) {
+    RateProducerArgs *args = arg;
+
+    for (int i = 0; i < args->count; ++i)
+        sn_async_logger_log(args->logger, SN_LOG_LEVEL_INFO, "flood %d", i);
+
+    return NULL;
+}
+
+static void test_rate_limit(void) {
+    printf("Running test_rate_limit...\n");
+
+    for (int deferred = 0; deferred < 2; ++deferred) {
+        char buffer[4096];
+        char format_buffer[256];
+        static LineSink lines;
+        memset(&lines, 0, sizeof(lines));
+
+        snSink sinks[] = {{.write = line_sink_write, .data = &lines}};
+        snAsyncRateSlot slots[8] = {0};
+        uint64_t now = 1000000000ull;
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+        if (deferred) sn_async_logger_set_deferred_formatting(&al, format_buffer, sizeof(format_buffer));
+        sn_async_logger_set_clock(&al, manual_clock, &now);
+        // A message every 100 ms, 3 at once
+        sn_async_logger_set_rate_limit(&al, slots, 8, 10, 3);
+
+        for (int i = 0; i < 10; ++i)
+            sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "tick %d", i);
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "other");
+
+        assert(al.suppressed == 7 && al.dropped == 0);
+
+        // Still empty 50 ms later, a token is back after 100 ms
+        now += 50000000ull;
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "tick %d", 10);
+        now += 50000000ull;
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "tick %d", 11);
+
+        // Call sites have a bucket each
+        uint32_t line = 0;
+        for (int i = 0; i < 7; ++i) {
+            if (i == 5) now += 1000000000ull;
+            SN_ALOG_WARN(&al, "site %d", i);
+            line = __LINE__ - 1;
+        }
+
+        snAsyncLoggerStats stats;
+        sn_async_logger_get_stats(&al, &stats);
+        assert(stats.suppressed == 10 && stats.dropped_total == 0 && stats.dropped[SN_LOG_LEVEL_WARN] == 0);
+
+        sn_async_logger_drain(&al);
+
+        char site_summary[LINE_LEN];
+        snprintf(site_summary, sizeof(site_summary), "suppressed 2 messages from %s:%u", __FILE__, (unsigned)line);
+
+        const char *expected[] = {
+            "tick 0", "tick 1", "tick 2", "other",
+            "suppressed 8 messages of \"tick %d\"", "tick 11",
+            "site 0", "site 1", "site 2",
+            site_summary, "site 5", "site 6",
+        };
+
+        assert(lines.count == SN_ARRAY_LENGTH(expected));
+        for (size_t i = 0; i < SN_ARRAY_LENGTH(expected); ++i)
+            assert(strcmp(lines.logs[i], expected[i]) == 0);
+
+        // A call site that went quiet is reported by the processing once
+        // its bucket has a token again
+        lines.count = 0;
+        now += 1000000000ull;
+        for (int i = 0; i < 5; ++i)
+            sn_async_logger_log(&al, SN_LOG_LEVEL_ERROR, "quiet %d", i);
+
+        sn_async_logger_drain(&al);
+        assert(lines.count == 3 && al.rate_pending == 2);
+
+        now += 100000000ull;
+        sn_async_logger_drain(&al);
+        assert(lines.count == 4 && al.rate_pending == 0);
+        assert(strcmp(lines.logs[3], "suppressed 2 messages of \"quiet %d\"") == 0);
+
+        sn_async_logger_deinit(&al);
+    }
+
+    // Call sites finding no free slot share the overflow bucket, deinit
+    // reports what the buckets still hold
+    {
+        static const char first[] = "first";
+        char buffer[4096];
+        static LineSink lines;
+        memset(&lines, 0, sizeof(lines));
+
+        snSink sinks[] = {{.write = line_sink_write, .data = &lines}};
+        snAsyncRateSlot slots[1] = {0};
+        uint64_t now = 1000000000ull;
+
+        snAsyncLogger al;
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+        sn_async_logger_set_clock(&al, manual_clock, &now);
+        sn_async_logger_set_rate_limit(&al, slots, 1, 10, 1);
+
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, first);
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "second");
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "third");
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, first);
+
+        assert(al.suppressed == 2 && slots[0].suppressed == 1 && al.rate_overflow.suppressed == 1);
+
+        sn_async_logger_deinit(&al);
+
+        const char *expected[] = {
+            "first", "second",
+            "suppressed 1 messages of \"first\"",
+            "suppressed 1 messages from call sites without a rate slot",
+        };
+
+        assert(lines.count == SN_ARRAY_LENGTH(expected));
+        for (size_t i = 0; i < SN_ARRAY_LENGTH(expected); ++i)
+            assert(strcmp(lines.logs[i], expected[i]) == 0);
+    }
+
+    // Concurrent producers on one call site, every message is either
+    // written or reported by a summary
+    enum { PRODUCERS = 4, MSGS = 2000 };
+
+    static char buffer[1 << 17];
+    static TestSink sink;
+    memset(&sink, 0, sizeof(sink));
+
+    snSink sinks[] = {{.write = test_sink_write, .data = &sink}};
+    snAsyncRateSlot slots[16] = {0};
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_rate_limit(&al, slots, 16, 1000, 10);
+
+    MutexCtx mctx;
+    pthread_mutex_init(&mctx.mutex, NULL);
+    sn_async_logger_set_lock_hooks(&al, lock_wrapper, unlock_wrapper, &mctx);
+
+    pthread_t producers[PRODUCERS];
+    RateProducerArgs args = {.logger = &al, .count = MSGS};
+    for (int i = 0; i < PRODUCERS; ++i)
+        pthread_create(&producers[i], NULL, rate_producer_thread, &args);
+    for (int i = 0; i < PRODUCERS; ++i)
+        pthread_join(producers[i], NULL);
+
+    sn_async_logger_drain(&al);
+    assert(al.dropped == 0 && al.suppressed > 0);
+
+    size_t written = 0;
+    size_t reported = 0;
+    for (size_t i = 0; i < sink.count; ++i) {
+        size_t count;
+        if (sscanf(sink.logs[i], "suppressed %zu", &count) == 1) {
+            reported += count;
+        } else {
+            ++written;
+        }
+    }
+
+    size_t pending = 0;
+    for (size_t i = 0; i < SN_ARRAY_LENGTH(slots); ++i)
+        pending += slots[i].suppressed;
+    pending += al.rate_overflow.suppressed;
+
+    assert(written + al.suppressed == PRODUCERS * MSGS);
+    assert(reported + pending == al.suppressed && pending == al.rate_pending);
+
+    sn_async_logger_deinit(&al);
+    pthread_mutex_destroy(&mctx.mutex);
+
+    printf("✓ passed\n");
+}
+
+static void test_async_notifier(void) {
+    printf("Running test_async_notifier...\n");
+
+    char buffer[4096];
+    static TestSink sink;
+    sink.count = 0;
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    snNotifier notifier;
+    bool initialized = sn_notifier_init(&notifier, SN_NOTIFIER_FUTEX);
+    assert(initialized);
+    bool woken = sn_notifier_wait(&notifier, 0);
+    assert(!woken);
+    woken = sn_notifier_wait(&notifier, 1000000);
+    assert(!woken);
+
+    // Record count, fires once until the consumer processed records
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+    sn_async_logger_set_notifier(&al, sn_notifier_notify, &notifier, 10, 0, 0);
+
+    for (int i = 0; i < 9; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(!woken);
+
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-9");
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(woken && notifier.notifications == 1);
+
+    for (int i = 0; i < 20; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "more-%d", i);
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(!woken && notifier.notifications == 1);
+
+    size_t processed = sn_async_logger_process(&al);
+    assert(processed == 30);
+    for (int i = 0; i < 10; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "again-%d", i);
+    woken = sn_notifier_wait(&notifier, SN_NOTIFIER_WAIT_FOREVER);
+    assert(woken && notifier.notifications == 2);
+    sn_async_logger_process(&al);
+
+    // Ring fill level
+    sn_async_logger_set_notifier(&al, sn_notifier_notify, &notifier, 0, 1024, 0);
+    while (notifier.notifications == 2) {
+        size_t used = al.write_offset - al.read_offset;
+        assert(used < 1024);
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "fill");
+    }
+    assert(al.write_offset - al.read_offset >= 1024);
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(woken);
+    sn_async_logger_process(&al);
+
+    // Age of the first pending record, from the logger clock
+    uint64_t now = 100;
+    sn_async_logger_set_clock(&al, manual_clock, &now);
+    sn_async_logger_set_notifier(&al, sn_notifier_notify, &notifier, 0, 0, 1000);
+
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "first");
+    now = 1000;
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "second");
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(!woken);
+    now = 1100;
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "third");
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(woken);
+
+    // The age starts over after processing
+    sn_async_logger_process(&al);
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "fourth");
+    now = 2000;
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "fifth");
+    woken = sn_notifier_wait(&notifier, 0);
+    assert(!woken);
+
+    sn_async_logger_deinit(&al);
+    sn_notifier_deinit(&notifier);
+
+    // eventfd, pollable by the consumer
+    {
+        initialized = sn_notifier_init(&notifier, SN_NOTIFIER_EVENTFD);
+        assert(initialized && notifier.fd >= 0);
+
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+        sn_async_logger_set_notifier(&al, sn_notifier_notify, &notifier, 1, 0, 0);
+
+        struct pollfd pfd = {.fd = notifier.fd, .events = POLLIN};
+        int ready = poll(&pfd, 1, 0);
+        assert(ready == 0);
+
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "ready");
+        ready = poll(&pfd, 1, 0);
+        assert(ready == 1 && (pfd.revents & POLLIN));
+        woken = sn_notifier_wait(&notifier, 0);
+        assert(woken);
+        woken = sn_notifier_wait(&notifier, 0);
+        ready = poll(&pfd, 1, 0);
+        assert(!woken && ready == 0);
+
+        sn_async_logger_deinit(&al);
+        sn_notifier_deinit(&notifier);
+    }
+
+    // A consumer sleeping on the notifier keeps up with producers
+    {
+        enum {
+            PRODUCERS = 2,
+            MSGS_PER_PRODUCER = 2000
+        };
+
+        sink.count = 0;
+        initialized = sn_notifier_init(&notifier, SN_NOTIFIER_FUTEX);
+        assert(initialized);
+
+        sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+        sn_async_logger_set_notifier(&al, sn_notifier_notify, &notifier, 32, sizeof(buffer) / 2, 0);
+        sn_async_logger_set_backpressure(&al, SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_FUTEX);
+
+        MutexCtx mctx;
+        pthread_mutex_init(&mctx.mutex, NULL);
+        sn_async_logger_set_lock_hooks(&al, lock_wrapper, unlock_wrapper, &mctx);
+
+        atomic_int done = 0;
+        NotifiedConsumerArgs cargs = {.logger = &al, .notifier = &notifier, .done = &done};
+        pthread_t consumer;
+        pthread_create(&consumer, NULL, notified_consumer_thread, &cargs);
+
+        pthread_t prod[PRODUCERS];
+        ProducerArgs pargs[PRODUCERS];
+        for (int i = 0; i < PRODUCERS; ++i) {
+            pargs[i] = (ProducerArgs){.logger = &al, .thread_id = i, .count = MSGS_PER_PRODUCER};
+            pthread_create(&prod[i], NULL, producer_thread, &pargs[i]);
+        }
+
+        for (int i = 0; i < PRODUCERS; ++i)
+            pthread_join(prod[i], NULL);
+
+        atomic_store(&done, 1);
+        sn_notifier_notify(&notifier);
+        pthread_join(consumer, NULL);
+
+        assert(sink.count == PRODUCERS * MSGS_PER_PRODUCER && al.dropped == 0);
+        assert(notifier.notifications > 1);
+
+        sn_async_logger_deinit(&al);
+        pthread_mutex_destroy(&mctx.mutex);
+        sn_notifier_deinit(&notifier);
+    }
+
+    printf("✓ passed\n");
+}
+
+#ifdef SN_LOGGER_TEST_WORKER
+static void test_worker_run(snWorkerMode mode) {
+    enum {
+        LOGGERS = 2,
+        MSGS_PER_PRODUCER = 3000
+    };
+
+    static char buffers[LOGGERS][2048];
+    static FlushSink sinks_data[LOGGERS];
+    snSink sinks[LOGGERS];
+    snAsyncLogger loggers[LOGGERS];
+    MutexCtx mctx[LOGGERS];
+
+    // Pin to a CPU the test is allowed to run on
+    cpu_set_t allowed;
+    int affinity = sched_getaffinity(0, sizeof(allowed), &allowed);
+    assert(affinity == 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) ++cpu;
+
+    snWorkerConfig config;
+    sn_worker_config_default(&config);
+    config.mode = mode;
+    config.cpu = cpu;
+    config.flush_interval = 1000000; // 1ms
+    config.notify_records = 16;
+
+    snWorker worker;
+    sn_worker_init(&worker, &config);
+
+    for (int i = 0; i < LOGGERS; ++i) {
+        memset(&sinks_data[i], 0, sizeof(sinks_data[i]));
+        sinks[i] = (snSink){.write = test_sink_write, .flush = flush_sink_flush, .data = &sinks_data[i]};
+
+        sn_async_logger_init(&loggers[i], buffers[i], sizeof(buffers[i]), &sinks[i], 1);
+        sn_async_logger_set_backpressure(&loggers[i], SN_BACKPRESSURE_BLOCK, SN_BACKPRESSURE_WAIT_FUTEX);
+
+        pthread_mutex_init(&mctx[i].mutex, NULL);
+        sn_async_logger_set_lock_hooks(&loggers[i], lock_wrapper, unlock_wrapper, &mctx[i]);
+
+        bool added = sn_worker_add(&worker, &loggers[i]);
+        assert(added);
+    }
+
+    bool started = sn_worker_start(&worker);
+    assert(started);
+
+    pthread_t prod[LOGGERS];
+    ProducerArgs pargs[LOGGERS];
+    for (int i = 0; i < LOGGERS; ++i) {
+        pargs[i] = (ProducerArgs){.logger = &loggers[i], .thread_id = i, .count = MSGS_PER_PRODUCER};
+        pthread_create(&prod[i], NULL, producer_thread, &pargs[i]);
+    }
+
+    for (int i = 0; i < LOGGERS; ++i)
+        pthread_join(prod[i], NULL);
+
+    // Let the periodic flush run at least once
+    usleep(5000);
+
+    // A last record is still drained on shutdown
+    sn_async_logger_log(&loggers[0], SN_LOG_LEVEL_INFO, "last");
+
+    sn_worker_stop(&worker);
+
+    assert(worker.pinned);
+    assert(worker.processed == LOGGERS * MSGS_PER_PRODUCER + 1);
+    assert(worker.flushes > 0);
+    if (mode == SN_WORKER_BLOCKING) assert(worker.sleeps > 0);
+
+    for (int i = 0; i < LOGGERS; ++i) {
+        TestSink *sink = &sinks_data[i].base;
+        assert(loggers[i].dropped == 0);
+        assert(sinks_data[i].flush_count > 1);
+        assert(!loggers[i].notify);
+
+        size_t expected = MSGS_PER_PRODUCER + (i == 0);
+        assert(sink->count == expected);
+
+        for (int j = 0; j < MSGS_PER_PRODUCER; ++j) {
+            uint64_t seq;
+            int thread_id, msg;
+            int fields = sscanf(sink->logs[j], "%lu t%d-%d", &seq, &thread_id, &msg);
+            assert(fields == 3 && thread_id == i && msg == j);
+        }
+
+        sn_async_logger_deinit(&loggers[i]);
+        pthread_mutex_destroy(&mctx[i].mutex);
+    }
+
+    assert(strcmp(sinks_data[0].base.logs[MSGS_PER_PRODUCER], "last") == 0);
+}
+
+static void test_worker(void) {
+    printf("Running test_worker...\n");
+
+    test_worker_run(SN_WORKER_BLOCKING);
+    test_worker_run(SN_WORKER_BUSY_POLL);
+
+    // Too many loggers
+    snWorker worker;
+    sn_worker_init(&worker, NULL);
+    char buffer[256];
+    static snAsyncLogger loggers[SN_WORKER_MAX_LOGGERS + 1];
+    for (int i = 0; i < SN_WORKER_MAX_LOGGERS; ++i) {
+        sn_async_logger_init(&loggers[i], buffer, sizeof(buffer), NULL, 0);
+        bool added = sn_worker_add(&worker, &loggers[i]);
+        assert(added);
+    }
+    bool added = sn_worker_add(&worker, &loggers[SN_WORKER_MAX_LOGGERS]);
+    assert(!added);
+    sn_worker_stop(&worker);
+
+    printf("✓ passed\n");
+}
+#endif
+
+static void test_async_process_n(void) {
+    printf("Running test_async_process_n...\n");
+
+    char buffer[4096];
+    TestSink sink = {0};
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+    for (int i = 0; i < 20; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+
+    size_t p1 = sn_async_logger_process_n(&al, 7);
+    assert(p1 == 7);
+    assert(sink.count == 7);
+
+    size_t p2 = sn_async_logger_process_n(&al, 7);
+    assert(p2 == 7);
+    assert(sink.count == 14);
+
+    size_t p3 = sn_async_logger_process_n(&al, 100);
+    assert(p3 == 6);
+    assert(sink.count == 20);
+
+    sn_async_logger_deinit(&al);
+
+    printf("✓ passed\n");
+}
+
+static void test_async_drain(void) {
+    printf("Running test_async_drain...\n");
+
+    char buffer[4096];
+    TestSink sink = {0};
+
+    snSink sinks[] = {
+        {.write = test_sink_write, .data = &sink}
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+    for (int i = 0; i < 50; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+
+    size_t drained = sn_async_logger_drain(&al);
+
+    assert(drained == 50);
+    assert(sink.count == 50);
+
+    sn_async_logger_deinit(&al);
+
+    printf("✓ passed\n");
+}
+
+static void test_async_flush_only(void) {
+    printf("Running test_async_flush_only...\n");
+
+    char buffer[4096];
+    FlushSink sink = {0};
+
+    snSink sinks[] = {
+        {
+            .write = test_sink_write,
+            .flush = flush_sink_flush,
+            .data = &sink
+        }
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+    sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "hello");
+
+    sn_async_logger_flush(&al);
+
+    assert(sink.flush_count == 1);
+    assert(sink.base.count == 0); // NOT processed
+
+    sn_async_logger_deinit(&al);
+
+    printf("✓ passed\n");
+}
+
+static void test_async_drain_and_flush(void) {
+    printf("Running test_async_drain_and_flush...\n");
+
+    char buffer[4096];
+    FlushSink sink = {0};
+
+    snSink sinks[] = {
+        {
+            .write = test_sink_write,
+            .flush = flush_sink_flush,
+            .data = &sink
+        }
+    };
+
+    snAsyncLogger al;
+    sn_async_logger_init(&al, buffer, sizeof(buffer), sinks, 1);
+
+    for (int i = 0; i < 10; ++i)
+        sn_async_logger_log(&al, SN_LOG_LEVEL_INFO, "msg-%d", i);
+
+    sn_async_logger_drain_and_flush(&al);
+
+    assert(sink.base.count == 10);
+    assert(sink.flush_count == 1);
+
+    sn_async_logger_deinit(&al);
+
+    printf("✓ passed\n");
+}
+
+int main(void) {
+    test_static_basic();
+    test_static_truncation();
+    test_static_log_level();
+    test_static_formatting();
 
     printf("All static logger tests passed!\n\n");
 
     test_async_single_thread_ordering();
     test_async_multi_producer_ordering();
+    test_async_lock_free_multi_producer();
+    test_async_sharded_multi_producer();
+    test_async_shard_reclaim();
     test_async_drop_behavior();
+    test_async_backpressure();
+
+    test_async_deferred_formatting();
+    test_async_write_batch();
+    test_sink_levels();
+    test_sink_cursors();
+    test_async_overflow_segments();
+    test_async_stats();
+    test_file_sink();
+    test_binary_sink();
+    test_mmap_sink();
+#ifdef SN_LOGGER_TEST_URING
+    test_uring_sink();
+#endif
+    test_async_log_sites();
+    test_log_site_modes();
+    test_async_clock();
+    test_histogram();
+    test_rate_limit();
+    test_async_notifier();
+#ifdef SN_LOGGER_TEST_WORKER
+    test_worker();
+#endif
 
     printf("All async logger tests passed!\n\n");
 
@@ -0,0 +1,260 @@
+/**
+ * snlog-decode: turn binary log files written by snBinarySink into text.
+ *
+ * Usage: snlog-decode [file...]
+ *
+ * Reads standard input when no file (or "-") is given. Every record is
+ * printed on its own line as "sequence [seconds.nanoseconds] LEVEL
+ * [file:line: ]message", the timestamp only if the logger had a clock.
+ */
+
+#include <snlogger/binary_sink.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct descriptor {
+    snLogLevel level;
+    uint64_t line;
+    char *file;
+    char *function;
+    char *fmt;
+} descriptor;
+
+typedef struct decoder {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+
+    descriptor *descriptors;
+    size_t descriptor_count;
+    size_t descriptor_capacity;
+
+    uint64_t sequence;
+    uint64_t timestamp;
+
+    char *message;
+    size_t message_size;
+} decoder;
+
+static const char *level_names[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+static bool read_varint(decoder *d, uint64_t *value) {
+    *value = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (d->offset == d->size) return false;
+
+        unsigned char byte = d->data[d->offset++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+
+    return false;
+}
+
+static bool read_bytes(decoder *d, size_t len, const unsigned char **bytes) {
+    if (d->size - d->offset < len) return false;
+
+    *bytes = d->data + d->offset;
+    d->offset += len;
+    return true;
+}
+
+static bool read_string(decoder *d, char **str) {
+    uint64_t len;
+    const unsigned char *bytes;
+    if (!read_varint(d, &len) || len > d->size || !read_bytes(d, (size_t)len, &bytes)) return false;
+
+    *str = malloc((size_t)len + 1);
+    if (!*str) return false;
+
+    memcpy(*str, bytes, (size_t)len);
+    (*str)[len] = 0;
+    return true;
+}
+
+static bool read_descriptor(decoder *d, snLogLevel level) {
+    uint64_t id;
+    descriptor desc = {.level = level};
+    if (!read_varint(d, &id) || !read_varint(d, &desc.line)) return false;
+
+    if (id != d->descriptor_count) {
+        fprintf(stderr, "snlog-decode: unexpected descriptor id %llu\n", (unsigned long long)id);
+        return false;
+    }
+
+    if (!read_string(d, &desc.file) || !read_string(d, &desc.function) || !read_string(d, &desc.fmt)) {
+        free(desc.file);
+        free(desc.function);
+        return false;
+    }
+
+    if (d->descriptor_count == d->descriptor_capacity) {
+        size_t capacity = d->descriptor_capacity ? 2 * d->descriptor_capacity : 64;
+        descriptor *descriptors = realloc(d->descriptors, capacity * sizeof(*descriptors));
+        if (!descriptors) return false;
+
+        d->descriptors = descriptors;
+        d->descriptor_capacity = capacity;
+    }
+
+    d->descriptors[d->descriptor_count++] = desc;
+    return true;
+}
+
+static void print_record(decoder *d, snLogLevel level, const descriptor *desc, const char *msg, size_t len) {
+    printf("%llu ", (unsigned long long)d->sequence);
+    if (d->timestamp) {
+        printf("%llu.%09llu ", (unsigned long long)(d->timestamp / 1000000000u),
+                (unsigned long long)(d->timestamp % 1000000000u));
+    }
+    printf("%-5s ", level <= SN_LOG_LEVEL_FATAL ? level_names[level] : "?");
+    if (desc && desc->file[0]) printf("%s:%llu: ", desc->file, (unsigned long long)desc->line);
+    fwrite(msg, 1, len, stdout);
+    putchar('\n');
+}
+
+static bool read_message(decoder *d, snLogLevel level) {
+    uint64_t id;
+    uint64_t args_size;
+    const unsigned char *args;
+    if (!read_varint(d, &id) || !read_varint(d, &args_size) || !read_bytes(d, (size_t)args_size, &args)) return false;
+
+    if (id >= d->descriptor_count) {
+        fprintf(stderr, "snlog-decode: unknown descriptor id %llu\n", (unsigned long long)id);
+        return false;
+    }
+
+    const descriptor *desc = &d->descriptors[id];
+
+    for (;;) {
+        size_t len = sn_binary_format(d->message, d->message_size, desc->fmt, args, (size_t)args_size);
+        if (len == (size_t)-1) {
+            fprintf(stderr, "snlog-decode: arguments do not match \"%s\"\n", desc->fmt);
+            return false;
+        }
+
+        if (len < d->message_size) {
+            print_record(d, level, desc, d->message, len);
+            return true;
+        }
+
+        char *message = realloc(d->message, len + 1);
+        if (!message) return false;
+
+        d->message = message;
+        d->message_size = len + 1;
+    }
+}
+
+static bool decode(decoder *d) {
+    const unsigned char *header;
+    if (!read_bytes(d, SN_BINARY_HEADER_SIZE, &header) || memcmp(header, SN_BINARY_MAGIC, 4) != 0) {
+        fprintf(stderr, "snlog-decode: not a binary log file\n");
+        return false;
+    }
+
+    if (header[4] != SN_BINARY_VERSION) {
+        fprintf(stderr, "snlog-decode: unsupported version %u\n", header[4]);
+        return false;
+    }
+
+    while (d->offset < d->size) {
+        unsigned tag = d->data[d->offset++];
+        unsigned type = tag & 0x3u;
+        snLogLevel level = (snLogLevel)((tag >> 2) & 0x7u);
+
+        if (type == SN_BINARY_RECORD_DESCRIPTOR) {
+            if (!read_descriptor(d, level)) return false;
+            continue;
+        }
+
+        uint64_t sequence;
+        uint64_t timestamp;
+        if (!read_varint(d, &sequence) || !read_varint(d, &timestamp)) return false;
+        d->sequence += (sequence >> 1) ^ (0 - (sequence & 1));
+        d->timestamp += (timestamp >> 1) ^ (0 - (timestamp & 1));
+
+        if (type == SN_BINARY_RECORD_ARGS) {
+            if (!read_message(d, level)) return false;
+        } else if (type == SN_BINARY_RECORD_TEXT) {
+            uint64_t len;
+            const unsigned char *msg;
+            if (!read_varint(d, &len) || !read_bytes(d, (size_t)len, &msg)) return false;
+            print_record(d, level, NULL, (const char *)msg, (size_t)len);
+        } else {
+            fprintf(stderr, "snlog-decode: unknown record type %u\n", type);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static unsigned char *read_file(FILE *file, size_t *size) {
+    size_t capacity = 1 << 16;
+    unsigned char *data = malloc(capacity);
+    *size = 0;
+
+    while (data) {
+        *size += fread(data + *size, 1, capacity - *size, file);
+        if (*size < capacity) break;
+
+        capacity *= 2;
+        unsigned char *grown = realloc(data, capacity);
+        if (!grown) free(data);
+        data = grown;
+    }
+
+    return data;
+}
+
+static bool decode_file(const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+
+    decoder d = {0};
+    unsigned char *data = read_file(file, &d.size);
+    if (file != stdin) fclose(file);
+
+    if (!data) {
+        fprintf(stderr, "snlog-decode: out of memory\n");
+        return false;
+    }
+
+    d.data = data;
+    bool ok = decode(&d);
+    if (!ok && d.offset <= d.size) fprintf(stderr, "%s: corrupted or truncated at byte %zu\n", path, d.offset);
+
+    for (size_t i = 0; i < d.descriptor_count; ++i) {
+        free(d.descriptors[i].file);
+        free(d.descriptors[i].function);
+        free(d.descriptors[i].fmt);
+    }
+    free(d.descriptors);
+    free(d.message);
+    free(data);
+
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) return decode_file("-") ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    bool ok = true;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printf("Usage: %s [file...]\nDecodes binary log files written by snBinarySink.\n", argv[0]);
+            return EXIT_SUCCESS;
+        }
+
+        ok = decode_file(argv[i]) && ok;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}